@@ -21,16 +21,30 @@
 #include "app/Aligns.hh"
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/optional.hpp>
 
 #include "spdlog/spdlog.h"
 
 #include "graphalign/GraphAlignmentOperations.hh"
 
+#include "app/MateBuffer.hh"
+
 extern "C"
 {
+#include "htslib/bgzf.h"
 #include "htslib/faidx.h"
 #include "htslib/hts.h"
 #include "htslib/sam.h"
@@ -45,174 +59,689 @@ using std::map;
 using std::string;
 using std::vector;
 
-FragById getAligns(const string& readsPath, const string& referencePath, const LocusSpecification& locusSpec)
+// Owners of htslib handles, so that they are released however extraction ends
+using HtsFilePtr = std::unique_ptr<htsFile, int (*)(htsFile*)>;
+using HtsHeaderPtr = std::unique_ptr<bam_hdr_t, void (*)(bam_hdr_t*)>;
+using HtsIndexPtr = std::unique_ptr<hts_idx_t, void (*)(hts_idx_t*)>;
+using HtsIteratorPtr = std::unique_ptr<hts_itr_t, void (*)(hts_itr_t*)>;
+
+struct QueryRegion
 {
-    htsFile* htsFilePtr = nullptr;
-    bam_hdr_t* htsHeaderPtr = nullptr;
-    hts_idx_t* htsIndexPtr = nullptr;
-    hts_itr_t* htsRegionPtr = nullptr;
-    bam1_t* htsAlignmentPtr = nullptr;
+    string contigName;
+    int64_t start;
+    int64_t end;
+};
 
-    htsFilePtr = sam_open(readsPath.c_str(), "r");
-    if (!htsFilePtr)
+static vector<QueryRegion> getQueryRegions(const string& referencePath, const LocusSpecification& locusSpec)
+{
+    vector<GenomicRegion> regions = locusSpec.targetReadExtractionRegions();
+    const auto& offtargetRegions = locusSpec.offtargetReadExtractionRegions();
+    regions.insert(regions.end(), offtargetRegions.begin(), offtargetRegions.end());
+
+    // In case the reference is not fully compatible with the BAM
+    faidx_t* referenceIndex = fai_load(referencePath.c_str());
+    if (!referenceIndex)
     {
-        throw std::runtime_error("Failed to read BAM file " + readsPath);
+        throw std::runtime_error("Failed to read reference index " + referencePath);
     }
 
-    // Required step for parsing of some CRAMs
-    if (hts_set_fai_filename(htsFilePtr, referencePath.c_str()) != 0)
+    vector<QueryRegion> queryRegions;
+    for (const auto& region : regions)
     {
-        throw std::runtime_error("Failed to set index of: " + referencePath);
+        const char* contigName = faidx_iseq(referenceIndex, region.contigIndex());
+        if (!contigName)
+        {
+            fai_destroy(referenceIndex);
+            throw std::runtime_error("Failed to resolve contig for region");
+        }
+        const string contigNameStr(contigName);
+        if (region.start() >= region.end())
+        {
+            fai_destroy(referenceIndex);
+            throw std::runtime_error("Invalid query region bounds for " + contigNameStr);
+        }
+
+        queryRegions.push_back({ contigNameStr, region.start(), region.end() });
     }
+    fai_destroy(referenceIndex);
 
-    htsHeaderPtr = sam_hdr_read(htsFilePtr);
-    if (!htsHeaderPtr)
+    return queryRegions;
+}
+
+// Query region with its contig resolved to an index of the header of the reads file
+using ResolvedQueryRegion = std::pair<int, QueryRegion>;
+
+template <typename GetContigIndex>
+static vector<ResolvedQueryRegion>
+resolveQueryRegions(const string& referencePath, const LocusSpecification& locusSpec, GetContigIndex getContigIndex)
+{
+    vector<ResolvedQueryRegion> resolvedRegions;
+    for (auto& queryRegion : getQueryRegions(referencePath, locusSpec))
     {
-        throw std::runtime_error("Failed to read header of " + readsPath);
+        const int contigIndex = getContigIndex(queryRegion.contigName);
+        if (contigIndex < 0)
+        {
+            throw std::runtime_error("Failed to find contig " + queryRegion.contigName + " in BAM header");
+        }
+        resolvedRegions.emplace_back(contigIndex, std::move(queryRegion));
     }
+    return resolvedRegions;
+}
 
-    htsIndexPtr = sam_index_load(htsFilePtr, readsPath.c_str());
-    if (!htsIndexPtr)
+// Selects records as the region iterator of the reads file would select them
+static bool
+overlapsQueryRegions(const vector<ResolvedQueryRegion>& queryRegions, int contigIndex, int64_t start, int64_t end)
+{
+    for (const auto& contigAndRegion : queryRegions)
     {
-        throw std::runtime_error("Failed to read index of " + readsPath);
+        const auto& queryRegion = contigAndRegion.second;
+        if (contigAndRegion.first == contigIndex && start < queryRegion.end && queryRegion.start < end)
+        {
+            return true;
+        }
     }
+    return false;
+}
 
-    const GenomicRegion region = locusSpec.variantSpecs().front().referenceLocus();
-
-    // In case the reference is not fully compatible with the BAM
-    faidx_t* referenceIndex = fai_load(referencePath.c_str());
-    if (!referenceIndex)
+/// Creates a single iterator over all read extraction regions of the locus
+///
+/// Index chunks of overlapping regions are merged, so the reads file is scanned once and each record is returned once
+/// even if it overlaps several regions.
+static hts_itr_t* createRegionIterator(
+    hts_idx_t* htsIndexPtr, bam_hdr_t* htsHeaderPtr, const string& referencePath, const LocusSpecification& locusSpec)
+{
+    auto queryRegions = getQueryRegions(referencePath, locusSpec);
+    for (const auto& queryRegion : queryRegions)
     {
-        throw std::runtime_error("Failed to read reference index " + referencePath);
+        if (sam_hdr_name2tid(htsHeaderPtr, queryRegion.contigName.c_str()) < 0)
+        {
+            throw std::runtime_error("Failed to find contig " + queryRegion.contigName + " in BAM header");
+        }
     }
-    const char* contigName = faidx_iseq(referenceIndex, region.contigIndex());
-    if (!contigName)
+    std::sort(
+        queryRegions.begin(), queryRegions.end(), [](const QueryRegion& lhs, const QueryRegion& rhs)
+        { return std::tie(lhs.contigName, lhs.start, lhs.end) < std::tie(rhs.contigName, rhs.start, rhs.end); });
+
+    // Intervals on each contig are kept sorted and disjoint as required by htslib
+    map<string, vector<hts_pair_pos_t>> intervalsByContig;
+    for (const auto& queryRegion : queryRegions)
     {
-        fai_destroy(referenceIndex);
-        throw std::runtime_error("Failed to resolve contig for region");
+        auto& intervals = intervalsByContig[queryRegion.contigName];
+        if (!intervals.empty() && queryRegion.start <= intervals.back().end)
+        {
+            intervals.back().end = std::max<hts_pos_t>(intervals.back().end, queryRegion.end);
+        }
+        else
+        {
+            intervals.push_back({ queryRegion.start, queryRegion.end });
+        }
     }
-    const string contigNameStr(contigName);
-    const int regionContigBamHeaderIndex = sam_hdr_name2tid(htsHeaderPtr, contigNameStr.c_str());
-    fai_destroy(referenceIndex);
-    if (regionContigBamHeaderIndex < 0)
+
+    // htslib takes ownership of the region list and frees it with the iterator; contig names are only read while
+    // the iterator is created
+    auto regionList = static_cast<hts_reglist_t*>(calloc(intervalsByContig.size(), sizeof(hts_reglist_t)));
+    if (!regionList)
     {
-        throw std::runtime_error("Failed to find contig " + contigNameStr + " in BAM header");
+        throw std::runtime_error("Failed to allocate region list");
     }
-
-    const auto& graph = locusSpec.regionGraph();
-    const auto queryRegionStart = std::max(0, static_cast<int>(region.start() - graph.nodeSeq(0).length()));
-    const auto queryRegionEnd = region.end() + graph.nodeSeq(graph.numNodes() - 1).length();
-    if (queryRegionStart >= queryRegionEnd)
+    int regionIndex = 0;
+    for (const auto& contigAndIntervals : intervalsByContig)
     {
-        throw std::runtime_error("Invalid query region bounds for " + contigNameStr);
+        const auto& intervals = contigAndIntervals.second;
+        auto& region = regionList[regionIndex++];
+        region.reg = contigAndIntervals.first.c_str();
+        region.intervals = static_cast<hts_pair_pos_t*>(malloc(intervals.size() * sizeof(hts_pair_pos_t)));
+        if (!region.intervals)
+        {
+            for (int index = 0; index != regionIndex; ++index)
+            {
+                free(regionList[index].intervals);
+            }
+            free(regionList);
+            throw std::runtime_error("Failed to allocate region list");
+        }
+        std::copy(intervals.begin(), intervals.end(), region.intervals);
+        region.count = intervals.size();
+        region.min_beg = intervals.front().beg;
+        region.max_end = intervals.back().end;
     }
-    htsRegionPtr = sam_itr_queryi(htsIndexPtr, regionContigBamHeaderIndex, queryRegionStart, queryRegionEnd);
+
+    hts_itr_t* htsRegionPtr = sam_itr_regions(htsIndexPtr, htsHeaderPtr, regionList, intervalsByContig.size());
     if (htsRegionPtr == nullptr)
     {
         throw std::runtime_error("Failed to extract reads from the specified region");
     }
+    return htsRegionPtr;
+}
 
-    FragById fragById;
-    std::map<string, Read> unpairedCache;
-    htsAlignmentPtr = bam_init1();
-    while (sam_itr_next(htsFilePtr, htsRegionPtr, htsAlignmentPtr) >= 0)
+static string decodeBases(const bam1_t* htsAlignmentPtr)
+{
+    string bases;
+    const uint8_t* htsSeqPtr = bam_get_seq(htsAlignmentPtr);
+    const int readLength = htsAlignmentPtr->core.l_qseq;
+    bases.resize(readLength);
+    for (int index = 0; index != readLength; ++index)
     {
-        // Decode read sequence
-        string bases;
-        uint8_t* htsSeqPtr = bam_get_seq(htsAlignmentPtr);
-        const int readLength = htsAlignmentPtr->core.l_qseq;
-        bases.resize(readLength);
-        for (int index = 0; index != readLength; ++index)
-        {
-            bases[index] = seq_nt16_str[bam_seqi(htsSeqPtr, index)];
-        }
+        bases[index] = seq_nt16_str[bam_seqi(htsSeqPtr, index)];
+    }
+    return bases;
+}
+
+static string decodeQuals(const bam1_t* htsAlignmentPtr)
+{
+    string quals;
+    const uint8_t* htsQualsPtr = bam_get_qual(htsAlignmentPtr);
+    const int readLength = htsAlignmentPtr->core.l_qseq;
+    quals.resize(readLength);
+    for (int index = 0; index != readLength; ++index)
+    {
+        quals[index] = static_cast<char>(33 + htsQualsPtr[index]);
+    }
+    return quals;
+}
+
+// Graph alignment encoded in the XG tag as <locus id>,<position>,<graph cigar>
+struct GraphAlignTag
+{
+    string locusId;
+    int position;
+    string cigar;
+};
+
+static GraphAlignTag decodeGraphAlignTag(const bam1_t* htsAlignmentPtr)
+{
+    if (!bam_get_l_aux(htsAlignmentPtr))
+    {
+        throw std::runtime_error("All BAM alignments are required to have \"XG\" auxiliary tag");
+    }
+
+    uint8_t* aux = bam_aux_get(htsAlignmentPtr, "XG");
+    if (!aux)
+    {
+        throw std::runtime_error("All BAM alignments are required to have \"XG\" auxiliary tag");
+    }
+    if (*aux != 'Z')
+    {
+        throw std::runtime_error("Unexpected auxiliary tag XG:" + string(1, static_cast<char>(*aux)));
+    }
+    const char* cigarEncodingPtr = bam_aux2Z(aux);
+    if (!cigarEncodingPtr)
+    {
+        throw std::runtime_error("Failed to read XG auxiliary tag");
+    }
+
+    const string cigarEncoding(cigarEncodingPtr);
+    vector<string> pieces;
+    boost::split(pieces, cigarEncoding, boost::is_any_of(","));
+    assert(pieces.size() == 3);
+    return { pieces[0], std::stoi(pieces[1]), pieces[2] };
+}
 
-        // Decode base call quality sequence
-        string quals;
-        uint8_t* htsQualsPtr = bam_get_qual(htsAlignmentPtr);
-        quals.resize(readLength);
+static Read
+decodeRead(const LocusSpecification& locusSpec, string bases, string quals, int position, const string& cigar)
+{
+    GraphAlignment align = decodeGraphAlignment(position, cigar, &locusSpec.regionGraph());
+    if (!graphtools::checkConsistency(align, bases))
+    {
+        spdlog::warn("Encountered inconsistent alignment \n{}", prettyPrint(align, bases));
+    }
 
-        for (int index = 0; index != readLength; ++index)
+    return Read(std::move(bases), std::move(quals), align);
+}
+
+// Fragment id and read of a record or nothing if the record is not part of the locus
+using DecodedRecord = boost::optional<std::pair<string, Read>>;
+
+/// \param queryRegions: Regions that the record must overlap or nullptr if the record was selected by region
+static DecodedRecord decodeRecord(
+    const LocusSpecification& locusSpec, const vector<ResolvedQueryRegion>* queryRegions, const bam1_t* record)
+{
+    const auto& core = record->core;
+    if (queryRegions && !overlapsQueryRegions(*queryRegions, core.tid, core.pos, bam_endpos(record)))
+    {
+        return boost::none;
+    }
+
+    const auto tag = decodeGraphAlignTag(record);
+    if (tag.locusId != locusSpec.locusId())
+    {
+        return boost::none;
+    }
+
+    return std::make_pair(
+        string(bam_get_qname(record)),
+        decodeRead(locusSpec, decodeBases(record), decodeQuals(record), tag.position, tag.cigar));
+}
+
+namespace
+{
+using RecordPtr = std::unique_ptr<bam1_t, void (*)(bam1_t*)>;
+
+// Consecutive records of the reads file
+struct RecordBatch
+{
+    int index;
+    vector<RecordPtr> records;
+};
+}
+
+/// Decodes records on worker threads while adding the reads to the mate buffer in the order of the reads file
+///
+/// A reader thread collects the records into batches. Workers decode the batches in any order, and the decoded
+/// batches are passed to the mate buffer in the order they were read, so the fragments are the same as when the
+/// records are decoded one by one.
+template <typename RecordReader>
+static void decodeRecordsInParallel(
+    int numThreads, RecordReader readRecord, const LocusSpecification& locusSpec,
+    const vector<ResolvedQueryRegion>* queryRegions, MateBuffer& mateBuffer, FragById& fragById)
+{
+    const size_t batchSize = 512;
+    // Limits the memory taken by batches that are read but not yet passed to the mate buffer
+    const int maxBatchesInFlight = 4 * numThreads;
+
+    std::mutex mutex;
+    std::condition_variable stateChange;
+    std::deque<RecordBatch> undecodedBatches;
+    map<int, vector<DecodedRecord>> decodedBatches;
+    int numBatchesInFlight = 0;
+    int numBatches = -1; // Set once all records are read
+    std::exception_ptr error;
+
+    auto recordError = [&]()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
         {
-            quals[index] = static_cast<char>(33 + htsQualsPtr[index]);
+            error = std::current_exception();
         }
+        stateChange.notify_all();
+    };
 
-        // Decode graph alignment
-        if (!bam_get_l_aux(htsAlignmentPtr))
+    auto readBatches = [&]()
+    {
+        try
         {
-            throw std::runtime_error("All BAM alignments are required to have \"XG\" auxiliary tag");
+            for (int batchIndex = 0;; ++batchIndex)
+            {
+                RecordBatch batch{ batchIndex, {} };
+                while (batch.records.size() != batchSize)
+                {
+                    RecordPtr record(bam_init1(), bam_destroy1);
+                    if (!readRecord(record.get()))
+                    {
+                        break;
+                    }
+                    batch.records.push_back(std::move(record));
+                }
+                const bool isLastBatch = batch.records.size() != batchSize;
+                const bool isEmptyBatch = batch.records.empty();
+
+                std::unique_lock<std::mutex> lock(mutex);
+                stateChange.wait(lock, [&]() { return numBatchesInFlight < maxBatchesInFlight || error; });
+                if (error)
+                {
+                    return;
+                }
+                if (!isEmptyBatch)
+                {
+                    undecodedBatches.push_back(std::move(batch));
+                    ++numBatchesInFlight;
+                }
+                if (isLastBatch)
+                {
+                    numBatches = isEmptyBatch ? batchIndex : batchIndex + 1;
+                }
+                stateChange.notify_all();
+                if (isLastBatch)
+                {
+                    return;
+                }
+            }
         }
-
-        uint8_t* aux = bam_aux_get(htsAlignmentPtr, "XG");
-        if (!aux)
+        catch (...)
         {
-            throw std::runtime_error("All BAM alignments are required to have \"XG\" auxiliary tag");
+            recordError();
         }
-        if (*aux != 'Z')
+    };
+
+    auto decodeBatches = [&]()
+    {
+        try
         {
-            throw std::runtime_error("Unexpected auxiliary tag XG:" + string(1, static_cast<char>(*aux)));
+            while (true)
+            {
+                RecordBatch batch;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    stateChange.wait(
+                        lock, [&]() { return !undecodedBatches.empty() || numBatches != -1 || error; });
+                    if (error || undecodedBatches.empty())
+                    {
+                        return;
+                    }
+                    batch = std::move(undecodedBatches.front());
+                    undecodedBatches.pop_front();
+                }
+
+                vector<DecodedRecord> decodedRecords;
+                decodedRecords.reserve(batch.records.size());
+                for (const auto& record : batch.records)
+                {
+                    decodedRecords.push_back(decodeRecord(locusSpec, queryRegions, record.get()));
+                }
+                batch.records.clear();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                decodedBatches.emplace(batch.index, std::move(decodedRecords));
+                stateChange.notify_all();
+            }
         }
-        const char* cigarEncodingPtr = bam_aux2Z(aux);
-        if (!cigarEncodingPtr)
+        catch (...)
         {
-            throw std::runtime_error("Failed to read XG auxiliary tag");
+            recordError();
         }
+    };
 
-        string fragmentId = bam_get_qname(htsAlignmentPtr);
-        const string cigarEncoding(cigarEncodingPtr);
-        vector<string> pieces;
-        boost::split(pieces, cigarEncoding, boost::is_any_of(","));
-        assert(pieces.size() == 3);
-        const string& locusId = pieces[0];
-        int pos = std::stoi(pieces[1]);
-        const string& cigar = pieces[2];
+    vector<std::thread> threads;
+    threads.emplace_back(readBatches);
+    for (int threadIndex = 0; threadIndex != numThreads; ++threadIndex)
+    {
+        threads.emplace_back(decodeBatches);
+    }
 
-        if (locusId != locusSpec.locusId())
+    try
+    {
+        for (int batchIndex = 0;; ++batchIndex)
         {
-            continue;
+            vector<DecodedRecord> decodedRecords;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                stateChange.wait(
+                    lock, [&]() { return decodedBatches.count(batchIndex) || numBatches == batchIndex || error; });
+                if (error || numBatches == batchIndex)
+                {
+                    break;
+                }
+                decodedRecords = std::move(decodedBatches[batchIndex]);
+                decodedBatches.erase(batchIndex);
+                --numBatchesInFlight;
+                stateChange.notify_all();
+            }
+
+            for (auto& decodedRecord : decodedRecords)
+            {
+                if (decodedRecord)
+                {
+                    mateBuffer.add(decodedRecord->first, std::move(decodedRecord->second), fragById);
+                }
+            }
         }
+    }
+    catch (...)
+    {
+        recordError();
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+static void finishPairing(MateBuffer& mateBuffer, FragById& fragById)
+{
+    const int numUnpaired = mateBuffer.finish(fragById);
+    if (mateBuffer.numSpilledReads())
+    {
+        spdlog::info("Spilled {} unpaired reads to disk while pairing mates", mateBuffer.numSpilledReads());
+    }
+    if (numUnpaired)
+    {
+        spdlog::warn("Found {} unpaired reads", numUnpaired);
+    }
+}
+
+struct ReadChunkIndex::HtsHandles
+{
+    HtsFilePtr htsFilePtr{ nullptr, hts_close };
+    HtsHeaderPtr htsHeaderPtr{ nullptr, sam_hdr_destroy };
+    HtsIndexPtr htsIndexPtr{ nullptr, hts_idx_destroy };
+};
+
+ReadChunkIndex::ReadChunkIndex(const string& readsPath)
+    : handles_(new HtsHandles())
+{
+    handles_->htsFilePtr.reset(sam_open(readsPath.c_str(), "r"));
+    if (!handles_->htsFilePtr)
+    {
+        throw std::runtime_error("Failed to read BAM file " + readsPath);
+    }
 
-        GraphAlignment align = decodeGraphAlignment(pos, cigar, &locusSpec.regionGraph());
-        if (!graphtools::checkConsistency(align, bases))
+    handles_->htsHeaderPtr.reset(sam_hdr_read(handles_->htsFilePtr.get()));
+    if (!handles_->htsHeaderPtr)
+    {
+        throw std::runtime_error("Failed to read header of " + readsPath);
+    }
+
+    handles_->htsIndexPtr.reset(sam_index_load(handles_->htsFilePtr.get(), readsPath.c_str()));
+    if (!handles_->htsIndexPtr)
+    {
+        throw std::runtime_error("Failed to read index of " + readsPath);
+    }
+}
+
+ReadChunkIndex::~ReadChunkIndex() = default;
+
+vector<ReadChunk> ReadChunkIndex::getChunks(const string& referencePath, const LocusSpecification& locusSpec) const
+{
+    HtsIteratorPtr htsRegionPtr(
+        createRegionIterator(handles_->htsIndexPtr.get(), handles_->htsHeaderPtr.get(), referencePath, locusSpec),
+        hts_itr_destroy);
+    vector<ReadChunk> chunks;
+    for (int chunkIndex = 0; chunkIndex != htsRegionPtr->n_off; ++chunkIndex)
+    {
+        chunks.emplace_back(htsRegionPtr->off[chunkIndex].u, htsRegionPtr->off[chunkIndex].v);
+    }
+
+    return chunks;
+}
+
+FragById getAligns(
+    const string& readsPath, const string& referencePath, const LocusSpecification& locusSpec, size_t mateBufferSize,
+    const XgLocusIndex* xgLocusIndex, int numThreads)
+{
+    HtsFilePtr htsFileOwner(sam_open(readsPath.c_str(), "r"), hts_close);
+    if (!htsFileOwner)
+    {
+        throw std::runtime_error("Failed to read BAM file " + readsPath);
+    }
+    htsFile* htsFilePtr = htsFileOwner.get();
+
+    // Required step for parsing of some CRAMs
+    if (hts_set_fai_filename(htsFilePtr, referencePath.c_str()) != 0)
+    {
+        throw std::runtime_error("Failed to set index of: " + referencePath);
+    }
+
+    HtsHeaderPtr htsHeaderOwner(sam_hdr_read(htsFilePtr), sam_hdr_destroy);
+    if (!htsHeaderOwner)
+    {
+        throw std::runtime_error("Failed to read header of " + readsPath);
+    }
+    bam_hdr_t* htsHeaderPtr = htsHeaderOwner.get();
+
+    // Records are either read from the ranges of the locus in the locus index or selected by region
+    HtsIndexPtr htsIndexOwner(nullptr, hts_idx_destroy);
+    HtsIteratorPtr htsRegionOwner(nullptr, hts_itr_destroy);
+    vector<ResolvedQueryRegion> queryRegions;
+    std::function<bool(bam1_t*)> readRecord;
+    if (xgLocusIndex)
+    {
+        queryRegions = resolveQueryRegions(
+            referencePath, locusSpec,
+            [htsHeaderPtr](const string& contigName) { return sam_hdr_name2tid(htsHeaderPtr, contigName.c_str()); });
+
+        const auto& ranges = xgLocusIndex->getRanges(locusSpec.locusId());
+        auto rangeIt = ranges.begin();
+        bool isAtRangeStart = false;
+        readRecord
+            = [&ranges, rangeIt, isAtRangeStart, htsFilePtr, htsHeaderPtr, &readsPath](bam1_t* record) mutable
+        {
+            for (; rangeIt != ranges.end(); ++rangeIt, isAtRangeStart = false)
+            {
+                if (!isAtRangeStart)
+                {
+                    if (bgzf_seek(htsFilePtr->fp.bgzf, rangeIt->begin, SEEK_SET) < 0)
+                    {
+                        throw std::runtime_error("Failed to seek in " + readsPath);
+                    }
+                    isAtRangeStart = true;
+                }
+
+                if (bgzf_tell(htsFilePtr->fp.bgzf) < static_cast<int64_t>(rangeIt->end)
+                    && sam_read1(htsFilePtr, htsHeaderPtr, record) >= 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+    }
+    else
+    {
+        htsIndexOwner.reset(sam_index_load(htsFilePtr, readsPath.c_str()));
+        if (!htsIndexOwner)
         {
-            spdlog::warn("Encountered inconsistent alignment \n{}", prettyPrint(align, bases));
+            throw std::runtime_error("Failed to read index of " + readsPath);
         }
 
-        // Store read and alignment
-        if (unpairedCache.find(fragmentId) == unpairedCache.end())
+        htsRegionOwner.reset(createRegionIterator(htsIndexOwner.get(), htsHeaderPtr, referencePath, locusSpec));
+        hts_itr_t* htsRegionPtr = htsRegionOwner.get();
+        readRecord = [htsFilePtr, htsRegionPtr](bam1_t* record)
+        { return sam_itr_next(htsFilePtr, htsRegionPtr, record) >= 0; };
+    }
+
+    FragById fragById;
+    MateBuffer mateBuffer(&locusSpec.regionGraph(), mateBufferSize);
+    const auto* regionFilter = xgLocusIndex ? &queryRegions : nullptr;
+    if (numThreads > 1)
+    {
+        decodeRecordsInParallel(numThreads, readRecord, locusSpec, regionFilter, mateBuffer, fragById);
+    }
+    else
+    {
+        RecordPtr htsAlignmentPtr(bam_init1(), bam_destroy1);
+        while (readRecord(htsAlignmentPtr.get()))
         {
-            Read read(std::move(bases), std::move(quals), align);
-            unpairedCache.emplace(fragmentId, read);
+            auto decodedRecord = decodeRecord(locusSpec, regionFilter, htsAlignmentPtr.get());
+            if (decodedRecord)
+            {
+                mateBuffer.add(decodedRecord->first, std::move(decodedRecord->second), fragById);
+            }
         }
-        else
-        {
-            auto mate = std::move(unpairedCache.at(fragmentId));
-            unpairedCache.erase(fragmentId);
+    }
 
-            Read read(bases, quals, align);
-            fragById.emplace(fragmentId, Frag(read, mate));
-        }
+    finishPairing(mateBuffer, fragById);
+
+    return fragById;
+}
+
+BamletStore::BamletStore(const string& readsPath, const string& referencePath)
+{
+    htsFile* htsFilePtr = sam_open(readsPath.c_str(), "r");
+    if (!htsFilePtr)
+    {
+        throw std::runtime_error("Failed to read BAM file " + readsPath);
     }
 
-    if (!unpairedCache.empty())
+    // Required step for parsing of some CRAMs
+    if (hts_set_fai_filename(htsFilePtr, referencePath.c_str()) != 0)
     {
-        spdlog::warn("Found {} unpaired reads", unpairedCache.size());
+        sam_close(htsFilePtr);
+        throw std::runtime_error("Failed to set index of: " + referencePath);
     }
 
-    bam_destroy1(htsAlignmentPtr);
-    htsAlignmentPtr = nullptr;
+    bam_hdr_t* htsHeaderPtr = sam_hdr_read(htsFilePtr);
+    if (!htsHeaderPtr)
+    {
+        sam_close(htsFilePtr);
+        throw std::runtime_error("Failed to read header of " + readsPath);
+    }
 
-    hts_itr_destroy(htsRegionPtr);
-    htsRegionPtr = nullptr;
+    for (int contigIndex = 0; contigIndex != htsHeaderPtr->n_targets; ++contigIndex)
+    {
+        contigIndexByName_[htsHeaderPtr->target_name[contigIndex]] = contigIndex;
+    }
 
-    hts_idx_destroy(htsIndexPtr);
-    htsIndexPtr = nullptr;
+    bam1_t* htsAlignmentPtr = bam_init1();
+    int status;
+    try
+    {
+        while ((status = sam_read1(htsFilePtr, htsHeaderPtr, htsAlignmentPtr)) >= 0)
+        {
+            auto tag = decodeGraphAlignTag(htsAlignmentPtr);
+            const auto& core = htsAlignmentPtr->core;
+            recordsByLocus_[tag.locusId].push_back(
+                { bam_get_qname(htsAlignmentPtr), core.tid, core.pos, bam_endpos(htsAlignmentPtr), tag.position,
+                  std::move(tag.cigar), decodeBases(htsAlignmentPtr), decodeQuals(htsAlignmentPtr) });
+            ++numRecords_;
+        }
+    }
+    catch (const std::exception&)
+    {
+        bam_destroy1(htsAlignmentPtr);
+        bam_hdr_destroy(htsHeaderPtr);
+        sam_close(htsFilePtr);
+        throw;
+    }
 
+    bam_destroy1(htsAlignmentPtr);
     bam_hdr_destroy(htsHeaderPtr);
-    htsHeaderPtr = nullptr;
-
     sam_close(htsFilePtr);
-    htsFilePtr = nullptr;
 
+    if (status < -1)
+    {
+        throw std::runtime_error("Failed to read " + readsPath);
+    }
+}
+
+const vector<BamletStore::Record>& BamletStore::getRecords(const string& locusId) const
+{
+    static const vector<Record> kNoRecords;
+    const auto recordsIt = recordsByLocus_.find(locusId);
+    return recordsIt != recordsByLocus_.end() ? recordsIt->second : kNoRecords;
+}
+
+int BamletStore::getContigIndex(const string& contigName) const
+{
+    const auto contigIt = contigIndexByName_.find(contigName);
+    return contigIt != contigIndexByName_.end() ? contigIt->second : -1;
+}
+
+FragById getAligns(
+    const BamletStore& bamletStore, const string& referencePath, const LocusSpecification& locusSpec,
+    size_t mateBufferSize)
+{
+    const auto queryRegions = resolveQueryRegions(
+        referencePath, locusSpec,
+        [&bamletStore](const string& contigName) { return bamletStore.getContigIndex(contigName); });
+
+    FragById fragById;
+    MateBuffer mateBuffer(&locusSpec.regionGraph(), mateBufferSize);
+    for (const auto& record : bamletStore.getRecords(locusSpec.locusId()))
+    {
+        if (overlapsQueryRegions(queryRegions, record.contigIndex, record.start, record.end))
+        {
+            mateBuffer.add(
+                record.fragmentId,
+                decodeRead(locusSpec, record.bases, record.quals, record.graphPosition, record.graphCigar), fragById);
+        }
+    }
+
+    finishPairing(mateBuffer, fragById);
     return fragById;
 }
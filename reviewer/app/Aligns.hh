@@ -23,9 +23,81 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "core/Aligns.hh"
 
+#include "app/XgLocusIndex.hh"
 #include "core/LocusSpecification.hh"
 
-FragById getAligns(const std::string& readsPath, const std::string& referencePath, const LocusSpecification& locusSpec);
+// Pair of BGZF virtual offsets delimiting a chunk of the reads file
+using ReadChunk = std::pair<uint64_t, uint64_t>;
+
+/// Index of the reads file opened once and queried for the chunks holding the reads of each locus
+class ReadChunkIndex
+{
+public:
+    explicit ReadChunkIndex(const std::string& readsPath);
+    ~ReadChunkIndex();
+
+    ReadChunkIndex(const ReadChunkIndex&) = delete;
+    ReadChunkIndex& operator=(const ReadChunkIndex&) = delete;
+
+    /// Looks up the chunks of the reads file that the index assigns to the query region of the given locus
+    std::vector<ReadChunk> getChunks(const std::string& referencePath, const LocusSpecification& locusSpec) const;
+
+private:
+    struct HtsHandles;
+    std::unique_ptr<HtsHandles> handles_;
+};
+
+/// Extracts read pairs aligned to the given locus
+///
+/// \param mateBufferSize: Memory in bytes for reads waiting for their mates; reads beyond it are spilled to disk
+/// \param xgLocusIndex: Index of the reads file by locus; without it the reads file is queried by region
+/// \param numThreads: Number of threads decoding the records; the reads file is read on a separate thread if above 1
+FragById getAligns(
+    const std::string& readsPath, const std::string& referencePath, const LocusSpecification& locusSpec,
+    size_t mateBufferSize, const XgLocusIndex* xgLocusIndex = nullptr, int numThreads = 1);
+
+/// Reads of a small reads file held in memory
+///
+/// The file is read and decompressed once. Its records are decoded into compact records grouped by the locus of their
+/// graph alignment, so extracting the reads of a locus requires no further I/O.
+class BamletStore
+{
+public:
+    struct Record
+    {
+        std::string fragmentId;
+        int contigIndex;
+        int64_t start;
+        int64_t end;
+        int graphPosition;
+        std::string graphCigar;
+        std::string bases;
+        std::string quals;
+    };
+
+    BamletStore(const std::string& readsPath, const std::string& referencePath);
+
+    /// \return Records whose graph alignments belong to the locus in the order of the reads file
+    const std::vector<Record>& getRecords(const std::string& locusId) const;
+
+    /// \return Index of the contig in the header of the reads file or -1 if the contig is absent
+    int getContigIndex(const std::string& contigName) const;
+
+    int numRecords() const { return numRecords_; }
+
+private:
+    std::unordered_map<std::string, std::vector<Record>> recordsByLocus_;
+    std::unordered_map<std::string, int> contigIndexByName_;
+    int numRecords_ = 0;
+};
+
+/// Extracts read pairs aligned to the given locus from the reads held in memory
+FragById getAligns(
+    const BamletStore& bamletStore, const std::string& referencePath, const LocusSpecification& locusSpec,
+    size_t mateBufferSize);
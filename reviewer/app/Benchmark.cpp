@@ -0,0 +1,571 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/Benchmark.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/optional.hpp>
+#include <boost/program_options.hpp>
+
+#include "spdlog/spdlog.h"
+
+#include "graphalign/GraphAlignmentOperations.hh"
+
+#include "app/CatalogLoading.hh"
+#include "app/GenerateSvg.hh"
+#include "app/GenotypePaths.hh"
+#include "app/LanePlot.hh"
+#include "app/LocusSpecDecoding.hh"
+#include "app/VcfGenotypeIndex.hh"
+#include "app/Workflow.hh"
+
+using boost::optional;
+using graphtools::decodeGraphAlignment;
+using graphtools::Path;
+using std::string;
+using std::to_string;
+using std::vector;
+
+namespace po = boost::program_options;
+
+static const int kReadLength = 150;
+static const int kFragLength = 400;
+// Longer allele of each simulated repeat exceeds the shorter allele by this many motifs
+static const int kAlleleLengthDifference = 2;
+// Settings of the axes that are not being scanned
+static const int kDefaultDepth = 30;
+static const int kDefaultAlleleLength = 20;
+
+// Stages of the workflow keep their numbers, followed by rendering of the plot
+enum Stage
+{
+    kCandidates = static_cast<int>(AnalysisStage::kCandidates),
+    kPhasing = static_cast<int>(AnalysisStage::kPhasing),
+    kProjection = static_cast<int>(AnalysisStage::kProjection),
+    kFragLenFilter = static_cast<int>(AnalysisStage::kFragLenFilter),
+    kAssignment = static_cast<int>(AnalysisStage::kAssignment),
+    kMetrics = static_cast<int>(AnalysisStage::kMetrics),
+    kBlueprint = static_cast<int>(AnalysisStage::kBlueprint),
+    kRendering,
+    kNumStages
+};
+
+static const char* const kStageNames[kNumStages] = { "Candidates", "Phasing",  "Projection", "FragLenFilter",
+                                                     "Assignment", "Metrics", "Blueprint",  "Rendering" };
+
+namespace
+{
+
+struct BenchmarkSettings
+{
+    string catalogPath;
+    string referencePath;
+    string outputPrefix;
+    string anchorLocusId;
+    int flankLength;
+    string depths;
+    string alleleLengths;
+    string hetRepeatCounts;
+    string locusCounts;
+    int numRepeats;
+    unsigned seed;
+};
+
+struct BenchmarkCase
+{
+    BenchmarkCase(string axis, int size)
+        : axis(std::move(axis))
+        , size(size)
+        , stageSeconds(kNumStages, 0.0)
+    {
+    }
+
+    double totalSeconds() const { return std::accumulate(stageSeconds.begin(), stageSeconds.end(), 0.0); }
+
+    string axis;
+    int size;
+    int numFrags = 0;
+    int numCandidates = 0;
+    vector<double> stageSeconds;
+    int64_t peakRssKb = 0;
+};
+
+// Attributes the time elapsed since the previous stage finished to the given stage
+class StageTimer
+{
+public:
+    explicit StageTimer(vector<double>& stageSeconds)
+        : stageSeconds_(stageSeconds)
+        , start_(std::chrono::steady_clock::now())
+    {
+    }
+
+    void finish(Stage stage)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        stageSeconds_[stage] += std::chrono::duration<double>(now - start_).count();
+        start_ = now;
+    }
+
+private:
+    vector<double>& stageSeconds_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}
+
+static vector<int> decodeSizes(const string& encoding)
+{
+    vector<string> pieces;
+    boost::split(pieces, encoding, boost::is_any_of(","));
+    vector<int> sizes;
+    for (const auto& piece : pieces)
+    {
+        if (piece.empty())
+        {
+            continue;
+        }
+
+        const int size = std::stoi(piece);
+        if (size < 1)
+        {
+            throw std::runtime_error("Sizes to scan must be positive, got " + piece);
+        }
+        sizes.push_back(size);
+    }
+    return sizes;
+}
+
+// Restarts tracking of the peak resident set size where the kernel supports it
+static void resetPeakRss()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    if (clearRefs.is_open())
+    {
+        clearRefs << "5";
+    }
+}
+
+static int64_t getPeakRssKb()
+{
+    std::ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+    {
+        if (boost::starts_with(line, "VmHWM:"))
+        {
+            return std::stoll(line.substr(6));
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static LocusSpecification makeSyntheticLocus(
+    const LocusSpecification& anchorLocus, int numRepeats, const Reference& reference, int flankLength)
+{
+    const vector<string> kMotifs = { "CAG", "CCG", "AAT", "TCTA" };
+    const int kReferenceRepeatLength = 12;
+    const auto& anchorRegion = anchorLocus.variantSpecs().front().referenceLocus();
+
+    LocusDescriptionFromUser description;
+    description.locusId = "Synthetic" + to_string(numRepeats);
+    for (int index = 0; index != numRepeats; ++index)
+    {
+        const int64_t start = anchorRegion.start() + index * kReferenceRepeatLength;
+        description.locusStructure += "(" + kMotifs[index % kMotifs.size()] + ")*";
+        description.referenceRegions.emplace_back(anchorRegion.contigIndex(), start, start + kReferenceRepeatLength);
+        description.variantIds.push_back(description.locusId + "_" + to_string(index + 1));
+        description.variantTypesFromUser.push_back(VariantTypeFromUser::kRareRepeat);
+    }
+
+    assertValidity(description);
+    return decodeLocusSpecification(description, reference, flankLength);
+}
+
+// Every repeat of every locus is heterozygous, so a locus with n repeats has 2^(n-1) candidate diplotypes
+static VcfGenotypeIndex makeGenotypes(const vector<const LocusSpecification*>& loci, int alleleLength)
+{
+    std::stringstream vcf;
+    vcf << "##fileformat=VCFv4.1\n";
+    vcf << "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tSYNTHETIC\n";
+    const int longAlleleLength = alleleLength + kAlleleLengthDifference;
+    for (const auto locusSpecPtr : loci)
+    {
+        for (const auto& variantSpec : locusSpecPtr->variantSpecs())
+        {
+            vcf << "chrN\t1\t.\tN\t<STR>\t.\tPASS\tVARID=" << variantSpec.id() << "\tGT:REPCN:REPCI\t1/2:"
+                << alleleLength << "/" << longAlleleLength << ":" << alleleLength << "-" << alleleLength << "/"
+                << longAlleleLength << "-" << longAlleleLength << "\n";
+        }
+    }
+
+    return VcfGenotypeIndex(vcf);
+}
+
+static Read simulateRead(
+    const Path& hapPath, const string& hapSeq, const vector<int>& nodeIndexByBase, const vector<int>& offsetByBase,
+    int start)
+{
+    string cigar;
+    int pieceStart = start;
+    for (int position = start + 1; position <= start + kReadLength; ++position)
+    {
+        if (position == start + kReadLength || nodeIndexByBase[position] != nodeIndexByBase[pieceStart])
+        {
+            const auto node = hapPath.getNodeIdByIndex(nodeIndexByBase[pieceStart]);
+            cigar += to_string(node) + "[" + to_string(position - pieceStart) + "M]";
+            pieceStart = position;
+        }
+    }
+
+    auto align = decodeGraphAlignment(offsetByBase[start], cigar, hapPath.graphRawPtr());
+    return Read(hapSeq.substr(start, kReadLength), string(kReadLength, 'I'), std::move(align));
+}
+
+// Simulates error-free read pairs that cover each haplotype at the given depth
+static FragById simulateFrags(const Diplotype& diplotype, int depth, std::mt19937& generator)
+{
+    FragById fragById;
+    for (const auto& hapPath : diplotype)
+    {
+        string hapSeq;
+        vector<int> nodeIndexByBase;
+        vector<int> offsetByBase;
+        for (int nodeIndex = 0; nodeIndex != static_cast<int>(hapPath.numNodes()); ++nodeIndex)
+        {
+            const string nodeSeq = hapPath.getNodeSeq(nodeIndex);
+            const int startOnNode = hapPath.getStartPositionOnNodeByIndex(nodeIndex);
+            for (int offset = 0; offset != static_cast<int>(nodeSeq.length()); ++offset)
+            {
+                nodeIndexByBase.push_back(nodeIndex);
+                offsetByBase.push_back(startOnNode + offset);
+            }
+            hapSeq += nodeSeq;
+        }
+
+        const int hapLength = hapSeq.length();
+        if (hapLength < kFragLength)
+        {
+            throw std::runtime_error("Haplotypes must be at least " + to_string(kFragLength) + " bp long");
+        }
+
+        std::uniform_int_distribution<int> fragStarts(0, hapLength - kFragLength);
+        const int numFrags = depth * hapLength / (2 * kReadLength);
+        for (int fragIndex = 0; fragIndex != numFrags; ++fragIndex)
+        {
+            const int fragStart = fragStarts(generator);
+            const int mateStart = fragStart + kFragLength - kReadLength;
+            Read read = simulateRead(hapPath, hapSeq, nodeIndexByBase, offsetByBase, fragStart);
+            Read mate = simulateRead(hapPath, hapSeq, nodeIndexByBase, offsetByBase, mateStart);
+            fragById.emplace("frag" + to_string(fragById.size()), Frag(std::move(read), std::move(mate)));
+        }
+    }
+
+    return fragById;
+}
+
+// Arguments of a default workflow run that analyzes reads on a single thread and draws a plot of every locus
+static WorkflowArguments makeWorkflowArguments()
+{
+    WorkflowArguments args = WorkflowArguments();
+    args.numThreads = 1;
+    return args;
+}
+
+static void analyzeLocus(
+    const LocusSpecification& locusSpec, const SampleGenotypes& genotypes, int depth, std::mt19937& generator,
+    BenchmarkCase& benchmarkCase)
+{
+    // Alleles of the first candidate are phased the way the genotypes are written
+    const auto trueDiplotype = getCandidateDiplotypes(kFragLength, genotypes, locusSpec).front();
+    const auto fragById = simulateFrags(trueDiplotype, depth, generator);
+    benchmarkCase.numFrags += fragById.size();
+
+    StageTimer timer(benchmarkCase.stageSeconds);
+    const auto locusAnalysis = analyzeLocusReads(
+        makeWorkflowArguments(), genotypes, locusSpec, fragById,
+        [&timer](AnalysisStage stage) { timer.finish(static_cast<Stage>(stage)); });
+    // All candidate diplotypes are scored and kept with the default arguments
+    benchmarkCase.numCandidates += locusAnalysis.numScoredDiplotypes;
+
+    std::ostringstream svg;
+    generateSvg(locusAnalysis.lanePlots, svg);
+    timer.finish(kRendering);
+}
+
+// Keeps the fastest of several repetitions to reduce the influence of other load on the machine
+static BenchmarkCase runCase(
+    const string& axis, int size, const vector<const LocusSpecification*>& loci, int depth, int alleleLength,
+    const BenchmarkSettings& settings)
+{
+    const VcfGenotypeIndex genotypeIndex = makeGenotypes(loci, alleleLength);
+    const SampleGenotypes genotypes(genotypeIndex, 0);
+
+    optional<BenchmarkCase> fastestCase;
+    for (int repeat = 0; repeat != settings.numRepeats; ++repeat)
+    {
+        std::mt19937 generator(settings.seed);
+        BenchmarkCase benchmarkCase(axis, size);
+        resetPeakRss();
+        for (const auto locusSpecPtr : loci)
+        {
+            analyzeLocus(*locusSpecPtr, genotypes, depth, generator, benchmarkCase);
+        }
+        benchmarkCase.peakRssKb = getPeakRssKb();
+
+        if (!fastestCase || benchmarkCase.totalSeconds() < fastestCase->totalSeconds())
+        {
+            fastestCase = benchmarkCase;
+        }
+    }
+
+    spdlog::info(
+        "{} {}: {} frags, {} candidate diplotypes, {:.3f}s", axis, size, fastestCase->numFrags,
+        fastestCase->numCandidates, fastestCase->totalSeconds());
+    return *fastestCase;
+}
+
+// Slope of the least-squares line through log-log points; NaN if sizes do not vary
+static double fitGrowthExponent(const vector<double>& sizes, const vector<double>& seconds)
+{
+    const double kMinSeconds = 1e-6;
+    const int numPoints = sizes.size();
+    double meanX = 0;
+    double meanY = 0;
+    for (int index = 0; index != numPoints; ++index)
+    {
+        meanX += std::log(sizes[index]) / numPoints;
+        meanY += std::log(std::max(seconds[index], kMinSeconds)) / numPoints;
+    }
+
+    double covariance = 0;
+    double variance = 0;
+    for (int index = 0; index != numPoints; ++index)
+    {
+        const double deltaX = std::log(sizes[index]) - meanX;
+        covariance += deltaX * (std::log(std::max(seconds[index], kMinSeconds)) - meanY);
+        variance += deltaX * deltaX;
+    }
+
+    return variance > 0 ? covariance / variance : std::nan("");
+}
+
+static void writeCases(const string& outputPath, const vector<BenchmarkCase>& cases)
+{
+    std::ofstream outputFile(outputPath);
+    if (!outputFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + outputPath);
+    }
+
+    outputFile << "Axis\tSize\tFrags\tCandidates\tWallSeconds\tPeakRssMb";
+    for (const char* stageName : kStageNames)
+    {
+        outputFile << "\t" << stageName << "Share";
+    }
+    outputFile << "\n";
+
+    outputFile.precision(4);
+    outputFile << std::fixed;
+    for (const auto& benchmarkCase : cases)
+    {
+        const double totalSeconds = benchmarkCase.totalSeconds();
+        outputFile << benchmarkCase.axis << "\t" << benchmarkCase.size << "\t" << benchmarkCase.numFrags << "\t"
+                   << benchmarkCase.numCandidates << "\t" << totalSeconds << "\t"
+                   << benchmarkCase.peakRssKb / 1024.0;
+        for (double seconds : benchmarkCase.stageSeconds)
+        {
+            outputFile << "\t" << (totalSeconds > 0 ? seconds / totalSeconds : 0.0);
+        }
+        outputFile << "\n";
+    }
+}
+
+static void writeGrowthExponents(const string& outputPath, const vector<BenchmarkCase>& cases)
+{
+    std::ofstream outputFile(outputPath);
+    if (!outputFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + outputPath);
+    }
+
+    outputFile << "Axis\tStage\tExponent\n";
+    outputFile.precision(2);
+    outputFile << std::fixed;
+
+    vector<string> axes;
+    for (const auto& benchmarkCase : cases)
+    {
+        if (std::find(axes.begin(), axes.end(), benchmarkCase.axis) == axes.end())
+        {
+            axes.push_back(benchmarkCase.axis);
+        }
+    }
+
+    for (const auto& axis : axes)
+    {
+        vector<double> sizes;
+        vector<vector<double>> secondsByStage(kNumStages + 1);
+        for (const auto& benchmarkCase : cases)
+        {
+            if (benchmarkCase.axis != axis)
+            {
+                continue;
+            }
+            sizes.push_back(benchmarkCase.size);
+            for (int stage = 0; stage != kNumStages; ++stage)
+            {
+                secondsByStage[stage].push_back(benchmarkCase.stageSeconds[stage]);
+            }
+            secondsByStage[kNumStages].push_back(benchmarkCase.totalSeconds());
+        }
+
+        for (int stage = 0; stage <= kNumStages; ++stage)
+        {
+            const double exponent = fitGrowthExponent(sizes, secondsByStage[stage]);
+            outputFile << axis << "\t" << (stage == kNumStages ? "Total" : kStageNames[stage]) << "\t";
+            if (std::isnan(exponent))
+            {
+                outputFile << "NA\n";
+            }
+            else
+            {
+                outputFile << exponent << "\n";
+            }
+        }
+    }
+}
+
+static optional<BenchmarkSettings> getBenchmarkSettings(int argc, char** argv)
+{
+    BenchmarkSettings settings;
+
+    // clang-format off
+    po::options_description options("Benchmark options");
+    options.add_options()
+            ("help", "Print help message")
+            ("catalog", po::value<string>(&settings.catalogPath)->required(), "JSON file with variants to simulate")
+            ("reference", po::value<string>(&settings.referencePath)->required(), "FASTA file with reference genome")
+            ("output-prefix", po::value<string>(&settings.outputPrefix)->required(), "Prefix for the output tables (<prefix>.benchmark.tsv and <prefix>.growth.tsv)")
+            ("locus", po::value<string>(&settings.anchorLocusId), "Locus simulated when scanning depth and allele length; synthetic loci are placed at its repeat (defaults to the first locus in the catalog)")
+            ("region-extension-length", po::value<int>(&settings.flankLength)->default_value(1000), "Length of flanking region")
+            ("depths", po::value<string>(&settings.depths)->default_value("10,20,40,80"), "Comma-separated read depths to scan")
+            ("allele-lengths", po::value<string>(&settings.alleleLengths)->default_value("10,20,40,80"), "Comma-separated repeat lengths (in motifs) to scan")
+            ("het-repeats", po::value<string>(&settings.hetRepeatCounts)->default_value("1,2,3,4,5"), "Comma-separated numbers of heterozygous repeats of synthetic loci to scan")
+            ("locus-counts", po::value<string>(&settings.locusCounts)->default_value("1,2,4,8"), "Comma-separated numbers of loci to scan; catalog loci are reused as needed")
+            ("repeats", po::value<int>(&settings.numRepeats)->default_value(3), "Number of repetitions of each case")
+            ("seed", po::value<unsigned>(&settings.seed)->default_value(42), "Seed of the read simulation");
+    // clang-format on
+
+    po::variables_map argumentMap;
+    po::store(po::command_line_parser(argc, argv).options(options).run(), argumentMap);
+    if (argc == 1 || argumentMap.count("help"))
+    {
+        std::cerr << options << std::endl;
+        return boost::none;
+    }
+    po::notify(argumentMap);
+
+    if (settings.numRepeats < 1)
+    {
+        throw std::runtime_error("Number of repetitions must be positive");
+    }
+
+    return settings;
+}
+
+int runBenchmark(int argc, char** argv)
+{
+    const auto settings = getBenchmarkSettings(argc, argv);
+    if (!settings)
+    {
+        return 0;
+    }
+
+    Reference reference(settings->referencePath);
+    const auto catalog = loadLocusCatalogFromDisk(settings->catalogPath, reference, settings->flankLength);
+    if (catalog.empty())
+    {
+        throw std::runtime_error("Catalog " + settings->catalogPath + " contains no loci");
+    }
+
+    auto anchorLocusIt = settings->anchorLocusId.empty() ? catalog.begin() : catalog.find(settings->anchorLocusId);
+    if (anchorLocusIt == catalog.end())
+    {
+        throw std::runtime_error("Catalog does not contain locus " + settings->anchorLocusId);
+    }
+    const LocusSpecification& anchorLocus = anchorLocusIt->second;
+    spdlog::info("Simulating reads of locus {}", anchorLocus.locusId());
+
+    vector<BenchmarkCase> cases;
+    for (int depth : decodeSizes(settings->depths))
+    {
+        cases.push_back(runCase("Depth", depth, { &anchorLocus }, depth, kDefaultAlleleLength, *settings));
+    }
+
+    for (int alleleLength : decodeSizes(settings->alleleLengths))
+    {
+        cases.push_back(runCase("AlleleLength", alleleLength, { &anchorLocus }, kDefaultDepth, alleleLength, *settings));
+    }
+
+    for (int numRepeats : decodeSizes(settings->hetRepeatCounts))
+    {
+        const auto syntheticLocus = makeSyntheticLocus(anchorLocus, numRepeats, reference, settings->flankLength);
+        auto benchmarkCase
+            = runCase("Candidates", numRepeats, { &syntheticLocus }, kDefaultDepth, kDefaultAlleleLength, *settings);
+        benchmarkCase.size = benchmarkCase.numCandidates;
+        cases.push_back(benchmarkCase);
+    }
+
+    for (int numLoci : decodeSizes(settings->locusCounts))
+    {
+        vector<const LocusSpecification*> loci;
+        auto locusIt = catalog.begin();
+        while (static_cast<int>(loci.size()) != numLoci)
+        {
+            loci.push_back(&locusIt->second);
+            locusIt = std::next(locusIt) == catalog.end() ? catalog.begin() : std::next(locusIt);
+        }
+        cases.push_back(runCase("Loci", numLoci, loci, kDefaultDepth, kDefaultAlleleLength, *settings));
+    }
+
+    writeCases(settings->outputPrefix + ".benchmark.tsv", cases);
+    writeGrowthExponents(settings->outputPrefix + ".growth.tsv", cases);
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+/// Measures how the running time and memory of the analysis grow with the size of its input
+///
+/// Reads are simulated from the catalog loci, so no BAMlets are needed, and analyzed by the workflow code that follows
+/// read extraction. Four axes are scanned: read depth, repeat allele length, number of candidate diplotypes (through
+/// synthetic loci with several heterozygous repeats), and number of analyzed loci. Each case is reported with its wall
+/// time, share of each analysis stage, and peak RSS, and a growth exponent is fitted to every stage along every axis.
+///
+/// Usage: REViewer benchmark --catalog <json> --reference <fasta> --output-prefix <prefix> [options]
+int runBenchmark(int argc, char** argv);
@@ -0,0 +1,63 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/ContentHash.hh"
+
+#include <cstdio>
+
+using std::string;
+
+ContentHash& ContentHash::add(const string& value)
+{
+    // Length prefix keeps concatenations of different fields from colliding
+    add(static_cast<uint64_t>(value.size()));
+    addBytes(value.data(), value.size());
+    return *this;
+}
+
+ContentHash& ContentHash::add(int64_t value) { return add(static_cast<uint64_t>(value)); }
+
+ContentHash& ContentHash::add(uint64_t value)
+{
+    char bytes[sizeof(value)];
+    for (size_t index = 0; index != sizeof(value); ++index)
+    {
+        bytes[index] = static_cast<char>((value >> (8 * index)) & 0xFF);
+    }
+    addBytes(bytes, sizeof(value));
+    return *this;
+}
+
+void ContentHash::addBytes(const char* bytes, size_t numBytes)
+{
+    const uint64_t kPrime = 1099511628211ULL;
+    for (size_t index = 0; index != numBytes; ++index)
+    {
+        state_ ^= static_cast<unsigned char>(bytes[index]);
+        state_ *= kPrime;
+    }
+}
+
+string ContentHash::hex() const
+{
+    char encoding[17];
+    std::snprintf(encoding, sizeof(encoding), "%016llx", static_cast<unsigned long long>(state_));
+    return encoding;
+}
@@ -0,0 +1,42 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Incremental 64-bit FNV-1a hash of strings and integers, such as the inputs that determine the results of a locus
+class ContentHash
+{
+public:
+    ContentHash& add(const std::string& value);
+    ContentHash& add(int64_t value);
+    ContentHash& add(uint64_t value);
+
+    std::string hex() const;
+    uint64_t value() const { return state_; }
+
+private:
+    void addBytes(const char* bytes, size_t numBytes);
+
+    uint64_t state_ = 14695981039346656037ULL;
+};
@@ -0,0 +1,108 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fragments are processed in chunks of at least this many so that threads are not started for little work
+const size_t kMinFragChunkSize = 64;
+
+/// Processes consecutive chunks of items on up to numThreads threads
+///
+/// \param processChunk: Callable taking the range [begin, end) of item indexes and returning the output of the chunk
+/// \return Outputs of the chunks in the order of their items
+template <typename ChunkOutput, typename ChunkProcessor>
+std::vector<ChunkOutput> processFragChunks(size_t numItems, int numThreads, ChunkProcessor processChunk)
+{
+    const size_t maxNumChunks = (numItems + kMinFragChunkSize - 1) / kMinFragChunkSize;
+    const size_t numChunks = std::max<size_t>(1, std::min<size_t>(std::max(numThreads, 1), maxNumChunks));
+    std::vector<ChunkOutput> outputs(numChunks);
+    if (numChunks == 1)
+    {
+        outputs.front() = processChunk(0, numItems);
+        return outputs;
+    }
+
+    std::vector<std::exception_ptr> errors(numChunks);
+    std::vector<std::thread> threads;
+    for (size_t chunkIndex = 0; chunkIndex != numChunks; ++chunkIndex)
+    {
+        const size_t begin = numItems * chunkIndex / numChunks;
+        const size_t end = numItems * (chunkIndex + 1) / numChunks;
+        threads.emplace_back(
+            [&outputs, &errors, &processChunk, chunkIndex, begin, end]()
+            {
+                try
+                {
+                    outputs[chunkIndex] = processChunk(begin, end);
+                }
+                catch (...)
+                {
+                    errors[chunkIndex] = std::current_exception();
+                }
+            });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    for (const auto& error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    return outputs;
+}
+
+/// \return Pointers to the entries of the map in the order of their keys, so that the map can be split into chunks
+template <typename Map> std::vector<const typename Map::value_type*> getMapEntries(const Map& map)
+{
+    std::vector<const typename Map::value_type*> entries;
+    entries.reserve(map.size());
+    for (const auto& entry : map)
+    {
+        entries.push_back(&entry);
+    }
+    return entries;
+}
+
+/// Joins maps of consecutive chunks whose keys do not overlap and increase from chunk to chunk
+template <typename Map> Map concatenateMaps(std::vector<Map> maps)
+{
+    Map concatenatedMap;
+    for (auto& map : maps)
+    {
+        for (auto& entry : map)
+        {
+            concatenatedMap.emplace_hint(concatenatedMap.end(), entry.first, std::move(entry.second));
+        }
+    }
+    return concatenatedMap;
+}
@@ -20,6 +20,8 @@
 
 #include "app/FragLenFilter.hh"
 
+#include "app/FragChunks.hh"
+
 static int calcFragLen(const ReadPathAlign& readAlign, const ReadPathAlign& mateAlign)
 {
     if (readAlign.pathIndex != mateAlign.pathIndex)
@@ -30,43 +32,48 @@ static int calcFragLen(const ReadPathAlign& readAlign, const ReadPathAlign& mate
     return std::max(readAlign.end, mateAlign.end) - std::min(readAlign.begin, mateAlign.begin);
 }
 
-FragPathAlignsById resolveByFragLen(int meanFragLen, const Diplotype& paths, const PairPathAlignById& pairPathAlignById)
+FragPathAlignsById resolveByFragLen(
+    int meanFragLen, const Diplotype& paths, const PairPathAlignById& pairPathAlignById, int numThreads)
 {
-    FragPathAlignsById fragPathAlignsById;
-
-    for (const auto& idAndPairPathAlign : pairPathAlignById)
+    const auto pairEntries = getMapEntries(pairPathAlignById);
+    auto resolveChunk = [meanFragLen, &paths, &pairEntries](size_t begin, size_t end)
     {
-        const auto& fragId = idAndPairPathAlign.first;
-        const PairPathAlign& pairPathAlign = idAndPairPathAlign.second;
-
-        int bestFragLen = std::numeric_limits<int>::max();
-        for (const auto& readAlign : pairPathAlign.readAligns)
+        FragPathAlignsById fragPathAlignsById;
+        for (size_t fragIndex = begin; fragIndex != end; ++fragIndex)
         {
-            for (const auto& mateAlign : pairPathAlign.mateAligns)
-            {
-                if (readAlign.pathIndex != mateAlign.pathIndex)
-                {
-                    continue;
-                }
+            const auto& fragId = pairEntries[fragIndex]->first;
+            const PairPathAlign& pairPathAlign = pairEntries[fragIndex]->second;
 
-                const auto& path = paths[readAlign.pathIndex];
-                const int fragLen = calcFragLen(readAlign, mateAlign);
-
-                if (std::abs(fragLen - meanFragLen) < std::abs(bestFragLen - meanFragLen))
-                {
-                    bestFragLen = meanFragLen;
-                    fragPathAlignsById[fragId].clear();
-                }
-
-                if (meanFragLen == bestFragLen)
+            int bestFragLen = std::numeric_limits<int>::max();
+            for (const auto& readAlign : pairPathAlign.readAligns)
+            {
+                for (const auto& mateAlign : pairPathAlign.mateAligns)
                 {
-                    fragPathAlignsById[fragId].emplace_back(readAlign, mateAlign);
+                    if (readAlign.pathIndex != mateAlign.pathIndex)
+                    {
+                        continue;
+                    }
+
+                    const auto& path = paths[readAlign.pathIndex];
+                    const int fragLen = calcFragLen(readAlign, mateAlign);
+
+                    if (std::abs(fragLen - meanFragLen) < std::abs(bestFragLen - meanFragLen))
+                    {
+                        bestFragLen = meanFragLen;
+                        fragPathAlignsById[fragId].clear();
+                    }
+
+                    if (meanFragLen == bestFragLen)
+                    {
+                        fragPathAlignsById[fragId].emplace_back(readAlign, mateAlign);
+                    }
                 }
             }
         }
-    }
+        return fragPathAlignsById;
+    };
 
-    return fragPathAlignsById;
+    return concatenateMaps(processFragChunks<FragPathAlignsById>(pairEntries.size(), numThreads, resolveChunk));
 }
 
 int getMeanFragLen(const FragById& fragById)
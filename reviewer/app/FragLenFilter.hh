@@ -27,5 +27,6 @@
 
 int getMeanFragLen(const FragById& fragById);
 
-FragPathAlignsById
-resolveByFragLen(int meanFragLen, const Diplotype& paths, const PairPathAlignById& pairPathAlignById);
+/// \param numThreads: Number of threads resolving consecutive chunks of fragments
+FragPathAlignsById resolveByFragLen(
+    int meanFragLen, const Diplotype& paths, const PairPathAlignById& pairPathAlignById, int numThreads = 1);
@@ -24,20 +24,23 @@
 
 #include <fstream>
 #include <list>
+#include <sstream>
 #include <stdexcept>
 
+#include "app/ContentHash.hh"
 
 using boost::optional;
 using graphtools::NodeId;
 using graphtools::Path;
 using std::list;
 using std::ofstream;
+using std::ostream;
 using std::string;
 using std::to_string;
 using std::vector;
 
 static void
-drawRect(ofstream& out, int x, int y, int width, int height, const string& fill, const string& stroke, double opacity)
+drawRect(ostream& out, int x, int y, int width, int height, const string& fill, const string& stroke, double opacity)
 {
     out << "<rect x=\"" << x << "\" y=\"" << y << "\"";
     out << " width=\"" << width << "\" height=\"" << height << "\"";
@@ -48,7 +51,7 @@ drawRect(ofstream& out, int x, int y, int width, int height, const string& fill,
 }
 
 static void
-drawRectWithLeftBreak(ofstream& out, int x, int y, int width, int height, const string& fill, const string& stroke)
+drawRectWithLeftBreak(ostream& out, int x, int y, int width, int height, const string& fill, const string& stroke)
 {
     out << "<path d=\"";
     out << "M " << x << " " << y << " ";
@@ -67,7 +70,7 @@ drawRectWithLeftBreak(ofstream& out, int x, int y, int width, int height, const
 }
 
 static void
-drawRectWithRightBreak(ofstream& out, int x, int y, int width, int height, const string& fill, const string& stroke)
+drawRectWithRightBreak(ostream& out, int x, int y, int width, int height, const string& fill, const string& stroke)
 {
     out << "<path d=\"";
     out << "M " << x + width << " " << y << " ";
@@ -85,7 +88,7 @@ drawRectWithRightBreak(ofstream& out, int x, int y, int width, int height, const
     out << "/>\n";
 }
 
-static void drawLine(ofstream& out, int x, int y, int width, int height, const string& stroke)
+static void drawLine(ostream& out, int x, int y, int width, int height, const string& stroke)
 {
     out << "<line ";
     out << "x1=\"" << x << "\" y1=\"" << y + height / 2 << "\" ";
@@ -94,7 +97,7 @@ static void drawLine(ofstream& out, int x, int y, int width, int height, const s
     out << "/>\n";
 }
 
-static void drawLetter(ofstream& out, int x, int y, int width, int height, char letter)
+static void drawLetter(ostream& out, int x, int y, int width, int height, char letter)
 {
     string color = "black";
     if (letter == 'A')
@@ -123,17 +126,20 @@ static void drawLetter(ofstream& out, int x, int y, int width, int height, char
     out << letter << "</text>";
 }
 
-static void drawText(ofstream& out, int x, int y, int width, int height, const string& text)
+static void drawText(ostream& out, int x, int y, int width, int height, const string& text)
 {
     const int letterWidth = width / text.length();
     for (int letterIndex = 0; letterIndex != text.length(); ++letterIndex)
     {
-        drawLetter(out, x + letterWidth * letterIndex, y, letterWidth, height, text[letterIndex]);
+        if (text[letterIndex] != ' ')
+        {
+            drawLetter(out, x + letterWidth * letterIndex, y, letterWidth, height, text[letterIndex]);
+        }
     }
 }
 
 static void
-drawArrows(ofstream& out, int x, int y, int width, int height, const string& stroke, const optional<string>& text)
+drawArrows(ostream& out, int x, int y, int width, int height, const string& stroke, const optional<string>& text)
 {
     out << "<line x1=\"" << x << "\" y1=\"" << y + height / 2 << "\"";
     out << " x2=\"" << x + width << "\" y2=\"" << y + height / 2 << "\"";
@@ -156,7 +162,7 @@ drawArrows(ofstream& out, int x, int y, int width, int height, const string& str
     }
 }
 
-static void drawVerticalLine(ofstream& out, int x, int y, int width, int height, const string& stroke)
+static void drawVerticalLine(ostream& out, int x, int y, int width, int height, const string& stroke)
 {
     out << "<line ";
     out << "x1=\"" << x << "\" y1=\"" << y << "\" ";
@@ -165,14 +171,103 @@ static void drawVerticalLine(ofstream& out, int x, int y, int width, int height,
     out << "/>\n";
 }
 
-void drawLane(ofstream& out, int baseWidth, int xPosStart, int yPos, const Lane& lane)
+// Number of identical rects starting at the given feature, such as the units of a repeat or the matches of a read
+// to consecutive repeat units
+static int getRectRunLength(const vector<Feature>& features, int firstIndex)
+{
+    const Feature& first = features[firstIndex];
+    if (first.type != FeatureType::kRect || first.length == 0)
+    {
+        return 1;
+    }
+
+    int lastIndex = firstIndex + 1;
+    while (lastIndex != static_cast<int>(features.size()))
+    {
+        const Feature& feature = features[lastIndex];
+        if (feature.type != first.type || feature.length != first.length || feature.fill != first.fill
+            || feature.stroke != first.stroke || feature.label != first.label)
+        {
+            break;
+        }
+        ++lastIndex;
+    }
+
+    return lastIndex - firstIndex;
+}
+
+static bool isBlank(const optional<string>& label)
+{
+    return !label || label->find_first_not_of(' ') == string::npos;
+}
+
+// Draws a run of identical rects as a single rect; unless the rects are plain, their outline and letters are drawn
+// once into a pattern that tiles the run
+static void drawRectRun(
+    ostream& out, int x, int y, int unitWidth, int numUnits, int height, const Feature& unit, double opacity,
+    SvgPatternIds& patternIds)
+{
+    const int width = unitWidth * numUnits;
+    if (unit.stroke == "none" && isBlank(unit.label))
+    {
+        drawRect(out, x, y, width, height, unit.fill, unit.stroke, opacity);
+        return;
+    }
+
+    std::ostringstream encodedOpacity;
+    encodedOpacity << opacity;
+    const string patternId = "unit-"
+        + ContentHash()
+              .add(unit.fill)
+              .add(unit.stroke)
+              .add(unit.label ? *unit.label : string())
+              .add(static_cast<int64_t>(unitWidth))
+              .add(static_cast<int64_t>(height))
+              .add(encodedOpacity.str())
+              .hex();
+
+    if (patternIds.insert(patternId).second)
+    {
+        out << "<defs><pattern id=\"" << patternId << "\" patternUnits=\"userSpaceOnUse\"";
+        out << " width=\"" << unitWidth << "\" height=\"" << height << "\">\n";
+        drawRect(out, 0, 0, unitWidth, height, unit.fill, unit.stroke, opacity);
+        if (unit.label)
+        {
+            drawText(out, 0, 0, unitWidth, height, *unit.label);
+        }
+        out << "</pattern></defs>\n";
+    }
+
+    // Tiles of the pattern start at the origin of the group, i.e. at the start of the run
+    out << "<g transform=\"translate(" << x << "," << y << ")\">";
+    drawRect(out, 0, 0, width, height, "url(#" + patternId + ")", "none", 1.0);
+    if (unit.stroke != "none")
+    {
+        // Tiles clip the outer half of the outline of the run
+        drawRect(out, 0, 0, width, height, "none", unit.stroke, opacity);
+    }
+    out << "</g>\n";
+}
+
+void drawLane(ostream& out, int baseWidth, int xPosStart, int yPos, const Lane& lane, SvgPatternIds& patternIds)
 {
     for (const auto& segment : lane.segments)
     {
         int xPos = xPosStart + segment.start * baseWidth;
-        for (const auto& feature : segment.features)
+        for (int featureIndex = 0; featureIndex != static_cast<int>(segment.features.size()); ++featureIndex)
         {
+            const auto& feature = segment.features[featureIndex];
             const int featureWidth = feature.length * baseWidth;
+            const int runLength = getRectRunLength(segment.features, featureIndex);
+            if (runLength > 1)
+            {
+                drawRectRun(
+                    out, xPos, yPos, featureWidth, runLength, lane.height, feature, segment.opacity, patternIds);
+                featureIndex += runLength - 1;
+                xPos += featureWidth * runLength;
+                continue;
+            }
+
             if (feature.type == FeatureType::kRect)
             {
                 drawRect(out, xPos, yPos, featureWidth, lane.height, feature.fill, feature.stroke, segment.opacity);
@@ -219,98 +314,131 @@ void drawLane(ofstream& out, int baseWidth, int xPosStart, int yPos, const Lane&
     }
 }
 
-int getPlotWidth(int baseWidth, const vector<LanePlot>& lanePlots)
+SvgSize getSvgSize(const vector<LanePlotExtent>& extents)
 {
     int maxLaneWidth = 0;
-    for (const auto& lanePlot : lanePlots)
+    int plotHeight = 0;
+    for (const auto& extent : extents)
     {
-        for (const auto& lane : lanePlot)
+        maxLaneWidth = std::max(maxLaneWidth, extent.width);
+        if (plotHeight != 0)
         {
-            for (const auto& segment : lane.segments)
-            {
-                maxLaneWidth = std::max(maxLaneWidth, segment.end);
-            }
+            plotHeight += kSpacingBetweenLanePlots;
+        }
+        for (int laneHeight : extent.laneHeights)
+        {
+            plotHeight += laneHeight;
         }
+        plotHeight += static_cast<int>(extent.laneHeights.size()) * kSpacingBetweenLanes;
     }
 
-    return maxLaneWidth * baseWidth;
+    SvgSize size;
+    size.width = maxLaneWidth * kBaseWidth + 2 * kPlotPadX;
+    size.height = plotHeight + 2 * kPlotPadY;
+    return size;
 }
 
-int getPlotHeight(int spacingBetweenLanes, int spacingBetweenLanePlots, const vector<LanePlot>& lanePlots)
+SvgSize getSvgSize(const vector<LanePlot>& lanePlots)
 {
-    int plotHeight = 0;
+    vector<LanePlotExtent> extents;
+    for (const auto& lanePlot : lanePlots)
+    {
+        extents.push_back(getExtent(lanePlot));
+    }
+    return getSvgSize(extents);
+}
+
+vector<int> getLaneYPositions(const vector<LanePlot>& lanePlots)
+{
+    vector<int> positions;
+    int yPos = kPlotPadY;
     for (const auto& lanePlot : lanePlots)
     {
-        if (plotHeight != 0)
-        {
-            plotHeight += spacingBetweenLanePlots;
-        }
         for (const auto& lane : lanePlot)
         {
-            plotHeight += lane.height;
+            positions.push_back(yPos);
+            yPos += lane.height + kSpacingBetweenLanes;
         }
-        plotHeight += static_cast<int>(lanePlot.size()) * spacingBetweenLanes;
+
+        yPos += kSpacingBetweenLanePlots;
     }
 
-    return plotHeight;
+    return positions;
 }
 
-void generateSvg(const vector<LanePlot>& lanePlots, const string& outputPath)
+void generateSvgDefs(ostream& out)
 {
-    const int kSpacingBetweenLanes = 5;
-    const int kSpacingBetweenLanePlots = 50;
-    const int kBaseWidth = 10;
-    const int kPlotPadX = 10;
-    const int kPlotPadY = 5;
-
-    const int plotWidth = getPlotWidth(kBaseWidth, lanePlots) + 2 * kPlotPadX;
-    const int plotHeight = getPlotHeight(kSpacingBetweenLanes, kSpacingBetweenLanePlots, lanePlots) + 2 * kPlotPadY;
+    out << "<defs>\n"
+           "    <linearGradient id=\"BlueWhiteBlue\" x1=\"0%\" y1=\"0%\" x2=\"0%\" y2=\"100%\">\n"
+           "      <stop offset=\"0%\" style=\"stop-color:#8da0cb;stop-opacity:0.8\" />\n"
+           "      <stop offset=\"50%\" style=\"stop-color:#8da0cb;stop-opacity:0.1\" />\n"
+           "      <stop offset=\"100%\" style=\"stop-color:#8da0cb;stop-opacity:0.8\" />\n"
+           "    </linearGradient>\n"
+           "    <linearGradient id=\"OrangeWhiteOrange\" x1=\"0%\" y1=\"0%\" x2=\"0%\" y2=\"100%\">\n"
+           "      <stop offset=\"0%\" style=\"stop-color:#fc8d62;stop-opacity:0.8\" />\n"
+           "      <stop offset=\"50%\" style=\"stop-color:#fc8d62;stop-opacity:0.1\" />\n"
+           "      <stop offset=\"100%\" style=\"stop-color:#fc8d62;stop-opacity:0.8\" />\n"
+           "    </linearGradient>\n"
+           "    <linearGradient id=\"GreenWhiteGreen\" x1=\"0%\" y1=\"0%\" x2=\"0%\" y2=\"100%\">\n"
+           "      <stop offset=\"0%\" style=\"stop-color:#66c2a5;stop-opacity:0.8\" />\n"
+           "      <stop offset=\"50%\" style=\"stop-color:#66c2a5;stop-opacity:0.1\" />\n"
+           "      <stop offset=\"100%\" style=\"stop-color:#66c2a5;stop-opacity:0.8\" />\n"
+           "    </linearGradient>\n"
+           "    <marker id=\"arrow\" viewBox=\"0 0 10 10\" refX=\"9\" refY=\"5\"\n"
+           "        markerWidth=\"6\" markerHeight=\"6\"\n"
+           "        orient=\"auto-start-reverse\">\n"
+           "      <path d=\"M 0 0 L 10 5 L 0 10 z\" />\n"
+           "    </marker>"
+           "</defs>";
+}
 
-    int yPos = kPlotPadY;
+SvgLaneSink::SvgLaneSink(ostream& out, bool includeDefs)
+    : out_(out)
+    , includeDefs_(includeDefs)
+    , yPos_(kPlotPadY)
+    , lanePlotIndex_(0)
+{
+}
 
-    ofstream svgFile(outputPath);
-    if (svgFile.is_open())
+void SvgLaneSink::begin(const vector<LanePlotExtent>& extents)
+{
+    const SvgSize size = getSvgSize(extents);
+    out_ << "<svg width=\"" << size.width << "\" height=\"" << size.height << "\""
+         << " xmlns=\"http://www.w3.org/2000/svg\">\n";
+    if (includeDefs_)
     {
-        svgFile << "<svg width=\"" << plotWidth << "\" height=\"" << plotHeight << "\""
-                << " xmlns=\"http://www.w3.org/2000/svg\">\n";
-        svgFile << "<defs>\n"
-                   "    <linearGradient id=\"BlueWhiteBlue\" x1=\"0%\" y1=\"0%\" x2=\"0%\" y2=\"100%\">\n"
-                   "      <stop offset=\"0%\" style=\"stop-color:#8da0cb;stop-opacity:0.8\" />\n"
-                   "      <stop offset=\"50%\" style=\"stop-color:#8da0cb;stop-opacity:0.1\" />\n"
-                   "      <stop offset=\"100%\" style=\"stop-color:#8da0cb;stop-opacity:0.8\" />\n"
-                   "    </linearGradient>\n"
-                   "    <linearGradient id=\"OrangeWhiteOrange\" x1=\"0%\" y1=\"0%\" x2=\"0%\" y2=\"100%\">\n"
-                   "      <stop offset=\"0%\" style=\"stop-color:#fc8d62;stop-opacity:0.8\" />\n"
-                   "      <stop offset=\"50%\" style=\"stop-color:#fc8d62;stop-opacity:0.1\" />\n"
-                   "      <stop offset=\"100%\" style=\"stop-color:#fc8d62;stop-opacity:0.8\" />\n"
-                   "    </linearGradient>\n"
-                   "    <linearGradient id=\"GreenWhiteGreen\" x1=\"0%\" y1=\"0%\" x2=\"0%\" y2=\"100%\">\n"
-                   "      <stop offset=\"0%\" style=\"stop-color:#66c2a5;stop-opacity:0.8\" />\n"
-                   "      <stop offset=\"50%\" style=\"stop-color:#66c2a5;stop-opacity:0.1\" />\n"
-                   "      <stop offset=\"100%\" style=\"stop-color:#66c2a5;stop-opacity:0.8\" />\n"
-                   "    </linearGradient>\n"
-                   "    <marker id=\"arrow\" viewBox=\"0 0 10 10\" refX=\"9\" refY=\"5\"\n"
-                   "        markerWidth=\"6\" markerHeight=\"6\"\n"
-                   "        orient=\"auto-start-reverse\">\n"
-                   "      <path d=\"M 0 0 L 10 5 L 0 10 z\" />\n"
-                   "    </marker>"
-                   "</defs>";
-
-        for (const auto& lanePlot : lanePlots)
-        {
-            for (const auto& lane : lanePlot)
-            {
-                drawLane(svgFile, kBaseWidth, kPlotPadX, yPos, lane);
-                yPos += lane.height + kSpacingBetweenLanes;
-            }
+        generateSvgDefs(out_);
+    }
 
-            yPos += kSpacingBetweenLanePlots;
-        }
+    yPos_ = kPlotPadY;
+    lanePlotIndex_ = 0;
+    patternIds_.clear();
+}
 
-        svgFile << "</svg>" << std::endl;
-    }
-    else
+void SvgLaneSink::addLane(int lanePlotIndex, Lane lane)
+{
+    yPos_ += (lanePlotIndex - lanePlotIndex_) * kSpacingBetweenLanePlots;
+    lanePlotIndex_ = lanePlotIndex;
+
+    drawLane(out_, kBaseWidth, kPlotPadX, yPos_, lane, patternIds_);
+    yPos_ += lane.height + kSpacingBetweenLanes;
+}
+
+void SvgLaneSink::end() { out_ << "</svg>" << std::endl; }
+
+void generateSvg(const vector<LanePlot>& lanePlots, ostream& out, bool includeDefs)
+{
+    SvgLaneSink sink(out, includeDefs);
+    emitLanePlots(lanePlots, sink);
+}
+
+void generateSvg(const vector<LanePlot>& lanePlots, const string& outputPath)
+{
+    ofstream svgFile(outputPath);
+    if (!svgFile.is_open())
     {
         throw std::runtime_error("Unable to open " + outputPath);
     }
+
+    generateSvg(lanePlots, svgFile);
 }
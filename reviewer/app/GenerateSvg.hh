@@ -20,9 +20,62 @@
 
 #pragma once
 
+#include <ostream>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "app/LanePlot.hh"
 
+const int kSpacingBetweenLanes = 5;
+const int kSpacingBetweenLanePlots = 50;
+const int kBaseWidth = 10;
+const int kPlotPadX = 10;
+const int kPlotPadY = 5;
+
+struct SvgSize
+{
+    int width;
+    int height;
+};
+
+SvgSize getSvgSize(const std::vector<LanePlotExtent>& extents);
+SvgSize getSvgSize(const std::vector<LanePlot>& lanePlots);
+
+// Vertical positions of all lanes of all lane plots in the order they are drawn
+std::vector<int> getLaneYPositions(const std::vector<LanePlot>& lanePlots);
+
+// Ids of the patterns already written to an image
+using SvgPatternIds = std::unordered_set<std::string>;
+
+/// Draws the features of the lane; runs of identical rects (e.g. repeat units) are drawn as single rects tiled by a
+/// pattern that is written to the image the first time it is used
+void drawLane(std::ostream& out, int baseWidth, int xPosStart, int yPos, const Lane& lane, SvgPatternIds& patternIds);
+
+// Writes gradients and markers referenced by the plots
+void generateSvgDefs(std::ostream& out);
+
+// Draws lanes as they arrive so that a lane plot need not be held in memory in its entirety
+class SvgLaneSink : public LanePlotSink
+{
+public:
+    /// \param includeDefs: Omit to share a single copy of the definitions between several images in the same document
+    explicit SvgLaneSink(std::ostream& out, bool includeDefs = true);
+
+    void begin(const std::vector<LanePlotExtent>& extents) override;
+    void addLane(int lanePlotIndex, Lane lane) override;
+    void end() override;
+
+private:
+    std::ostream& out_;
+    bool includeDefs_;
+    int yPos_;
+    int lanePlotIndex_;
+    SvgPatternIds patternIds_;
+};
+
+/// Writes SVG image of the lane plots
+///
+/// \param includeDefs: Omit to share a single copy of the definitions between several images in the same document
+void generateSvg(const std::vector<LanePlot>& lanePlots, std::ostream& out, bool includeDefs = true);
 void generateSvg(const std::vector<LanePlot>& lanePlots, const std::string& outputPath);
\ No newline at end of file
@@ -22,15 +22,10 @@
 
 #include <algorithm>
 #include <cassert>
-#include <fstream>
 #include <map>
 #include <stdexcept>
 #include <utility>
 
-#include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <boost/iostreams/filtering_streambuf.hpp>
 #include <boost/optional.hpp>
 
 using boost::optional;
@@ -39,86 +34,9 @@ using graphtools::NodeId;
 using graphtools::Path;
 using std::map;
 using std::pair;
-using std::runtime_error;
-using std::stoi;
 using std::string;
 using std::vector;
 
-static vector<int> parseRepeatLengthsFromStream(std::istream& vcfStream, const string& repeatId)
-{
-    const string query = "VARID=" + repeatId + ";";
-    string line;
-    while (getline(vcfStream, line))
-    {
-        if (boost::find_first(line, query))
-        {
-            vector<string> pieces;
-            boost::split(pieces, line, boost::is_any_of("\t"));
-            if (pieces.size() < 10)
-            {
-                throw runtime_error("Malformed VCF record for " + repeatId);
-            }
-            const string& formatField = pieces[8];
-            const string& sampleFields = pieces[9];
-            vector<string> formatPieces;
-            boost::split(formatPieces, formatField, boost::is_any_of(":"));
-            boost::split(pieces, sampleFields, boost::is_any_of(":"));
-            auto repcnIter = std::find(formatPieces.begin(), formatPieces.end(), "REPCN");
-            if (repcnIter == formatPieces.end())
-            {
-                throw runtime_error("Missing REPCN field for " + repeatId);
-            }
-            const auto repcnIndex = static_cast<size_t>(std::distance(formatPieces.begin(), repcnIter));
-            if (pieces.size() <= repcnIndex)
-            {
-                throw runtime_error("Missing REPCN sample value for " + repeatId);
-            }
-            const string genotypeEncoding = pieces[repcnIndex];
-
-            if (genotypeEncoding == "./.")
-            {
-                throw runtime_error("Cannot create a plot because the genotype of " + repeatId + " is missing");
-            }
-
-            boost::split(pieces, genotypeEncoding, boost::is_any_of("/"));
-            vector<int> sizes;
-            for (const auto& sizeEncoding : pieces)
-            {
-                sizes.push_back(stoi(sizeEncoding));
-            }
-            return sizes;
-        }
-    }
-
-    throw std::runtime_error("No VCF record for " + repeatId);
-}
-
-static vector<int> extractRepeatLengths(const string& vcfPath, const string& repeatId)
-{
-    if (boost::algorithm::ends_with(vcfPath, "gz"))
-    {
-        std::ifstream vcfFile(vcfPath, std::ios::binary);
-        if (!vcfFile.is_open())
-        {
-            throw std::runtime_error("Unable to open file " + vcfPath);
-        }
-        boost::iostreams::filtering_istreambuf bufferedInputStream;
-        bufferedInputStream.push(boost::iostreams::gzip_decompressor());
-        bufferedInputStream.push(vcfFile);
-        std::istream decompressedStream(&bufferedInputStream);
-        return parseRepeatLengthsFromStream(decompressedStream, repeatId);
-    }
-    else
-    {
-        std::ifstream vcfFile(vcfPath);
-        if (!vcfFile.is_open())
-        {
-            throw std::runtime_error("Unable to open file " + vcfPath);
-        }
-        return parseRepeatLengthsFromStream(vcfFile, repeatId);
-    }
-}
-
 static vector<int> capLengths(int upperBound, const vector<int>& lengths)
 {
     vector<int> cappedLength;
@@ -138,7 +56,7 @@ using NodeVectors = std::vector<NodeVector>;
 
 /// Determine sequences of nodes corresponding to each allele of the given variant
 /// \param meanFragLen: Mean fragment length
-/// \param vcfPath: Path to VCF file generated by ExpansionHunter
+/// \param genotypes: Repeat genotypes of the sample
 /// \param locusSpec: Description of the target locus
 /// \return Sequences of nodes for each allele indexed by the range of nodes corresponding to the entire variant
 ///
@@ -148,7 +66,7 @@ using NodeVectors = std::vector<NodeVector>;
 ///  An STR corresponding to RE (CAG)* with genotype 3/4 corresponds to the
 ///  output {{1, 1}: {{1, 1, 1}, {1, 1, 1, 1}}
 map<NodeRange, NodeVectors>
-getGenotypeNodesByNodeRange(int meanFragLen, const string& vcfPath, const LocusSpecification& locusSpec)
+getGenotypeNodesByNodeRange(int meanFragLen, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec)
 {
     map<NodeRange, NodeVectors> genotypeNodesByNodeRange;
     for (const auto& variantSpec : locusSpec.variantSpecs())
@@ -162,7 +80,7 @@ getGenotypeNodesByNodeRange(int meanFragLen, const string& vcfPath, const LocusS
         NodeId repeatNode = variantSpec.nodes().front();
         NodeVectors genotypeNodes;
 
-        auto repeatLens = extractRepeatLengths(vcfPath, variantSpec.id());
+        auto repeatLens = genotypes.getRepeatLengths(variantSpec.id());
         repeatLens = capLengths(meanFragLen, repeatLens);
 
         genotypeNodes.reserve(repeatLens.size());
@@ -244,9 +162,10 @@ static vector<NodeVectors> extendDiplotype(const vector<NodeVectors>& genotypes,
     return extendedGenotype;
 }
 
-vector<Diplotype> getCandidateDiplotypes(int meanFragLen, const string& vcfPath, const LocusSpecification& locusSpec)
+vector<Diplotype>
+getCandidateDiplotypes(int meanFragLen, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec)
 {
-    auto genotypeNodesByNodeRange = getGenotypeNodesByNodeRange(meanFragLen, vcfPath, locusSpec);
+    auto genotypeNodesByNodeRange = getGenotypeNodesByNodeRange(meanFragLen, genotypes, locusSpec);
 
     // Assume that all variants have the same number of alleles
     const auto numAlleles = genotypeNodesByNodeRange.empty() ? 2 : genotypeNodesByNodeRange.begin()->second.size();
@@ -303,53 +222,146 @@ vector<Diplotype> getCandidateDiplotypes(int meanFragLen, const string& vcfPath,
     return diplotypes;
 }
 
+static string summarizeNode(const Graph& graph, NodeId nodeId, int numOccurrences)
+{
+    if (nodeId == 0)
+    {
+        return "(LF)";
+    }
+    if (nodeId + 1 == graph.numNodes())
+    {
+        return "(RF)";
+    }
+
+    string summary = "(" + graph.nodeSeq(nodeId) + ")";
+    if (graph.hasEdge(nodeId, nodeId))
+    {
+        summary += "{" + std::to_string(numOccurrences) + "}";
+    }
+    return summary;
+}
+
+// Nodes are summarized in the order of their first occurrence
 static string summarizePath(const graphtools::Path& path)
 {
     const auto& graph = *path.graphRawPtr();
-    string summary;
-    std::set<graphtools::NodeId> observedNodes;
+    vector<int> numOccurrencesByNode(graph.numNodes(), 0);
+    vector<NodeId> nodesByFirstOccurrence;
     for (const auto nodeId : path.nodeIds())
     {
-        if (observedNodes.find(nodeId) != observedNodes.end())
+        if (numOccurrencesByNode[nodeId]++ == 0)
         {
-            continue;
+            nodesByFirstOccurrence.push_back(nodeId);
         }
+    }
+
+    string summary;
+    for (const auto nodeId : nodesByFirstOccurrence)
+    {
+        summary += summarizeNode(graph, nodeId, numOccurrencesByNode[nodeId]);
+    }
+    return summary;
+}
 
-        const bool isLoopNode = graph.hasEdge(nodeId, nodeId);
+std::ostream& operator<<(std::ostream& out, const Diplotype& diplotype)
+{
+    out << summarizePath(diplotype.front());
+    if (diplotype.size() == 2)
+    {
+        out << "/" << summarizePath(diplotype.back());
+    }
+    return out;
+}
 
-        if (nodeId == 0)
+DiplotypeCodec::DiplotypeCodec(const Graph& graph)
+    : graphPtr_(&graph)
+    , isRepeatNode_(graph.numNodes(), false)
+{
+    for (NodeId node = 0; node != graph.numNodes(); ++node)
+    {
+        isRepeatNode_[node] = graph.hasEdge(node, node);
+    }
+}
+
+CompactDiplotype DiplotypeCodec::encode(const Diplotype& diplotype) const
+{
+    const NodeId rightFlankNode = graphPtr_->numNodes() - 1;
+    const int rightFlankLength = graphPtr_->nodeSeq(rightFlankNode).length();
+
+    CompactDiplotype compactDiplotype;
+    for (const auto& haplotype : diplotype)
+    {
+        const auto& nodes = haplotype.nodeIds();
+        bool isEncodable = haplotype.graphRawPtr() == graphPtr_ && haplotype.startPosition() == 0
+            && haplotype.endPosition() == rightFlankLength;
+        vector<int> repeatLengths;
+        auto nodeIt = nodes.begin();
+        for (NodeId node = 0; node != graphPtr_->numNodes() && isEncodable; ++node)
         {
-            summary += "(LF)";
+            const auto runEnd = std::find_if(nodeIt, nodes.end(), [node](NodeId pathNode) { return pathNode != node; });
+            const int runLength = static_cast<int>(runEnd - nodeIt);
+            if (isRepeatNode_[node])
+            {
+                repeatLengths.push_back(runLength);
+            }
+            else
+            {
+                isEncodable = runLength == 1;
+            }
+            nodeIt = runEnd;
         }
-        else if (nodeId + 1 == graph.numNodes())
+
+        if (!isEncodable || nodeIt != nodes.end())
         {
-            summary += "(RF)";
+            throw std::logic_error("Path " + haplotype.encode() + " is not a candidate haplotype");
         }
-        else
-        {
-            assert(graph.numNodes() != 0);
-            const string& nodeSeq = graph.nodeSeq(nodeId);
-            summary += "(" + nodeSeq + ")";
+        compactDiplotype.push_back(std::move(repeatLengths));
+    }
 
-            if (isLoopNode)
-            {
-                int numMotifs = std::count(path.nodeIds().begin(), path.nodeIds().end(), nodeId);
-                summary += "{" + std::to_string(numMotifs) + "}";
-            }
-        }
+    return compactDiplotype;
+}
 
-        observedNodes.emplace(nodeId);
+Diplotype DiplotypeCodec::decode(const CompactDiplotype& compactDiplotype) const
+{
+    const NodeId rightFlankNode = graphPtr_->numNodes() - 1;
+    const int rightFlankLength = graphPtr_->nodeSeq(rightFlankNode).length();
+
+    Diplotype diplotype;
+    for (const auto& repeatLengths : compactDiplotype)
+    {
+        NodeVector nodes;
+        auto repeatLengthIt = repeatLengths.begin();
+        for (NodeId node = 0; node != graphPtr_->numNodes(); ++node)
+        {
+            const int runLength = isRepeatNode_[node] ? *repeatLengthIt++ : 1;
+            nodes.insert(nodes.end(), runLength, node);
+        }
+        diplotype.emplace_back(graphPtr_, 0, nodes, rightFlankLength);
     }
 
-    return summary;
+    return diplotype;
 }
 
-std::ostream& operator<<(std::ostream& out, const Diplotype& diplotype)
+string DiplotypeCodec::summarize(const CompactDiplotype& compactDiplotype) const
 {
-    out << summarizePath(diplotype.front());
-    if (diplotype.size() == 2)
+    string summary;
+    for (const auto& repeatLengths : compactDiplotype)
     {
-        out << "/" << summarizePath(diplotype.back());
+        if (!summary.empty())
+        {
+            summary += "/";
+        }
+
+        auto repeatLengthIt = repeatLengths.begin();
+        for (NodeId node = 0; node != graphPtr_->numNodes(); ++node)
+        {
+            const int runLength = isRepeatNode_[node] ? *repeatLengthIt++ : 1;
+            if (runLength != 0)
+            {
+                summary += summarizeNode(*graphPtr_, node, runLength);
+            }
+        }
     }
-    return out;
+
+    return summary;
 }
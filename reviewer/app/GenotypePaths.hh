@@ -23,16 +23,41 @@
 #include <string>
 #include <vector>
 
+#include "graphcore/Graph.hh"
 #include "graphcore/Path.hh"
 
+#include "app/VcfGenotypeIndex.hh"
 #include "core/LocusSpecification.hh"
 
 using Diplotype = std::vector<graphtools::Path>;
 std::ostream& operator<<(std::ostream& out, const Diplotype& diplotype);
 
+/// Lengths of the repeats of each haplotype of a diplotype, in the order of the repeat nodes in the locus graph
+using CompactDiplotype = std::vector<std::vector<int>>;
+
+/// Converts candidate diplotypes to and from their compact encoding
+///
+/// Candidate haplotypes traverse all nodes of the locus graph in order and only repeat nodes occur other than once,
+/// so each haplotype is determined by its repeat lengths. Paths are materialized only when needed.
+class DiplotypeCodec
+{
+public:
+    explicit DiplotypeCodec(const graphtools::Graph& graph);
+
+    CompactDiplotype encode(const Diplotype& diplotype) const;
+    Diplotype decode(const CompactDiplotype& diplotype) const;
+
+    /// \return Same summary as printing the decoded diplotype
+    std::string summarize(const CompactDiplotype& diplotype) const;
+
+private:
+    const graphtools::Graph* graphPtr_;
+    std::vector<bool> isRepeatNode_;
+};
+
 /// Computes all possible diplotype paths at the given locus
 /// \param meanFragLen: Mean fragment length
-/// \param vcfPath: Path to the VCF file
+/// \param genotypes: Repeat genotypes of the sample
 /// \param locusSpec: Locus specification
 /// \return Vector of all possible diplotype paths
 ///
@@ -42,4 +67,4 @@ std::ostream& operator<<(std::ostream& out, const Diplotype& diplotype);
 /// (last node)
 ///
 std::vector<Diplotype>
-getCandidateDiplotypes(int meanFragLen, const std::string& vcfPath, const LocusSpecification& locusSpec);
+getCandidateDiplotypes(int meanFragLen, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec);
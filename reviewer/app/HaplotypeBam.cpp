@@ -0,0 +1,241 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/HaplotypeBam.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+extern "C"
+{
+#include "htslib/faidx.h"
+#include "htslib/hts.h"
+#include "htslib/kstring.h"
+#include "htslib/sam.h"
+}
+
+#include "graphalign/Operation.hh"
+
+using graphtools::Operation;
+using graphtools::OperationType;
+using graphtools::Path;
+using std::string;
+using std::to_string;
+using std::vector;
+
+// Compression threads of the BGZF writer
+static const unsigned kMaxWriterThreads = 4;
+
+namespace
+{
+
+struct BamLine
+{
+    int contigIndex;
+    int position;
+    string text;
+};
+
+}
+
+static string getContigName(const string& locusId, int pathIndex) { return locusId + "_hap" + to_string(pathIndex + 1); }
+
+static string getHaplotypeSeq(const Path& path)
+{
+    string seq;
+    for (auto node : path.nodeIds())
+    {
+        seq += path.graphRawPtr()->nodeSeq(node);
+    }
+    return seq;
+}
+
+static char getCigarCode(OperationType type)
+{
+    switch (type)
+    {
+    case OperationType::kInsertionToRef:
+        return 'I';
+    case OperationType::kDeletionFromRef:
+        return 'D';
+    case OperationType::kSoftclip:
+        return 'S';
+    default:
+        return 'M';
+    }
+}
+
+static string encodeLinearCigar(const GraphAlign& align)
+{
+    string cigar;
+    char lastCode = 0;
+    int lastLength = 0;
+    for (const auto& nodeAlign : align.alignments())
+    {
+        for (const Operation& operation : nodeAlign)
+        {
+            const char code = getCigarCode(operation.type());
+            const int length = code == 'D' ? operation.referenceLength() : operation.queryLength();
+            if (code == lastCode)
+            {
+                lastLength += length;
+                continue;
+            }
+            if (lastLength)
+            {
+                cigar += to_string(lastLength) + lastCode;
+            }
+            lastCode = code;
+            lastLength = length;
+        }
+    }
+    if (lastLength)
+    {
+        cigar += to_string(lastLength) + lastCode;
+    }
+
+    return cigar;
+}
+
+static BamLine encodeRead(
+    const string& fragId, const string& contigName, const Read& read, const ReadPathAlign& readAlign,
+    const ReadPathAlign& mateAlign, bool isFirstMate)
+{
+    int flag = BAM_FPAIRED | BAM_FPROPER_PAIR | (isFirstMate ? BAM_FREAD1 : BAM_FREAD2);
+    const int fragStart = std::min(readAlign.begin, mateAlign.begin);
+    const int fragEnd = std::max(readAlign.end, mateAlign.end);
+    const bool isLeftmost = readAlign.begin < mateAlign.begin || (readAlign.begin == mateAlign.begin && isFirstMate);
+    const int templateLength = isLeftmost ? fragEnd - fragStart : fragStart - fragEnd;
+
+    string text = fragId;
+    text += "\t" + to_string(flag) + "\t" + contigName + "\t" + to_string(readAlign.begin + 1) + "\t255\t";
+    text += encodeLinearCigar(*readAlign.align);
+    text += "\t=\t" + to_string(mateAlign.begin + 1) + "\t" + to_string(templateLength);
+    text += "\t" + read.bases + "\t" + read.quals;
+    text += "\tHP:i:" + to_string(readAlign.pathIndex + 1) + "\tAS:i:" + to_string(score(*readAlign.align));
+
+    return { readAlign.pathIndex, readAlign.begin, text };
+}
+
+static void writeHaplotypeFasta(const string& fastaPath, const string& locusId, const Diplotype& diplotype)
+{
+    std::ofstream fastaFile(fastaPath);
+    if (!fastaFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + fastaPath);
+    }
+
+    const int kLineWidth = 60;
+    for (int pathIndex = 0; pathIndex != static_cast<int>(diplotype.size()); ++pathIndex)
+    {
+        fastaFile << ">" << getContigName(locusId, pathIndex) << "\n";
+        const string seq = getHaplotypeSeq(diplotype[pathIndex]);
+        for (size_t start = 0; start < seq.length(); start += kLineWidth)
+        {
+            fastaFile << seq.substr(start, kLineWidth) << "\n";
+        }
+    }
+    fastaFile.close();
+
+    if (fai_build(fastaPath.c_str()) != 0)
+    {
+        throw std::runtime_error("Failed to index " + fastaPath);
+    }
+}
+
+static void writeBam(const string& bamPath, const string& headerText, const vector<BamLine>& lines)
+{
+    htsFile* htsFilePtr = sam_open(bamPath.c_str(), "wb");
+    if (!htsFilePtr)
+    {
+        throw std::runtime_error("Failed to open " + bamPath + " for writing");
+    }
+
+    const unsigned numThreads = std::max(1u, std::min(kMaxWriterThreads, std::thread::hardware_concurrency()));
+    hts_set_threads(htsFilePtr, numThreads);
+
+    sam_hdr_t* htsHeaderPtr = sam_hdr_parse(headerText.length(), headerText.c_str());
+    bam1_t* htsAlignmentPtr = bam_init1();
+    kstring_t lineBuffer = { 0, 0, nullptr };
+    bool isWritten = htsHeaderPtr && sam_hdr_write(htsFilePtr, htsHeaderPtr) == 0;
+    for (const auto& line : lines)
+    {
+        if (!isWritten)
+        {
+            break;
+        }
+        lineBuffer.l = 0;
+        kputsn(line.text.c_str(), line.text.length(), &lineBuffer);
+        isWritten = sam_parse1(&lineBuffer, htsHeaderPtr, htsAlignmentPtr) >= 0
+            && sam_write1(htsFilePtr, htsHeaderPtr, htsAlignmentPtr) >= 0;
+    }
+
+    free(lineBuffer.s);
+    bam_destroy1(htsAlignmentPtr);
+    if (htsHeaderPtr)
+    {
+        sam_hdr_destroy(htsHeaderPtr);
+    }
+    isWritten = sam_close(htsFilePtr) == 0 && isWritten;
+
+    if (!isWritten)
+    {
+        throw std::runtime_error("Failed to write " + bamPath);
+    }
+    if (sam_index_build(bamPath.c_str(), 0) != 0)
+    {
+        throw std::runtime_error("Failed to index " + bamPath);
+    }
+}
+
+void writeHaplotypeBam(
+    const string& prefix, const string& locusId, const Diplotype& diplotype, const FragById& fragById,
+    const FragAssignment& fragAssignment, const FragPathAlignsById& fragPathAlignsById)
+{
+    string headerText = "@HD\tVN:1.6\tSO:coordinate\n";
+    for (int pathIndex = 0; pathIndex != static_cast<int>(diplotype.size()); ++pathIndex)
+    {
+        headerText += "@SQ\tSN:" + getContigName(locusId, pathIndex)
+            + "\tLN:" + to_string(getHaplotypeSeq(diplotype[pathIndex]).length()) + "\n";
+    }
+    headerText += "@PG\tID:REViewer\tPN:REViewer\n";
+
+    vector<BamLine> lines;
+    for (int fragIndex = 0; fragIndex != static_cast<int>(fragAssignment.fragIds.size()); ++fragIndex)
+    {
+        const auto& fragId = fragAssignment.fragIds[fragIndex];
+        const auto& frag = fragById.at(fragId);
+        const auto& fragAlign = fragPathAlignsById.at(fragId)[fragAssignment.alignIndexByFrag[fragIndex]];
+        const string contigName = getContigName(locusId, fragAlign.readAlign.pathIndex);
+        lines.push_back(encodeRead(fragId, contigName, frag.read, fragAlign.readAlign, fragAlign.mateAlign, true));
+        lines.push_back(encodeRead(fragId, contigName, frag.mate, fragAlign.mateAlign, fragAlign.readAlign, false));
+    }
+
+    std::stable_sort(
+        lines.begin(), lines.end(), [](const BamLine& lhs, const BamLine& rhs)
+        { return std::tie(lhs.contigIndex, lhs.position) < std::tie(rhs.contigIndex, rhs.position); });
+
+    writeHaplotypeFasta(prefix + ".fa", locusId, diplotype);
+    writeBam(prefix + ".bam", headerText, lines);
+}
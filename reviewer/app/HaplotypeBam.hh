@@ -0,0 +1,43 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+
+#include "app/Aligns.hh"
+#include "app/GenotypePaths.hh"
+#include "app/Projection.hh"
+
+/// Writes reads projected onto the haplotypes of a locus into a coordinate-sorted and indexed BAM file
+///
+/// Each haplotype becomes a contig named <locus>_hap<N> whose sequence is written to an indexed FASTA file, so that
+/// the BAM can be loaded into genome browsers. Reads are placed at their projected coordinates with linear CIGARs and
+/// carry the haplotype their fragment is assigned to (HP tag) and the score of their projected alignment (AS tag).
+///
+/// \param prefix: Prefix of the output files (<prefix>.bam and <prefix>.fa)
+/// \param locusId: Locus id used to name haplotype contigs
+/// \param diplotype: Haplotype paths of the locus
+/// \param fragById: Fragments containing read sequences
+/// \param fragAssignment: Alignment assigned to each fragment
+/// \param fragPathAlignsById: Candidate alignments of each fragment
+void writeHaplotypeBam(
+    const std::string& prefix, const std::string& locusId, const Diplotype& diplotype, const FragById& fragById,
+    const FragAssignment& fragAssignment, const FragPathAlignsById& fragPathAlignsById);
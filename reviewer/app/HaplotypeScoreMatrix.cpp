@@ -0,0 +1,104 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/HaplotypeScoreMatrix.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#include "app/FragChunks.hh"
+#include "app/Projection.hh"
+
+using graphtools::Path;
+using std::vector;
+
+HaplotypeScoreMatrix::HaplotypeScoreMatrix(
+    const FragById& fragById, const vector<Diplotype>& diplotypes, int numThreads)
+    : numFrags_(static_cast<int>(fragById.size()))
+{
+    vector<const Path*> haplotypes;
+    for (const auto& diplotype : diplotypes)
+    {
+        for (const auto& haplotype : diplotype)
+        {
+            if (columnByHaplotype_.emplace(haplotype, static_cast<int>(haplotypes.size())).second)
+            {
+                haplotypes.push_back(&haplotype);
+            }
+        }
+    }
+
+    // Chunks of fragments fill disjoint rows of every column
+    pairScores_.resize(static_cast<size_t>(numFrags_) * haplotypes.size());
+    const auto fragEntries = getMapEntries(fragById);
+    auto scoreChunk = [this, &haplotypes, &fragEntries](size_t begin, size_t end)
+    {
+        for (size_t column = 0; column != haplotypes.size(); ++column)
+        {
+            int* pairScores = pairScores_.data() + column * numFrags_;
+            for (size_t fragIndex = begin; fragIndex != end; ++fragIndex)
+            {
+                pairScores[fragIndex] = scorePairProjection(fragEntries[fragIndex]->second, *haplotypes[column]);
+            }
+        }
+        return true;
+    };
+    processFragChunks<bool>(fragEntries.size(), numThreads, scoreChunk);
+}
+
+const int* HaplotypeScoreMatrix::getColumn(const Path& haplotype) const
+{
+    const auto columnIt = columnByHaplotype_.find(haplotype);
+    if (columnIt == columnByHaplotype_.end())
+    {
+        throw std::logic_error("Haplotype is missing from the score matrix");
+    }
+    return pairScores_.data() + static_cast<size_t>(columnIt->second) * numFrags_;
+}
+
+int HaplotypeScoreMatrix::score(const Diplotype& diplotype) const
+{
+    assert(diplotype.size() == 1 || diplotype.size() == 2);
+
+    int diplotypeScore = 0;
+    const int* firstScores = getColumn(diplotype.front());
+    if (diplotype.size() == 1)
+    {
+        for (int fragIndex = 0; fragIndex != numFrags_; ++fragIndex)
+        {
+            const int pairScore = firstScores[fragIndex];
+            diplotypeScore += pairScore != kNoPairScore ? pairScore : 0;
+        }
+        return diplotypeScore;
+    }
+
+    // Branch-free so that the loop vectorizes; fragments projecting onto neither haplotype contribute nothing
+    const int* secondScores = getColumn(diplotype.back());
+    for (int fragIndex = 0; fragIndex != numFrags_; ++fragIndex)
+    {
+        const int firstScore = firstScores[fragIndex];
+        const int secondScore = secondScores[fragIndex];
+        const int bestScore = std::max(firstScore, secondScore);
+        const int numBestHaplotypes = firstScore == secondScore ? 2 : 1;
+        diplotypeScore += bestScore != kNoPairScore ? numBestHaplotypes * bestScore : 0;
+    }
+    return diplotypeScore;
+}
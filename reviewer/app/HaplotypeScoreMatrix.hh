@@ -0,0 +1,57 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "graphcore/Path.hh"
+
+#include "app/Aligns.hh"
+#include "app/GenotypePaths.hh"
+
+/// Pair scores of all fragments projected onto each distinct haplotype of the candidate diplotypes
+///
+/// Each fragment is projected onto each distinct haplotype once, however many diplotypes share it. Scores are stored
+/// column-major, one contiguous column per haplotype, so that a diplotype is scored by a single pass over the columns
+/// of its haplotypes.
+class HaplotypeScoreMatrix
+{
+public:
+    /// \param numThreads: Number of threads projecting consecutive chunks of fragments
+    HaplotypeScoreMatrix(const FragById& fragById, const std::vector<Diplotype>& diplotypes, int numThreads = 1);
+
+    int numFrags() const { return numFrags_; }
+    int numHaplotypes() const { return static_cast<int>(columnByHaplotype_.size()); }
+
+    /// Scores a diplotype of one or two of the haplotypes
+    ///
+    /// Each fragment contributes its best pair score once for every haplotype achieving it, which is the sum of
+    /// scorePath over the haplotypes after projecting the fragments with project().
+    int score(const Diplotype& diplotype) const;
+
+private:
+    const int* getColumn(const graphtools::Path& haplotype) const;
+
+    int numFrags_;
+    std::map<graphtools::Path, int> columnByHaplotype_;
+    std::vector<int> pairScores_;
+};
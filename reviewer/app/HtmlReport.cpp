@@ -0,0 +1,192 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/HtmlReport.hh"
+
+#include <sstream>
+#include <stdexcept>
+
+#include "app/GenerateSvg.hh"
+#include "archive/Gzip.hh"
+
+using std::string;
+using std::vector;
+
+static const char* kReportHeader = R"(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>REViewer report</title>
+<style>
+body { font-family: sans-serif; margin: 20px; }
+section { margin-bottom: 30px; }
+h2 { font-size: 16px; font-family: monospace; }
+.plot { overflow-x: auto; }
+.plot-placeholder { background: #f4f4f4; }
+</style>
+</head>
+<body>
+)";
+
+// Plots are decoded when they come within a screen of the viewport
+static const char* kReportFooter = R"(<script>
+async function decodePlot(container) {
+    const bytes = Uint8Array.from(atob(container.dataset.plot), c => c.charCodeAt(0));
+    const stream = new Blob([bytes]).stream().pipeThrough(new DecompressionStream("gzip"));
+    container.innerHTML = await new Response(stream).text();
+    container.classList.remove("plot-placeholder");
+    container.style.height = "";
+    delete container.dataset.plot;
+}
+
+const plots = document.querySelectorAll(".plot[data-plot]");
+if ("IntersectionObserver" in window) {
+    const observer = new IntersectionObserver(entries => {
+        for (const entry of entries) {
+            if (entry.isIntersecting) {
+                observer.unobserve(entry.target);
+                decodePlot(entry.target);
+            }
+        }
+    }, { rootMargin: "100% 0px" });
+    plots.forEach(plot => observer.observe(plot));
+} else {
+    plots.forEach(decodePlot);
+}
+</script>
+</body>
+</html>
+)";
+
+static string encodeBase64(const string& bytes)
+{
+    static const char* kAlphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    string encoding;
+    encoding.reserve(4 * ((bytes.size() + 2) / 3));
+    for (size_t index = 0; index < bytes.size(); index += 3)
+    {
+        const size_t numBytes = std::min<size_t>(3, bytes.size() - index);
+        uint32_t chunk = static_cast<uint8_t>(bytes[index]) << 16;
+        if (numBytes > 1)
+        {
+            chunk |= static_cast<uint8_t>(bytes[index + 1]) << 8;
+        }
+        if (numBytes > 2)
+        {
+            chunk |= static_cast<uint8_t>(bytes[index + 2]);
+        }
+
+        encoding += kAlphabet[(chunk >> 18) & 0x3F];
+        encoding += kAlphabet[(chunk >> 12) & 0x3F];
+        encoding += numBytes > 1 ? kAlphabet[(chunk >> 6) & 0x3F] : '=';
+        encoding += numBytes > 2 ? kAlphabet[chunk & 0x3F] : '=';
+    }
+
+    return encoding;
+}
+
+static string escapeHtml(const string& text)
+{
+    string escapedText;
+    for (char symbol : text)
+    {
+        switch (symbol)
+        {
+        case '&':
+            escapedText += "&amp;";
+            break;
+        case '<':
+            escapedText += "&lt;";
+            break;
+        case '>':
+            escapedText += "&gt;";
+            break;
+        case '"':
+            escapedText += "&quot;";
+            break;
+        default:
+            escapedText += symbol;
+        }
+    }
+    return escapedText;
+}
+
+HtmlReportWriter::HtmlReportWriter(const string& reportPath)
+    : reportPath_(reportPath)
+    , reportFile_(reportPath)
+{
+    if (!reportFile_.is_open())
+    {
+        throw std::runtime_error("Unable to open " + reportPath);
+    }
+
+    reportFile_ << kReportHeader;
+
+    // Element ids are shared by the whole document, so the plots can reference these definitions
+    reportFile_ << "<svg width=\"0\" height=\"0\" style=\"position:absolute\" xmlns=\"http://www.w3.org/2000/svg\">";
+    generateSvgDefs(reportFile_);
+    reportFile_ << "</svg>\n";
+}
+
+HtmlReportWriter::~HtmlReportWriter()
+{
+    if (reportFile_.is_open())
+    {
+        try
+        {
+            close();
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+}
+
+void HtmlReportWriter::add(const string& locusId, const vector<LanePlot>& lanePlots)
+{
+    std::ostringstream svg;
+    generateSvg(lanePlots, svg, false);
+
+    // The placeholder takes the size of the plot so that the page does not jump as plots are decoded
+    const SvgSize size = getSvgSize(lanePlots);
+    const string escapedLocusId = escapeHtml(locusId);
+    reportFile_ << "<section id=\"" << escapedLocusId << "\">\n";
+    reportFile_ << "<h2>" << escapedLocusId << "</h2>\n";
+    reportFile_ << "<div class=\"plot plot-placeholder\" style=\"height:" << size.height << "px\"";
+    reportFile_ << " data-plot=\"" << encodeBase64(gzipCompress(svg.str())) << "\"></div>\n";
+    reportFile_ << "</section>\n";
+
+    if (!reportFile_)
+    {
+        throw std::runtime_error("Unable to write plot of " + locusId + " to " + reportPath_);
+    }
+}
+
+void HtmlReportWriter::close()
+{
+    reportFile_ << kReportFooter;
+    reportFile_.close();
+
+    if (!reportFile_)
+    {
+        throw std::runtime_error("Unable to write " + reportPath_);
+    }
+}
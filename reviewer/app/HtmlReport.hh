@@ -0,0 +1,44 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "app/LanePlot.hh"
+
+// Writes plots of many loci into a single HTML page. Gradients and markers shared by all plots are written once;
+// each plot is stored gzip-compressed and is decoded by the browser only when it is scrolled into view, so the page
+// opens quickly regardless of the number of loci.
+class HtmlReportWriter
+{
+public:
+    explicit HtmlReportWriter(const std::string& reportPath);
+    ~HtmlReportWriter();
+
+    void add(const std::string& locusId, const std::vector<LanePlot>& lanePlots);
+    void close();
+
+private:
+    std::string reportPath_;
+    std::ofstream reportFile_;
+};
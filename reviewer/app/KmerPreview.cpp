@@ -0,0 +1,263 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/KmerPreview.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using std::string;
+using std::vector;
+
+static const uint64_t kEmptySlot = ~static_cast<uint64_t>(0);
+
+static int encodeBase(char base)
+{
+    switch (base)
+    {
+    case 'A':
+    case 'a':
+        return 0;
+    case 'C':
+    case 'c':
+        return 1;
+    case 'G':
+    case 'g':
+        return 2;
+    case 'T':
+    case 't':
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+// Calls processKmer for 2-bit encodings of all k-mers of the sequence that contain no ambiguous bases
+template <typename Callback> static void forEachKmer(const string& sequence, int kmerLength, Callback processKmer)
+{
+    const uint64_t kmerMask = (static_cast<uint64_t>(1) << (2 * kmerLength)) - 1;
+    uint64_t kmer = 0;
+    int numValidBases = 0;
+    for (char base : sequence)
+    {
+        const int baseCode = encodeBase(base);
+        if (baseCode == -1)
+        {
+            numValidBases = 0;
+            kmer = 0;
+            continue;
+        }
+
+        kmer = ((kmer << 2) | static_cast<uint64_t>(baseCode)) & kmerMask;
+        if (++numValidBases >= kmerLength)
+        {
+            processKmer(kmer);
+        }
+    }
+}
+
+static size_t hashKmer(uint64_t kmer) { return static_cast<size_t>((kmer * 0x9E3779B97F4A7C15ULL) >> 17); }
+
+int KmerPreview::countHaplotypes(const vector<Diplotype>& diplotypes)
+{
+    vector<graphtools::Path> haplotypes;
+    for (const auto& diplotype : diplotypes)
+    {
+        for (const auto& haplotype : diplotype)
+        {
+            if (std::find(haplotypes.begin(), haplotypes.end(), haplotype) == haplotypes.end())
+            {
+                haplotypes.push_back(haplotype);
+            }
+        }
+    }
+    return static_cast<int>(haplotypes.size());
+}
+
+KmerPreview::KmerPreview(vector<Diplotype> diplotypes, int kmerLength)
+    : diplotypes_(std::move(diplotypes))
+    , kmerLength_(kmerLength)
+    , numKmers_(0)
+{
+    if (kmerLength_ < 1 || kmerLength_ > 31)
+    {
+        throw std::logic_error("K-mer length must be between 1 and 31");
+    }
+
+    vector<graphtools::Path> haplotypes;
+    for (const auto& diplotype : diplotypes_)
+    {
+        uint64_t diplotypeMask = 0;
+        for (const auto& haplotype : diplotype)
+        {
+            auto haplotypeIter = std::find(haplotypes.begin(), haplotypes.end(), haplotype);
+            if (haplotypeIter == haplotypes.end())
+            {
+                haplotypeIter = haplotypes.insert(haplotypes.end(), haplotype);
+            }
+            const auto haplotypeIndex = static_cast<size_t>(haplotypeIter - haplotypes.begin());
+            if (haplotypeIndex >= static_cast<size_t>(kMaxHaplotypes))
+            {
+                throw std::runtime_error(
+                    "K-mer preview supports at most " + std::to_string(kMaxHaplotypes) + " candidate haplotypes");
+            }
+            diplotypeMask |= static_cast<uint64_t>(1) << haplotypeIndex;
+        }
+        diplotypeMasks_.push_back(diplotypeMask);
+    }
+
+    // K-mers of each haplotype as sorted lists so that their membership can be merged into masks
+    vector<vector<uint64_t>> kmersByHaplotype;
+    for (const auto& haplotype : haplotypes)
+    {
+        vector<uint64_t> kmers;
+        forEachKmer(haplotype.seq(), kmerLength_, [&kmers](uint64_t kmer) { kmers.push_back(kmer); });
+        std::sort(kmers.begin(), kmers.end());
+        kmers.erase(std::unique(kmers.begin(), kmers.end()), kmers.end());
+        kmersByHaplotype.push_back(std::move(kmers));
+    }
+
+    vector<std::pair<uint64_t, uint64_t>> maskByKmer;
+    for (size_t haplotypeIndex = 0; haplotypeIndex != kmersByHaplotype.size(); ++haplotypeIndex)
+    {
+        for (uint64_t kmer : kmersByHaplotype[haplotypeIndex])
+        {
+            maskByKmer.emplace_back(kmer, static_cast<uint64_t>(1) << haplotypeIndex);
+        }
+    }
+    std::sort(maskByKmer.begin(), maskByKmer.end());
+
+    const uint64_t allHaplotypesMask
+        = haplotypes.size() == 64 ? kEmptySlot : (static_cast<uint64_t>(1) << haplotypes.size()) - 1;
+    vector<std::pair<uint64_t, uint64_t>> informativeKmers;
+    for (const auto& kmerAndMask : maskByKmer)
+    {
+        if (!informativeKmers.empty() && informativeKmers.back().first == kmerAndMask.first)
+        {
+            informativeKmers.back().second |= kmerAndMask.second;
+        }
+        else
+        {
+            informativeKmers.push_back(kmerAndMask);
+        }
+    }
+
+    size_t tableSize = 16;
+    while (tableSize < 2 * informativeKmers.size())
+    {
+        tableSize *= 2;
+    }
+    kmers_.assign(tableSize, kEmptySlot);
+    haplotypeMasks_.assign(tableSize, 0);
+
+    for (const auto& kmerAndMask : informativeKmers)
+    {
+        if (kmerAndMask.second != allHaplotypesMask)
+        {
+            insert(kmerAndMask.first, kmerAndMask.second);
+        }
+    }
+}
+
+size_t KmerPreview::findSlot(uint64_t kmer) const
+{
+    const size_t slotMask = kmers_.size() - 1;
+    size_t slot = hashKmer(kmer) & slotMask;
+    while (kmers_[slot] != kmer && kmers_[slot] != kEmptySlot)
+    {
+        slot = (slot + 1) & slotMask;
+    }
+    return slot;
+}
+
+void KmerPreview::insert(uint64_t kmer, uint64_t haplotypeMask)
+{
+    const size_t slot = findSlot(kmer);
+    kmers_[slot] = kmer;
+    haplotypeMasks_[slot] = haplotypeMask;
+    ++numKmers_;
+}
+
+ScoredDiplotypes KmerPreview::rank(const FragById& fragById) const
+{
+    vector<uint32_t> countBySlot(kmers_.size(), 0);
+    auto countKmer = [this, &countBySlot](uint64_t kmer)
+    {
+        const size_t slot = findSlot(kmer);
+        if (kmers_[slot] != kEmptySlot)
+        {
+            ++countBySlot[slot];
+        }
+    };
+
+    for (const auto& fragIdAndFrag : fragById)
+    {
+        forEachKmer(fragIdAndFrag.second.read.bases, kmerLength_, countKmer);
+        forEachKmer(fragIdAndFrag.second.mate.bases, kmerLength_, countKmer);
+    }
+
+    vector<std::pair<uint64_t, int>> observedMasksAndCounts;
+    for (size_t slot = 0; slot != kmers_.size(); ++slot)
+    {
+        if (countBySlot[slot] != 0)
+        {
+            observedMasksAndCounts.emplace_back(haplotypeMasks_[slot], static_cast<int>(countBySlot[slot]));
+        }
+    }
+
+    ScoredDiplotypes scoredDiplotypes;
+    for (size_t diplotypeIndex = 0; diplotypeIndex != diplotypes_.size(); ++diplotypeIndex)
+    {
+        const uint64_t diplotypeMask = diplotypeMasks_[diplotypeIndex];
+        int score = 0;
+        for (const auto& maskAndCount : observedMasksAndCounts)
+        {
+            score += (maskAndCount.first & diplotypeMask) ? maskAndCount.second : -maskAndCount.second;
+        }
+        scoredDiplotypes.emplace_back(diplotypes_[diplotypeIndex], score);
+    }
+
+    std::stable_sort(
+        scoredDiplotypes.begin(), scoredDiplotypes.end(),
+        [](const ScoredDiplotype& gt1, const ScoredDiplotype& gt2) { return gt1.second > gt2.second; });
+
+    return scoredDiplotypes;
+}
+
+vector<Diplotype> getTopDiplotypes(const ScoredDiplotypes& scoredDiplotypes, int maxDiplotypes)
+{
+    // K-mer counts often tie (e.g. for alleles longer than k), so a cut between equal scores would be arbitrary
+    vector<Diplotype> diplotypes;
+    if (maxDiplotypes <= 0)
+    {
+        return diplotypes;
+    }
+    for (const auto& diplotypeAndScore : scoredDiplotypes)
+    {
+        if (static_cast<int>(diplotypes.size()) >= maxDiplotypes
+            && diplotypeAndScore.second != scoredDiplotypes[maxDiplotypes - 1].second)
+        {
+            break;
+        }
+        diplotypes.push_back(diplotypeAndScore.first);
+    }
+    return diplotypes;
+}
@@ -0,0 +1,68 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "app/Aligns.hh"
+#include "app/GenotypePaths.hh"
+#include "app/Phasing.hh"
+
+/// Ranks candidate diplotypes from k-mer counts without projecting reads onto haplotypes
+///
+/// Only k-mers that distinguish candidate haplotypes (i.e. are absent from at least one of them) are counted. Each
+/// occurrence of such a k-mer in a fragment adds a point to diplotypes containing it and removes a point from the
+/// other diplotypes. The ranking is a fast approximation of scoreDiplotypes suitable for triage and for discarding
+/// hopeless candidates before full scoring.
+class KmerPreview
+{
+public:
+    static const int kDefaultKmerLength = 31;
+    // Haplotype sets of k-mers are stored as 64-bit masks
+    static const int kMaxHaplotypes = 64;
+
+    /// \return Number of distinct haplotypes of the diplotypes
+    static int countHaplotypes(const std::vector<Diplotype>& diplotypes);
+
+    explicit KmerPreview(std::vector<Diplotype> diplotypes, int kmerLength = kDefaultKmerLength);
+
+    /// \return Diplotypes sorted by decreasing preview score
+    ScoredDiplotypes rank(const FragById& fragById) const;
+
+    size_t numInformativeKmers() const { return numKmers_; }
+
+private:
+    size_t findSlot(uint64_t kmer) const;
+    void insert(uint64_t kmer, uint64_t haplotypeMask);
+
+    std::vector<Diplotype> diplotypes_;
+    std::vector<uint64_t> diplotypeMasks_;
+    int kmerLength_;
+
+    // Open-addressing hash table of informative k-mers and the haplotypes containing them
+    std::vector<uint64_t> kmers_;
+    std::vector<uint64_t> haplotypeMasks_;
+    size_t numKmers_;
+};
+
+/// Keeps the maxDiplotypes highest-ranking diplotypes and any diplotypes tied with the last of them
+std::vector<Diplotype> getTopDiplotypes(const ScoredDiplotypes& scoredDiplotypes, int maxDiplotypes);
@@ -20,6 +20,7 @@
 
 #include "app/LanePlot.hh"
 
+#include <algorithm>
 #include <stdexcept>
 #include <tuple>
 
@@ -28,6 +29,8 @@
 #include "graphalign/GraphAlignmentOperations.hh"
 #include "graphalign/LinearAlignmentOperations.hh"
 
+#include "app/FragChunks.hh"
+
 using boost::optional;
 using graphtools::getQuerySequencesForEachNode;
 using graphtools::getSequencesForEachOperation;
@@ -41,7 +44,7 @@ using std::string;
 using std::unordered_map;
 using std::vector;
 
-static bool overlaps(const Segment& first, const Segment& second)
+template <typename SegmentType> static bool overlaps(const SegmentType& first, const SegmentType& second)
 {
     const int64_t leftBound = first.start > second.start ? first.start : second.start;
     const int64_t rightBound = first.end < second.end ? first.end : second.end;
@@ -85,23 +88,38 @@ static bool singlePath(const vector<FragPathAlign>& fragPathAligns)
 }
 
 list<ReadAlignOrigin> extractReadInfo(
-    const FragAssignment& fragAssignment, const FragById& fragById, const FragPathAlignsById& fragPathAlignsById)
+    const FragAssignment& fragAssignment, const FragById& fragById, const FragPathAlignsById& fragPathAlignsById,
+    int numThreads)
 {
-    list<ReadAlignOrigin> readInfo;
-    for (int fragIndex = 0; fragIndex != fragAssignment.fragIds.size(); ++fragIndex)
+    auto extractChunk = [&fragAssignment, &fragById, &fragPathAlignsById](size_t begin, size_t end)
     {
-        const auto& fragId = fragAssignment.fragIds[fragIndex];
-        const auto& frag = fragById.at(fragId);
-        const int alignIndex = fragAssignment.alignIndexByFrag[fragIndex];
-        const FragPathAlign& fragAlign = fragPathAlignsById.at(fragId)[alignIndex];
+        list<ReadAlignOrigin> readInfo;
+        for (size_t fragIndex = begin; fragIndex != end; ++fragIndex)
+        {
+            const auto& fragId = fragAssignment.fragIds[fragIndex];
+            const auto& frag = fragById.at(fragId);
+            const int alignIndex = fragAssignment.alignIndexByFrag[fragIndex];
+            const FragPathAlign& fragAlign = fragPathAlignsById.at(fragId)[alignIndex];
 
-        const bool consistentWithMultiplePaths = !singlePath(fragPathAlignsById.at(fragId));
+            const bool consistentWithMultiplePaths = !singlePath(fragPathAlignsById.at(fragId));
 
-        GenomicRegion readRegion(fragAlign.readAlign.pathIndex, fragAlign.readAlign.begin, fragAlign.readAlign.end);
-        readInfo.emplace_back(frag.read.bases, *fragAlign.readAlign.align, readRegion, consistentWithMultiplePaths);
+            GenomicRegion readRegion(
+                fragAlign.readAlign.pathIndex, fragAlign.readAlign.begin, fragAlign.readAlign.end);
+            readInfo.emplace_back(frag.read.bases, *fragAlign.readAlign.align, readRegion, consistentWithMultiplePaths);
 
-        GenomicRegion mateRegion(fragAlign.mateAlign.pathIndex, fragAlign.mateAlign.begin, fragAlign.mateAlign.end);
-        readInfo.emplace_back(frag.mate.bases, *fragAlign.mateAlign.align, mateRegion, consistentWithMultiplePaths);
+            GenomicRegion mateRegion(
+                fragAlign.mateAlign.pathIndex, fragAlign.mateAlign.begin, fragAlign.mateAlign.end);
+            readInfo.emplace_back(frag.mate.bases, *fragAlign.mateAlign.align, mateRegion, consistentWithMultiplePaths);
+        }
+        return readInfo;
+    };
+
+    auto readInfoByChunk
+        = processFragChunks<list<ReadAlignOrigin>>(fragAssignment.fragIds.size(), numThreads, extractChunk);
+    list<ReadAlignOrigin> readInfo;
+    for (auto& chunkReadInfo : readInfoByChunk)
+    {
+        readInfo.splice(readInfo.end(), chunkReadInfo);
     }
     return readInfo;
 }
@@ -246,119 +264,158 @@ getFeature(const ColorPicker& colorPicker, NodeId node, const Operation& op, con
     return feature;
 }
 
-// TODO: Rename segment to displaySegment?
-static list<Segment> getSegments(int hapIndex, const list<ReadAlignOrigin>& infoByRead)
+static int getSegmentStart(const ReadAlignOrigin& readInfo)
 {
-    list<Segment> segments;
-    ColorPicker colorPicker(*infoByRead.front().align.path().graphRawPtr());
-
-    for (const auto& readInfo : infoByRead)
+    int start = readInfo.origin.start();
+    const auto& firstOperation = readInfo.align.alignments().front().front();
+    if (firstOperation.type() == OperationType::kSoftclip)
     {
-        const auto& origin = readInfo.origin;
-        if (origin.contigIndex() != hapIndex)
-        {
-            continue;
-        }
+        start -= firstOperation.queryLength();
+    }
+    return start;
+}
 
-        const auto& align = readInfo.align;
+// TODO: Rename segment to displaySegment?
+static Segment getSegment(const ColorPicker& colorPicker, const ReadAlignOrigin& readInfo)
+{
+    const auto& align = readInfo.align;
+    const int segmentStart = getSegmentStart(readInfo);
 
-        const int segmentStart = [&]
+    vector<Feature> features;
+    const int numNodes = align.path().numNodes();
+    auto readPiecesByNode = getQuerySequencesForEachNode(align, readInfo.read);
+    auto nodeReadPieceIt = readPiecesByNode.begin();
+
+    for (int nodeIndex = 0; nodeIndex != numNodes; ++nodeIndex)
+    {
+        const auto node = align.path().getNodeIdByIndex(nodeIndex);
+        const auto& nodeSeq = align.path().graphRawPtr()->nodeSeq(node);
+        const auto& nodeAlign = align.alignments()[nodeIndex];
+        const auto& nodeReadPiece = *nodeReadPieceIt;
+        auto opReadPieces = getSequencesForEachOperation(nodeAlign, nodeSeq, nodeReadPiece);
+        auto opReadPieceIt = opReadPieces.begin();
+
+        for (const auto& operation : nodeAlign.operations())
         {
-            int start = origin.start();
-            const auto& firstOperation = align.alignments().front().front();
-            if (firstOperation.type() == OperationType::kSoftclip)
+            const auto& opRefSeq = opReadPieceIt->first;
+            const auto& opQuerySeq = opReadPieceIt->second;
+            auto feature = getFeature(colorPicker, node, operation, opRefSeq, opQuerySeq);
+            if (feature)
             {
-                start -= firstOperation.queryLength();
+                features.push_back(*feature);
             }
-            return start;
-        }();
 
-        vector<Feature> features;
-        const int numNodes = align.path().numNodes();
-        auto readPiecesByNode = getQuerySequencesForEachNode(align, readInfo.read);
-        auto nodeReadPieceIt = readPiecesByNode.begin();
+            ++opReadPieceIt;
+        }
+        ++nodeReadPieceIt;
+    }
 
-        for (int nodeIndex = 0; nodeIndex != numNodes; ++nodeIndex)
+    const double opacity = readInfo.consistentWithMultipleHaplotypes ? 0.7 : 1.0;
+    return Segment(segmentStart, features, opacity);
+}
+
+// Lengths of the features that getFeature generates for each operation of the alignment
+static vector<int> getFeatureLengths(const GraphAlign& align)
+{
+    vector<int> featureLengths;
+    for (const auto& nodeAlign : align.alignments())
+    {
+        for (const auto& operation : nodeAlign.operations())
         {
-            const auto node = align.path().getNodeIdByIndex(nodeIndex);
-            const auto& nodeSeq = align.path().graphRawPtr()->nodeSeq(node);
-            const auto& nodeAlign = align.alignments()[nodeIndex];
-            const auto& nodeReadPiece = *nodeReadPieceIt;
-            auto opReadPieces = getSequencesForEachOperation(nodeAlign, nodeSeq, nodeReadPiece);
-            auto opReadPieceIt = opReadPieces.begin();
-
-            for (const auto& operation : nodeAlign.operations())
+            switch (operation.type())
             {
-                const auto& opRefSeq = opReadPieceIt->first;
-                const auto& opQuerySeq = opReadPieceIt->second;
-                auto feature = getFeature(colorPicker, node, operation, opRefSeq, opQuerySeq);
-                if (feature)
-                {
-                    features.push_back(*feature);
-                }
-
-                ++opReadPieceIt;
+            case OperationType::kMatch:
+            case OperationType::kMismatch:
+            case OperationType::kDeletionFromRef:
+            case OperationType::kSoftclip:
+                featureLengths.push_back(operation.length());
+                break;
+            case OperationType::kInsertionToRef:
+                featureLengths.push_back(0);
+                break;
+            default:
+                break;
             }
-            ++nodeReadPieceIt;
         }
-
-        const double opacity = readInfo.consistentWithMultipleHaplotypes ? 0.7 : 1.0;
-        segments.emplace_back(segmentStart, features, opacity);
     }
-
-    return segments;
+    return featureLengths;
 }
 
-static list<Segment> trimSegments(const Path& hapPath, const list<Segment>& segments)
+static Segment trimSegment(const Path& hapPath, const Segment& segment)
 {
-    list<Segment> trimmedSegments;
     const int haplotypeLen = hapPath.length();
-    for (const auto& segment : segments)
+    vector<Feature> trimmedFeatures;
+    int segmentPos = segment.start;
+    auto featureIter = segment.features.begin();
+    while (segmentPos + featureIter->length <= 0)
+    {
+        segmentPos += featureIter->length;
+        ++featureIter;
+    }
+
+    if (segmentPos < 0)
     {
-        vector<Feature> trimmedFeatures;
-        int segmentPos = segment.start;
-        auto featureIter = segment.features.begin();
-        while (segmentPos + featureIter->length <= 0)
+        const int trimmedLen = featureIter->length + segmentPos;
+        trimmedFeatures.emplace_back(featureIter->type, trimmedLen, featureIter->fill, featureIter->stroke);
+        if (featureIter->label)
         {
-            segmentPos += featureIter->length;
-            ++featureIter;
+            trimmedFeatures.back().label = featureIter->label->substr(-segmentPos, trimmedLen);
         }
+        ++featureIter;
+    } // TODO: Address the case where a segment needs to be trimmed on both sides
 
-        if (segmentPos < 0)
+    while (featureIter != segment.features.end() && segmentPos < haplotypeLen)
+    {
+        if (segmentPos + featureIter->length > haplotypeLen)
         {
-            const int trimmedLen = featureIter->length + segmentPos;
+            const int trimmedLen = haplotypeLen - segmentPos;
             trimmedFeatures.emplace_back(featureIter->type, trimmedLen, featureIter->fill, featureIter->stroke);
             if (featureIter->label)
             {
-                trimmedFeatures.back().label = featureIter->label->substr(-segmentPos, trimmedLen);
+                trimmedFeatures.back().label = featureIter->label->substr(0, trimmedLen);
             }
-            ++featureIter;
-        } // TODO: Address the case where a segment needs to be trimmed on both sides
-
-        while (featureIter != segment.features.end() && segmentPos < haplotypeLen)
+        }
+        else
         {
-            if (segmentPos + featureIter->length > haplotypeLen)
-            {
-                const int trimmedLen = haplotypeLen - segmentPos;
-                trimmedFeatures.emplace_back(featureIter->type, trimmedLen, featureIter->fill, featureIter->stroke);
-                if (featureIter->label)
-                {
-                    trimmedFeatures.back().label = featureIter->label->substr(0, trimmedLen);
-                }
-            }
-            else
-            {
-                trimmedFeatures.push_back(*featureIter);
-            }
-
-            segmentPos += featureIter->length;
-            ++featureIter;
+            trimmedFeatures.push_back(*featureIter);
         }
 
-        const int trimmedSegmentStart = segment.start > 0 ? segment.start : 0;
-        trimmedSegments.emplace_back(trimmedSegmentStart, trimmedFeatures, segment.opacity);
+        segmentPos += featureIter->length;
+        ++featureIter;
+    }
+
+    const int trimmedSegmentStart = segment.start > 0 ? segment.start : 0;
+    return Segment(trimmedSegmentStart, trimmedFeatures, segment.opacity);
+}
+
+// Mirrors trimSegment on feature lengths alone to obtain the extent of the trimmed segment
+static std::pair<int, int> getTrimmedExtent(int haplotypeLen, int segmentStart, const vector<int>& featureLengths)
+{
+    int segmentPos = segmentStart;
+    size_t featureIndex = 0;
+    while (featureIndex != featureLengths.size() && segmentPos + featureLengths[featureIndex] <= 0)
+    {
+        segmentPos += featureLengths[featureIndex];
+        ++featureIndex;
+    }
+
+    int trimmedLength = 0;
+    if (segmentPos < 0)
+    {
+        trimmedLength += featureLengths[featureIndex] + segmentPos;
+        ++featureIndex;
+    }
+
+    while (featureIndex != featureLengths.size() && segmentPos < haplotypeLen)
+    {
+        const int featureLength = featureLengths[featureIndex];
+        trimmedLength += segmentPos + featureLength > haplotypeLen ? haplotypeLen - segmentPos : featureLength;
+        segmentPos += featureLength;
+        ++featureIndex;
     }
-    return trimmedSegments;
+
+    const int trimmedSegmentStart = segmentStart > 0 ? segmentStart : 0;
+    return std::make_pair(trimmedSegmentStart, trimmedSegmentStart + trimmedLength);
 }
 
 static void addLabelLane(const Path& path, LanePlot& lanePlot)
@@ -418,30 +475,56 @@ static void addHaplotypePathLane(const Path& hapPath, LanePlot& lanePlot)
     lanePlot.emplace_back(hapHeight, vector<Segment>({ pathSegment }));
 }
 
-static void addSegmentLanes(list<Segment>& hapSegments, LanePlot& lanePlot)
+// Position of a read in a lane plot; the features of the read are generated only once its lane is emitted
+struct SegmentSlot
+{
+    const ReadAlignOrigin* readInfo;
+    int start;
+    int end;
+};
+
+static list<SegmentSlot> getSegmentSlots(int hapIndex, const Path& hapPath, const list<ReadAlignOrigin>& infoByRead)
+{
+    list<SegmentSlot> slots;
+    for (const auto& readInfo : infoByRead)
+    {
+        if (readInfo.origin.contigIndex() != hapIndex)
+        {
+            continue;
+        }
+
+        const auto extent
+            = getTrimmedExtent(hapPath.length(), getSegmentStart(readInfo), getFeatureLengths(readInfo.align));
+        slots.push_back({ &readInfo, extent.first, extent.second });
+    }
+    return slots;
+}
+
+static vector<vector<SegmentSlot>> packSegmentSlots(list<SegmentSlot>& hapSlots)
 {
     using IntTuple = std::tuple<int, int>;
-    hapSegments.sort([](const Segment& lhs, const Segment& rhs)
-                     { return IntTuple(lhs.end, lhs.start) < IntTuple(rhs.end, rhs.start); });
+    hapSlots.sort([](const SegmentSlot& lhs, const SegmentSlot& rhs)
+                  { return IntTuple(lhs.end, lhs.start) < IntTuple(rhs.end, rhs.start); });
 
-    while (!hapSegments.empty())
+    vector<vector<SegmentSlot>> lanes;
+    while (!hapSlots.empty())
     {
-        vector<Segment> laneSegments;
-        auto iter = hapSegments.begin();
-        while (iter != hapSegments.end())
+        vector<SegmentSlot> laneSlots;
+        auto iter = hapSlots.begin();
+        while (iter != hapSlots.end())
         {
-            if (laneSegments.empty())
+            if (laneSlots.empty())
             {
-                laneSegments.push_back(*iter);
-                iter = hapSegments.erase(iter);
+                laneSlots.push_back(*iter);
+                iter = hapSlots.erase(iter);
             }
             else
             {
-                const Segment& lastSegment = laneSegments.back();
-                if (!overlaps(lastSegment, *iter))
+                const SegmentSlot& lastSlot = laneSlots.back();
+                if (!overlaps(lastSlot, *iter))
                 {
-                    laneSegments.push_back(*iter);
-                    iter = hapSegments.erase(iter);
+                    laneSlots.push_back(*iter);
+                    iter = hapSlots.erase(iter);
                 }
                 else
                 {
@@ -449,19 +532,9 @@ static void addSegmentLanes(list<Segment>& hapSegments, LanePlot& lanePlot)
                 }
             }
         }
-        const int readHeight = 10;
-        lanePlot.emplace_back(readHeight, std::move(laneSegments));
+        lanes.push_back(std::move(laneSlots));
     }
-}
-
-static LanePlot getLanePlot(const Path& path, list<Segment>& hapSegments)
-{
-    LanePlot lanePlot;
-    addLabelLane(path, lanePlot);
-    addHaplotypePathLane(path, lanePlot);
-    addSegmentLanes(hapSegments, lanePlot);
-
-    return lanePlot;
+    return lanes;
 }
 
 void removeFlankingReads(list<ReadAlignOrigin>& infoByRead)
@@ -487,24 +560,226 @@ void removeFlankingReads(list<ReadAlignOrigin>& infoByRead)
     }
 }
 
-vector<LanePlot> generateBlueprint(
+LanePlotExtent getExtent(const LanePlot& lanePlot)
+{
+    LanePlotExtent extent;
+    extent.width = 0;
+    for (const auto& lane : lanePlot)
+    {
+        extent.laneHeights.push_back(lane.height);
+        for (const auto& segment : lane.segments)
+        {
+            extent.width = std::max(extent.width, segment.end);
+        }
+    }
+    return extent;
+}
+
+void emitLanePlots(const vector<LanePlot>& lanePlots, LanePlotSink& sink)
+{
+    vector<LanePlotExtent> extents;
+    for (const auto& lanePlot : lanePlots)
+    {
+        extents.push_back(getExtent(lanePlot));
+    }
+
+    sink.begin(extents);
+    for (int lanePlotIndex = 0; lanePlotIndex != static_cast<int>(lanePlots.size()); ++lanePlotIndex)
+    {
+        for (const auto& lane : lanePlots[lanePlotIndex])
+        {
+            sink.addLane(lanePlotIndex, lane);
+        }
+    }
+    sink.end();
+}
+
+void generateBlueprint(
     vector<Path> paths, const FragById& fragById, const FragAssignment& fragAssignment,
-    const FragPathAlignsById& fragPathAlignsById)
+    const FragPathAlignsById& fragPathAlignsById, LanePlotSink& sink, int numThreads)
 {
-    auto infoByRead = extractReadInfo(fragAssignment, fragById, fragPathAlignsById);
+    auto infoByRead = extractReadInfo(fragAssignment, fragById, fragPathAlignsById, numThreads);
     removeFlankingReads(infoByRead);
     clipFlanks(paths, 50, infoByRead);
     if (infoByRead.empty())
     {
         throw std::runtime_error("There are no read alignments in the target region");
     }
-    vector<LanePlot> lanePlots;
+
+    // Lanes are laid out from segment extents so that the features of each read exist only while its lane is emitted
+    const int readHeight = 10;
+    vector<LanePlot> headerLanesByPath;
+    vector<vector<vector<SegmentSlot>>> slotLanesByPath;
+    vector<LanePlotExtent> extents;
+    for (int pathIndex = 0; pathIndex != paths.size(); ++pathIndex)
+    {
+        LanePlot headerLanes;
+        addLabelLane(paths[pathIndex], headerLanes);
+        addHaplotypePathLane(paths[pathIndex], headerLanes);
+
+        auto slots = getSegmentSlots(pathIndex, paths[pathIndex], infoByRead);
+        auto slotLanes = packSegmentSlots(slots);
+
+        LanePlotExtent extent = getExtent(headerLanes);
+        for (const auto& slotLane : slotLanes)
+        {
+            extent.laneHeights.push_back(readHeight);
+            for (const auto& slot : slotLane)
+            {
+                extent.width = std::max(extent.width, slot.end);
+            }
+        }
+
+        headerLanesByPath.push_back(std::move(headerLanes));
+        slotLanesByPath.push_back(std::move(slotLanes));
+        extents.push_back(std::move(extent));
+    }
+
+    sink.begin(extents);
+    ColorPicker colorPicker(*infoByRead.front().align.path().graphRawPtr());
     for (int pathIndex = 0; pathIndex != paths.size(); ++pathIndex)
     {
-        auto segments = getSegments(pathIndex, infoByRead);
-        segments = trimSegments(paths[pathIndex], segments);
-        auto lanePlot = getLanePlot(paths[pathIndex], segments);
-        lanePlots.push_back(lanePlot);
+        for (auto& lane : headerLanesByPath[pathIndex])
+        {
+            sink.addLane(pathIndex, std::move(lane));
+        }
+        headerLanesByPath[pathIndex].clear();
+
+        // Segments are generated for blocks of lanes at a time to keep the memory bounded with many threads
+        const auto& slotLanes = slotLanesByPath[pathIndex];
+        const size_t blockSize = kMinFragChunkSize * std::max(numThreads, 1);
+        for (size_t blockStart = 0; blockStart < slotLanes.size(); blockStart += blockSize)
+        {
+            auto getLanes = [&](size_t begin, size_t end)
+            {
+                vector<Lane> lanes;
+                for (size_t laneIndex = blockStart + begin; laneIndex != blockStart + end; ++laneIndex)
+                {
+                    vector<Segment> laneSegments;
+                    for (const auto& slot : slotLanes[laneIndex])
+                    {
+                        laneSegments.push_back(trimSegment(paths[pathIndex], getSegment(colorPicker, *slot.readInfo)));
+                    }
+                    lanes.emplace_back(readHeight, std::move(laneSegments));
+                }
+                return lanes;
+            };
+
+            const size_t numBlockLanes = std::min(blockSize, slotLanes.size() - blockStart);
+            for (auto& chunkLanes : processFragChunks<vector<Lane>>(numBlockLanes, numThreads, getLanes))
+            {
+                for (auto& lane : chunkLanes)
+                {
+                    sink.addLane(pathIndex, std::move(lane));
+                }
+            }
+        }
+    }
+    sink.end();
+}
+
+namespace
+{
+class LanePlotCollector : public LanePlotSink
+{
+public:
+    void begin(const vector<LanePlotExtent>& extents) override { lanePlots.resize(extents.size()); }
+    void addLane(int lanePlotIndex, Lane lane) override { lanePlots[lanePlotIndex].push_back(std::move(lane)); }
+    void end() override {}
+
+    vector<LanePlot> lanePlots;
+};
+}
+
+vector<LanePlot> generateBlueprint(
+    vector<Path> paths, const FragById& fragById, const FragAssignment& fragAssignment,
+    const FragPathAlignsById& fragPathAlignsById, int numThreads)
+{
+    LanePlotCollector collector;
+    generateBlueprint(std::move(paths), fragById, fragAssignment, fragPathAlignsById, collector, numThreads);
+    return std::move(collector.lanePlots);
+}
+
+// Mean depth of reads in consecutive bins of the haplotype, drawn as a strip whose opacity follows the depth
+static Lane getCoverageLane(const vector<double>& depthByBin, int binLength, int haplotypeLen, double maxDepth)
+{
+    vector<Segment> segments;
+    for (int bin = 0; bin != static_cast<int>(depthByBin.size()); ++bin)
+    {
+        if (depthByBin[bin] == 0)
+        {
+            continue;
+        }
+        const int start = bin * binLength;
+        const int length = std::min(binLength, haplotypeLen - start);
+        vector<Feature> features = { Feature(FeatureType::kRect, length, "#8da0cb", "none") };
+        segments.emplace_back(start, features, depthByBin[bin] / maxDepth);
+    }
+
+    const int coverageHeight = 10;
+    return Lane(coverageHeight, segments);
+}
+
+vector<LanePlot> generateSummaryBlueprint(
+    vector<Path> paths, const FragById& fragById, const FragAssignment& fragAssignment,
+    const FragPathAlignsById& fragPathAlignsById, bool includeReadLanes, int numThreads)
+{
+    vector<LanePlot> lanePlots;
+    if (includeReadLanes)
+    {
+        lanePlots = generateBlueprint(paths, fragById, fragAssignment, fragPathAlignsById, numThreads);
+    }
+
+    auto infoByRead = extractReadInfo(fragAssignment, fragById, fragPathAlignsById, numThreads);
+    removeFlankingReads(infoByRead);
+    clipFlanks(paths, 50, infoByRead);
+    if (infoByRead.empty())
+    {
+        throw std::runtime_error("There are no read alignments in the target region");
+    }
+
+    const int binLength = 5;
+    vector<vector<double>> depthByBinByPath;
+    for (const auto& path : paths)
+    {
+        depthByBinByPath.emplace_back((path.length() + binLength - 1) / binLength, 0.0);
+    }
+    for (const auto& readInfo : infoByRead)
+    {
+        const int pathIndex = readInfo.origin.contigIndex();
+        auto& depthByBin = depthByBinByPath[pathIndex];
+        const int start = std::max<int>(readInfo.origin.start(), 0);
+        const int end = std::min<int>(readInfo.origin.end(), paths[pathIndex].length());
+        for (int position = start; position < end; ++position)
+        {
+            depthByBin[position / binLength] += 1.0 / binLength;
+        }
+    }
+
+    // Haplotypes of a sample share the depth scale so that their coverage can be compared
+    double maxDepth = 0;
+    for (const auto& depthByBin : depthByBinByPath)
+    {
+        for (double depth : depthByBin)
+        {
+            maxDepth = std::max(maxDepth, depth);
+        }
+    }
+
+    lanePlots.resize(paths.size());
+    for (int pathIndex = 0; pathIndex != static_cast<int>(paths.size()); ++pathIndex)
+    {
+        auto& lanePlot = lanePlots[pathIndex];
+        if (!includeReadLanes)
+        {
+            addLabelLane(paths[pathIndex], lanePlot);
+            addHaplotypePathLane(paths[pathIndex], lanePlot);
+        }
+
+        // Coverage is drawn right under the label and haplotype lanes
+        auto coverageLane
+            = getCoverageLane(depthByBinByPath[pathIndex], binLength, paths[pathIndex].length(), maxDepth);
+        lanePlot.insert(lanePlot.begin() + 2, std::move(coverageLane));
     }
 
     return lanePlots;
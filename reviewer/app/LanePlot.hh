@@ -94,6 +94,41 @@ struct Lane
 
 using LanePlot = std::vector<Lane>;
 
+// Layout of a lane plot that is known before its lanes are generated
+struct LanePlotExtent
+{
+    int width; // In bases
+    std::vector<int> laneHeights;
+};
+
+// Receives lane plots one lane at a time
+class LanePlotSink
+{
+public:
+    virtual ~LanePlotSink() = default;
+
+    // Called once before any lanes are added
+    virtual void begin(const std::vector<LanePlotExtent>& extents) = 0;
+    // Lanes arrive in the order of lane plots and, within each lane plot, in the order of drawing
+    virtual void addLane(int lanePlotIndex, Lane lane) = 0;
+    virtual void end() = 0;
+};
+
+LanePlotExtent getExtent(const LanePlot& lanePlot);
+void emitLanePlots(const std::vector<LanePlot>& lanePlots, LanePlotSink& sink);
+
+/// \param numThreads: Number of threads extracting reads and generating segments for consecutive chunks of them
+void generateBlueprint(
+    std::vector<graphtools::Path> paths, const FragById& fragById, const FragAssignment& fragAssignment,
+    const FragPathAlignsById& fragPathAlignsById, LanePlotSink& sink, int numThreads = 1);
+
 std::vector<LanePlot> generateBlueprint(
     std::vector<graphtools::Path> paths, const FragById& fragById, const FragAssignment& fragAssignment,
-    const FragPathAlignsById& fragPathAlignsById);
+    const FragPathAlignsById& fragPathAlignsById, int numThreads = 1);
+
+/// Generates a compact blueprint where the reads of each haplotype are summarized by their binned depth
+///
+/// \param includeReadLanes: Also draw the read lanes of the full blueprint below the depth summary
+std::vector<LanePlot> generateSummaryBlueprint(
+    std::vector<graphtools::Path> paths, const FragById& fragById, const FragAssignment& fragAssignment,
+    const FragPathAlignsById& fragPathAlignsById, bool includeReadLanes, int numThreads = 1);
@@ -253,9 +253,14 @@ decodeLocusSpecification(const LocusDescriptionFromUser& userDescription, const
         {
             targetReadExtractionRegions.push_back(region.extend(flankLength));
         }
+        // Without target regions, reads are extracted around the first variant and as far as the flanks of the
+        // graph reach from it, even if the locus has further variants
         if (targetReadExtractionRegions.empty())
         {
-            targetReadExtractionRegions.push_back(referenceRegionForEntireLocus.extend(flankLength));
+            const GenomicRegion& firstRegion = userDescription.referenceRegions.front();
+            const int64_t start = std::max<int64_t>(0, firstRegion.start() - locusGraph.nodeSeq(0).length());
+            const int64_t end = firstRegion.end() + locusGraph.nodeSeq(locusGraph.numNodes() - 1).length();
+            targetReadExtractionRegions.emplace_back(firstRegion.contigIndex(), start, end);
         }
 
         const auto& contigName = reference.contigInfo().getContigName(referenceRegionForEntireLocus.contigIndex());
@@ -263,7 +268,8 @@ decodeLocusSpecification(const LocusDescriptionFromUser& userDescription, const
         NodeToRegionAssociation referenceRegionsOfGraphNodes
             = associateNodesWithReferenceRegions(blueprint, locusGraph, completeReferenceRegions);
 
-        LocusSpecification locusSpec(userDescription.locusId, locusGraph);
+        LocusSpecification locusSpec(
+            userDescription.locusId, targetReadExtractionRegions, userDescription.offtargetRegions, locusGraph);
 
         int variantIndex = 0;
         for (const auto& feature : blueprint)
@@ -0,0 +1,382 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/MateBuffer.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+
+#include <boost/filesystem.hpp>
+#include <boost/optional.hpp>
+
+#include "graphalign/GraphAlignmentOperations.hh"
+
+using graphtools::decodeGraphAlignment;
+using std::string;
+using std::vector;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+
+struct SpilledRead
+{
+    string fragId;
+    uint64_t arrival;
+    int32_t startPosition;
+    string cigar;
+    string bases;
+    string quals;
+};
+
+bool operator<(const SpilledRead& lhs, const SpilledRead& rhs)
+{
+    return std::tie(lhs.fragId, lhs.arrival) < std::tie(rhs.fragId, rhs.arrival);
+}
+
+template <typename T> void writeValue(std::ostream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T> void readValue(std::istream& in, T& value)
+{
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+void writeString(std::ostream& out, const string& value)
+{
+    writeValue(out, static_cast<uint32_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+void readString(std::istream& in, string& value)
+{
+    uint32_t size = 0;
+    readValue(in, size);
+    value.resize(size);
+    in.read(&value[0], size);
+}
+
+void writeRead(std::ostream& out, const SpilledRead& read)
+{
+    writeString(out, read.fragId);
+    writeValue(out, read.arrival);
+    writeValue(out, read.startPosition);
+    writeString(out, read.cigar);
+    writeString(out, read.bases);
+    writeString(out, read.quals);
+}
+
+// Sequential reader of one sorted run of the run file
+class RunReader
+{
+public:
+    RunReader(const string& runPath, int64_t start, int64_t end)
+        : stream_(runPath, std::ios::binary)
+        , end_(end)
+    {
+        if (!stream_.is_open())
+        {
+            throw std::runtime_error("Unable to open " + runPath);
+        }
+        stream_.seekg(start);
+    }
+
+    const SpilledRead& current() const { return current_; }
+
+    bool advance()
+    {
+        if (stream_.tellg() >= end_)
+        {
+            return false;
+        }
+
+        readString(stream_, current_.fragId);
+        readValue(stream_, current_.arrival);
+        readValue(stream_, current_.startPosition);
+        readString(stream_, current_.cigar);
+        readString(stream_, current_.bases);
+        readString(stream_, current_.quals);
+        if (!stream_)
+        {
+            throw std::runtime_error("Truncated run of spilled reads");
+        }
+        return true;
+    }
+
+private:
+    std::ifstream stream_;
+    int64_t end_;
+    SpilledRead current_;
+};
+
+}
+
+// Runs merged at once; each run being merged keeps its own stream open, so this bounds the number of open files
+static const size_t kMaxMergeFanIn = 64;
+
+static string makeRunPath()
+{
+    return (fs::temp_directory_path() / fs::unique_path("reviewer-mates-%%%%-%%%%-%%%%.run")).string();
+}
+
+// Merges runs [first, last) of the run file, passing reads to consume in order of fragment id and arrival
+template <typename Consume>
+static void mergeRuns(
+    const string& runPath, const vector<std::pair<int64_t, int64_t>>& runs, size_t first, size_t last,
+    Consume consume)
+{
+    vector<std::unique_ptr<RunReader>> readers;
+    for (size_t runIndex = first; runIndex != last; ++runIndex)
+    {
+        std::unique_ptr<RunReader> reader(new RunReader(runPath, runs[runIndex].first, runs[runIndex].second));
+        if (reader->advance())
+        {
+            readers.push_back(std::move(reader));
+        }
+    }
+
+    auto isAfter = [&readers](int lhs, int rhs) { return readers[rhs]->current() < readers[lhs]->current(); };
+    std::priority_queue<int, vector<int>, decltype(isAfter)> heads(isAfter);
+    for (int index = 0; index != static_cast<int>(readers.size()); ++index)
+    {
+        heads.push(index);
+    }
+
+    while (!heads.empty())
+    {
+        const int index = heads.top();
+        heads.pop();
+        SpilledRead spilledRead = readers[index]->current();
+        if (readers[index]->advance())
+        {
+            heads.push(index);
+        }
+        consume(std::move(spilledRead));
+    }
+}
+
+// Approximate memory footprint of a waiting read including its alignment and index entries
+static size_t estimateSize(const string& fragId, const Read& read)
+{
+    const size_t kBytesPerNode = 96;
+    const size_t kOverhead = 256;
+    return 2 * fragId.size() + read.bases.size() + read.quals.size() + read.align.size() * kBytesPerNode + kOverhead;
+}
+
+MateBuffer::MateBuffer(const graphtools::Graph* graphPtr, size_t memoryCap)
+    : graphPtr_(graphPtr)
+    , memoryCap_(memoryCap)
+{
+}
+
+MateBuffer::~MateBuffer()
+{
+    if (!runPath_.empty())
+    {
+        boost::system::error_code error;
+        fs::remove(runPath_, error);
+    }
+}
+
+void MateBuffer::add(const string& fragId, Read read, FragById& fragById)
+{
+    auto pendingIt = pendingReads_.find(fragId);
+    if (pendingIt != pendingReads_.end())
+    {
+        memorySize_ -= estimateSize(fragId, pendingIt->second.read);
+        pendingIdsByArrival_.erase(pendingIt->second.arrival);
+        if (!fragById.emplace(fragId, Frag(std::move(read), std::move(pendingIt->second.read))).second)
+        {
+            numUnpaired_ += 2;
+        }
+        pendingReads_.erase(pendingIt);
+        return;
+    }
+
+    // A fragment that is already paired keeps its first two reads; further reads are counted as unpaired
+    if (fragById.count(fragId))
+    {
+        ++numUnpaired_;
+        return;
+    }
+
+    const uint64_t arrival = numArrivals_++;
+    memorySize_ += estimateSize(fragId, read);
+    pendingReads_.emplace(fragId, PendingRead(std::move(read), arrival));
+    pendingIdsByArrival_.emplace(arrival, fragId);
+
+    if (memorySize_ > memoryCap_)
+    {
+        spill(memoryCap_ / 2);
+    }
+}
+
+void MateBuffer::spill(size_t targetSize)
+{
+    vector<SpilledRead> run;
+    while (memorySize_ > targetSize && !pendingIdsByArrival_.empty())
+    {
+        const string fragId = pendingIdsByArrival_.begin()->second;
+        pendingIdsByArrival_.erase(pendingIdsByArrival_.begin());
+
+        auto pendingIt = pendingReads_.find(fragId);
+        const PendingRead& pending = pendingIt->second;
+        memorySize_ -= estimateSize(fragId, pending.read);
+        run.push_back({ fragId, pending.arrival, pending.read.align.path().startPosition(),
+                        pending.read.align.generateCigar(), pending.read.bases, pending.read.quals });
+        pendingReads_.erase(pendingIt);
+    }
+
+    if (run.empty())
+    {
+        return;
+    }
+    std::sort(run.begin(), run.end());
+
+    if (runPath_.empty())
+    {
+        runPath_ = makeRunPath();
+    }
+    std::ofstream runFile(runPath_, std::ios::binary | std::ios::app);
+    if (!runFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + runPath_);
+    }
+
+    runFile.seekp(0, std::ios::end);
+    const int64_t start = runFile.tellp();
+    for (const auto& read : run)
+    {
+        writeRead(runFile, read);
+    }
+    const int64_t end = runFile.tellp();
+    if (!runFile)
+    {
+        throw std::runtime_error("Failed to write spilled reads to " + runPath_);
+    }
+
+    runs_.emplace_back(start, end);
+    numSpilledReads_ += static_cast<int>(run.size());
+    ++numSpilledRuns_;
+}
+
+int MateBuffer::finish(FragById& fragById)
+{
+    if (runs_.empty())
+    {
+        const int numUnpaired = numUnpaired_ + static_cast<int>(pendingReads_.size());
+        numUnpaired_ = 0;
+        pendingReads_.clear();
+        pendingIdsByArrival_.clear();
+        memorySize_ = 0;
+        return numUnpaired;
+    }
+
+    // Reads still in memory become the last run so that all reads are merged in fixed memory
+    spill(0);
+
+    // Runs are merged in passes into fewer, longer runs until all of them can be open at once
+    while (runs_.size() > kMaxMergeFanIn)
+    {
+        mergePass();
+    }
+
+    // Reads of each fragment come out of the merge consecutively in order of arrival
+    int numUnpaired = numUnpaired_;
+    numUnpaired_ = 0;
+    boost::optional<SpilledRead> waitingRead;
+    mergeRuns(
+        runPath_, runs_, 0, runs_.size(),
+        [this, &fragById, &numUnpaired, &waitingRead](SpilledRead spilledRead)
+        {
+            if (waitingRead && waitingRead->fragId == spilledRead.fragId)
+            {
+                Read mate(
+                    std::move(waitingRead->bases), std::move(waitingRead->quals),
+                    decodeGraphAlignment(waitingRead->startPosition, waitingRead->cigar, graphPtr_));
+                Read read(
+                    std::move(spilledRead.bases), std::move(spilledRead.quals),
+                    decodeGraphAlignment(spilledRead.startPosition, spilledRead.cigar, graphPtr_));
+                if (!fragById.emplace(spilledRead.fragId, Frag(std::move(read), std::move(mate))).second)
+                {
+                    numUnpaired += 2;
+                }
+                waitingRead = boost::none;
+            }
+            else
+            {
+                numUnpaired += waitingRead ? 1 : 0;
+                waitingRead = std::move(spilledRead);
+            }
+        });
+    numUnpaired += waitingRead ? 1 : 0;
+
+    runs_.clear();
+    boost::system::error_code error;
+    fs::remove(runPath_, error);
+    runPath_.clear();
+
+    return numUnpaired;
+}
+
+void MateBuffer::mergePass()
+{
+    const string mergedPath = makeRunPath();
+    vector<std::pair<int64_t, int64_t>> mergedRuns;
+    try
+    {
+        std::ofstream mergedFile(mergedPath, std::ios::binary);
+        if (!mergedFile.is_open())
+        {
+            throw std::runtime_error("Unable to open " + mergedPath);
+        }
+
+        for (size_t first = 0; first < runs_.size(); first += kMaxMergeFanIn)
+        {
+            const size_t last = std::min(first + kMaxMergeFanIn, runs_.size());
+            const int64_t start = mergedFile.tellp();
+            mergeRuns(
+                runPath_, runs_, first, last, [&mergedFile](SpilledRead read) { writeRead(mergedFile, read); });
+            mergedRuns.emplace_back(start, mergedFile.tellp());
+        }
+        if (!mergedFile)
+        {
+            throw std::runtime_error("Failed to write spilled reads to " + mergedPath);
+        }
+    }
+    catch (const std::exception&)
+    {
+        boost::system::error_code error;
+        fs::remove(mergedPath, error);
+        throw;
+    }
+
+    boost::system::error_code error;
+    fs::remove(runPath_, error);
+    runPath_ = mergedPath;
+    runs_.swap(mergedRuns);
+}
@@ -0,0 +1,93 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "graphcore/Graph.hh"
+
+#include "core/Aligns.hh"
+
+/// Pairs reads of the same fragment in bounded memory
+///
+/// Reads wait in memory until their mates arrive. Once the estimated size of the waiting reads exceeds the memory
+/// cap, the oldest of them are written to a temporary run file as a run sorted by fragment id. The runs and the reads
+/// still in memory are merged when all reads have been added, pairing the reads whose mates were spilled. If there are
+/// too many runs to open at once, they are first merged in passes into fewer, longer runs.
+class MateBuffer
+{
+public:
+    /// \param graphPtr: Graph that spilled alignments are decoded against
+    /// \param memoryCap: Maximum estimated size in bytes of the reads kept in memory
+    MateBuffer(const graphtools::Graph* graphPtr, size_t memoryCap);
+    ~MateBuffer();
+
+    MateBuffer(const MateBuffer&) = delete;
+    MateBuffer& operator=(const MateBuffer&) = delete;
+
+    /// Adds a read, storing its fragment in fragById if the mate is in memory
+    void add(const std::string& fragId, Read read, FragById& fragById);
+
+    /// Pairs the remaining reads, storing their fragments in fragById
+    ///
+    /// \return Number of reads left without a mate, including extra reads of fragments that were already paired
+    int finish(FragById& fragById);
+
+    int numSpilledReads() const { return numSpilledReads_; }
+    int numSpilledRuns() const { return numSpilledRuns_; }
+
+private:
+    struct PendingRead
+    {
+        PendingRead(Read read, uint64_t arrival)
+            : read(std::move(read))
+            , arrival(arrival)
+        {
+        }
+
+        Read read;
+        uint64_t arrival;
+    };
+
+    void spill(size_t targetSize);
+    void mergePass();
+
+    const graphtools::Graph* graphPtr_;
+    size_t memoryCap_;
+    size_t memorySize_ = 0;
+    uint64_t numArrivals_ = 0;
+    int numSpilledReads_ = 0;
+    int numSpilledRuns_ = 0;
+    int numUnpaired_ = 0;
+
+    std::unordered_map<std::string, PendingRead> pendingReads_;
+    // Ids of pending reads by arrival, so that the oldest reads are spilled first
+    std::map<uint64_t, std::string> pendingIdsByArrival_;
+
+    std::string runPath_;
+    // Start and end offsets of runs in the run file
+    std::vector<std::pair<int64_t, int64_t>> runs_;
+};
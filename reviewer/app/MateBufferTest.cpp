@@ -0,0 +1,95 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/MateBuffer.hh"
+
+#include <string>
+
+#include <catch2/catch.hpp>
+
+#include "graphalign/GraphAlignmentOperations.hh"
+#include "graphcore/GraphBuilders.hh"
+
+using graphtools::decodeGraphAlignment;
+using graphtools::Graph;
+using std::string;
+
+// Adds first reads in a shuffled order and then their mates in order, so that mates end up split between memory,
+// early runs, and late runs; returns the number of unpaired reads
+static int addReads(const Graph& graph, MateBuffer& mateBuffer, FragById& fragById)
+{
+    // The first two reads of the duplicated fragment pair up; the other two are unpaired wherever they wait
+    for (int index = 0; index != 3; ++index)
+    {
+        mateBuffer.add("duplicate", Read("CCCC", "IIII", decodeGraphAlignment(0, "1[4M]", &graph)), fragById);
+    }
+
+    const int numFrags = 3000;
+    for (int index = 0; index != numFrags; ++index)
+    {
+        const string fragId = "frag" + std::to_string(index * 7919 % numFrags);
+        mateBuffer.add(fragId, Read("AAAA", "IIII", decodeGraphAlignment(0, "0[4M]", &graph)), fragById);
+    }
+    for (int index = 0; index != numFrags; ++index)
+    {
+        const string fragId = "frag" + std::to_string(index);
+        mateBuffer.add(fragId, Read("GGGG", "####", decodeGraphAlignment(0, "2[4M]", &graph)), fragById);
+    }
+
+    mateBuffer.add("lonely", Read("CCCC", "IIII", decodeGraphAlignment(0, "1[4M]", &graph)), fragById);
+    mateBuffer.add("duplicate", Read("CCCC", "IIII", decodeGraphAlignment(0, "1[4M]", &graph)), fragById);
+    return mateBuffer.finish(fragById);
+}
+
+TEST_CASE("Mates spilled to disk are paired like mates kept in memory", "[MateBuffer]")
+{
+    const Graph graph = graphtools::makeDeletionGraph("AAAA", "CCCC", "GGGG");
+
+    FragById expectedFragById;
+    MateBuffer inMemoryBuffer(&graph, 1000000000);
+    const int expectedNumUnpaired = addReads(graph, inMemoryBuffer, expectedFragById);
+    REQUIRE(inMemoryBuffer.numSpilledRuns() == 0);
+
+    FragById fragById;
+    MateBuffer spillingBuffer(&graph, 2000);
+    const int numUnpaired = addReads(graph, spillingBuffer, fragById);
+    // More runs than the merge fan-in of 64 force at least one merge pass
+    REQUIRE(spillingBuffer.numSpilledRuns() > 64);
+
+    // The lonely read and the third and fourth reads of the duplicated fragment
+    REQUIRE(expectedNumUnpaired == 3);
+    REQUIRE(numUnpaired == expectedNumUnpaired);
+
+    REQUIRE(fragById.size() == expectedFragById.size());
+    REQUIRE(expectedFragById.at("frag1").read.bases == "GGGG");
+    REQUIRE(expectedFragById.at("frag1").mate.bases == "AAAA");
+    for (const auto& fragIdAndFrag : expectedFragById)
+    {
+        const auto fragIt = fragById.find(fragIdAndFrag.first);
+        REQUIRE(fragIt != fragById.end());
+        const Frag& expectedFrag = fragIdAndFrag.second;
+        const Frag& frag = fragIt->second;
+        REQUIRE(frag.read.bases == expectedFrag.read.bases);
+        REQUIRE(frag.read.quals == expectedFrag.read.quals);
+        REQUIRE(frag.read.align == expectedFrag.read.align);
+        REQUIRE(frag.mate.bases == expectedFrag.mate.bases);
+        REQUIRE(frag.mate.align == expectedFrag.mate.align);
+    }
+}
@@ -20,12 +20,15 @@
 
 #include "app/Origin.hh"
 
+#include <cstdlib>
+
 using graphtools::NodeId;
 using graphtools::Path;
 using std::string;
 using std::vector;
 
-FragAssignment getBestFragAssignment(const vector<Path>& hapPaths, const FragPathAlignsById& fragPathAlignsById)
+template <typename RandomGenerator>
+static FragAssignment assignFragments(const FragPathAlignsById& fragPathAlignsById, RandomGenerator generate)
 {
     vector<string> fragIds;
     fragIds.reserve(fragPathAlignsById.size());
@@ -39,9 +42,20 @@ FragAssignment getBestFragAssignment(const vector<Path>& hapPaths, const FragPat
     {
         const auto& fragId = fragIds[fragIndex];
         int numOrigins = fragPathAlignsById.at(fragId).size();
-        int originIndex = rand() % numOrigins;
+        int originIndex = generate() % numOrigins;
         alignIndexByFrag[fragIndex] = originIndex;
     }
 
     return { fragIds, alignIndexByFrag };
 }
+
+FragAssignment getBestFragAssignment(const vector<Path>& hapPaths, const FragPathAlignsById& fragPathAlignsById)
+{
+    return assignFragments(fragPathAlignsById, []() { return rand(); });
+}
+
+FragAssignment
+getBestFragAssignment(const vector<Path>& hapPaths, const FragPathAlignsById& fragPathAlignsById, unsigned& seed)
+{
+    return assignFragments(fragPathAlignsById, [&seed]() { return rand_r(&seed); });
+}
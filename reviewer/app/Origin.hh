@@ -32,4 +32,8 @@
 
 FragAssignment getBestFragAssignment(const std::vector<graphtools::Path>& hapPaths, const FragPathAlignsById& fragPathAlignsById);
 
+/// Draws origins from the given seed instead of the global generator so that loci can be analyzed concurrently
+FragAssignment getBestFragAssignment(
+    const std::vector<graphtools::Path>& hapPaths, const FragPathAlignsById& fragPathAlignsById, unsigned& seed);
+
 // FragAssignment removeFlankingReads(const FragPathAlignsById& infoByRead, const FragAssignment& fragAssignment);
\ No newline at end of file
@@ -22,58 +22,21 @@
 
 #include <algorithm>
 
-#include "app/Projection.hh"
+#include "app/HaplotypeScoreMatrix.hh"
 
 using boost::optional;
 using std::pair;
 using std::string;
 using std::vector;
 
-int scorePath(int pathIndex, const PairPathAlignById& pairPathAlignById)
+ScoredDiplotypes scoreDiplotypes(const FragById& fragById, const vector<Diplotype>& diplotypes, int numThreads)
 {
-    int pathScore = 0;
-    for (const auto& idAndPairPathAlign : pairPathAlignById)
-    {
-        const auto& pairAlign = idAndPairPathAlign.second;
-        for (const auto& readAlign : pairAlign.readAligns)
-        {
-            if (readAlign.pathIndex == pathIndex)
-            {
-                pathScore += score(*readAlign.align);
-                break;
-            }
-        }
-
-        for (const auto& mateAlign : pairAlign.mateAligns)
-        {
-            if (mateAlign.pathIndex == pathIndex)
-            {
-                pathScore += score(*mateAlign.align);
-                break;
-            }
-        }
-    }
-
-    return pathScore;
-}
+    const HaplotypeScoreMatrix scoreMatrix(fragById, diplotypes, numThreads);
 
-ScoredDiplotypes scoreDiplotypes(const FragById& fragById, const vector<Diplotype>& diplotypes)
-{
     vector<ScoredDiplotype> scoredDiplotypes;
-
     for (const auto& diplotype : diplotypes)
     {
-        assert(diplotype.size() == 1 || diplotype.size() == 2);
-
-        auto pairPathAlignById = project(diplotype, fragById);
-
-        int genotypeScore = scorePath(0, pairPathAlignById);
-        if (diplotype.size() == 2)
-        {
-            genotypeScore += scorePath(1, pairPathAlignById);
-        }
-
-        scoredDiplotypes.emplace_back(diplotype, genotypeScore);
+        scoredDiplotypes.emplace_back(diplotype, scoreMatrix.score(diplotype));
     }
 
     std::sort(
@@ -84,4 +47,18 @@ ScoredDiplotypes scoreDiplotypes(const FragById& fragById, const vector<Diplotyp
     return scoredDiplotypes;
 }
 
+CompactScoredDiplotypes
+compactScoredDiplotypes(const DiplotypeCodec& codec, const ScoredDiplotypes& scoredDiplotypes, int maxDiplotypes)
+{
+    const size_t numKept = maxDiplotypes > 0 ? std::min<size_t>(maxDiplotypes, scoredDiplotypes.size())
+                                             : scoredDiplotypes.size();
+    CompactScoredDiplotypes compactDiplotypes;
+    compactDiplotypes.reserve(numKept);
+    for (size_t index = 0; index != numKept; ++index)
+    {
+        compactDiplotypes.emplace_back(codec.encode(scoredDiplotypes[index].first), scoredDiplotypes[index].second);
+    }
+    return compactDiplotypes;
+}
+
 std::ostream& operator<<(std::ostream& out, const ScoredDiplotype& diplotype) { return out; }
@@ -28,5 +28,14 @@
 
 using ScoredDiplotype = std::pair<Diplotype, int>;
 using ScoredDiplotypes = std::vector<ScoredDiplotype>;
+using CompactScoredDiplotypes = std::vector<std::pair<CompactDiplotype, int>>;
 
-ScoredDiplotypes scoreDiplotypes(const FragById& fragById, const std::vector<Diplotype>& diplotypes);
\ No newline at end of file
+/// Scores each diplotype by how well the fragments project onto its haplotypes, highest-scoring diplotypes first
+///
+/// \param numThreads: Number of threads projecting the fragments onto the haplotypes
+ScoredDiplotypes
+scoreDiplotypes(const FragById& fragById, const std::vector<Diplotype>& diplotypes, int numThreads = 1);
+
+/// Encodes at most maxDiplotypes of the first (i.e. highest-scoring) diplotypes; all of them if maxDiplotypes is 0
+CompactScoredDiplotypes
+compactScoredDiplotypes(const DiplotypeCodec& codec, const ScoredDiplotypes& scoredDiplotypes, int maxDiplotypes);
@@ -0,0 +1,371 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/PlotTiles.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "app/GenerateSvg.hh"
+
+using std::string;
+using std::to_string;
+using std::vector;
+
+namespace fs = boost::filesystem;
+
+static const int kTileSize = 512;
+
+enum class TileDetail
+{
+    // Everything that regular SVG output shows
+    kFull,
+    // Base labels are unreadable once a base is narrower than a letter
+    kNoLabels,
+    // Each segment is reduced to a single rectangle
+    kSummary
+};
+
+struct PlacedLane
+{
+    const Lane* lane;
+    int yPos;
+};
+
+static TileDetail getDetail(double scale)
+{
+    if (scale >= 1.0)
+    {
+        return TileDetail::kFull;
+    }
+    else if (scale >= 0.25)
+    {
+        return TileDetail::kNoLabels;
+    }
+
+    return TileDetail::kSummary;
+}
+
+static Segment summarize(const Segment& segment)
+{
+    // The summary takes the color of the longest feature
+    const Feature* longestFeature = nullptr;
+    for (const auto& feature : segment.features)
+    {
+        if (feature.type != FeatureType::kVerticalLine
+            && (!longestFeature || feature.length > longestFeature->length))
+        {
+            longestFeature = &feature;
+        }
+    }
+
+    if (!longestFeature)
+    {
+        return Segment(segment.start, {}, segment.opacity);
+    }
+
+    // Lines and arrows stay as they are; rectangles lose their breaks
+    FeatureType type = longestFeature->type;
+    if (type == FeatureType::kRectWithLeftBreak || type == FeatureType::kRectWithRightBreak)
+    {
+        type = FeatureType::kRect;
+    }
+
+    Feature summary(type, segment.end - segment.start, longestFeature->fill, longestFeature->stroke);
+    if (type == FeatureType::kArrows)
+    {
+        summary.label = longestFeature->label;
+    }
+    return Segment(segment.start, { summary }, segment.opacity);
+}
+
+static Segment removeLabels(const Segment& segment)
+{
+    Segment unlabeledSegment = segment;
+    for (auto& feature : unlabeledSegment.features)
+    {
+        if (feature.type != FeatureType::kArrows)
+        {
+            feature.label = boost::none;
+        }
+    }
+    return unlabeledSegment;
+}
+
+// Restricts the segment to the bases in [firstBase, lastBase) so that long features are not repeated in every tile
+// they overlap
+static Segment clip(const Segment& segment, int firstBase, int lastBase)
+{
+    int clippedStart = -1;
+    vector<Feature> clippedFeatures;
+    int featureStart = segment.start;
+    for (const auto& feature : segment.features)
+    {
+        const int featureEnd = featureStart + feature.length;
+        const int overlapStart = std::max(featureStart, firstBase);
+        const int overlapEnd = std::min(featureEnd, lastBase);
+        const bool isVisible = feature.length == 0 ? firstBase <= featureStart && featureStart <= lastBase
+                                                   : overlapStart < overlapEnd;
+        if (!isVisible)
+        {
+            featureStart = featureEnd;
+            continue;
+        }
+
+        if (clippedStart == -1)
+        {
+            clippedStart = overlapStart;
+        }
+
+        // Arrows carry a single label for the whole feature so they are never cut
+        if (feature.length == 0 || feature.type == FeatureType::kArrows
+            || (overlapStart == featureStart && overlapEnd == featureEnd))
+        {
+            if (clippedStart > featureStart)
+            {
+                clippedStart = featureStart;
+            }
+            clippedFeatures.push_back(feature);
+        }
+        else
+        {
+            FeatureType type = feature.type;
+            if ((type == FeatureType::kRectWithLeftBreak && overlapStart != featureStart)
+                || (type == FeatureType::kRectWithRightBreak && overlapEnd != featureEnd))
+            {
+                type = FeatureType::kRect;
+            }
+
+            Feature clippedFeature(type, overlapEnd - overlapStart, feature.fill, feature.stroke);
+            if (feature.label && static_cast<int>(feature.label->length()) == feature.length)
+            {
+                clippedFeature.label = feature.label->substr(overlapStart - featureStart, clippedFeature.length);
+            }
+            clippedFeatures.push_back(clippedFeature);
+        }
+
+        featureStart = featureEnd;
+    }
+
+    return Segment(clippedStart, std::move(clippedFeatures), segment.opacity);
+}
+
+// Restricts the lane to the parts of segments overlapping the horizontal span of the tile
+static Lane getTilePart(const Lane& lane, double xStart, double xEnd, TileDetail detail)
+{
+    const int firstBase = std::max(0, static_cast<int>(std::floor((xStart - kPlotPadX) / kBaseWidth)));
+    const int lastBase = static_cast<int>(std::ceil((xEnd - kPlotPadX) / kBaseWidth));
+
+    vector<Segment> segments;
+    for (const auto& segment : lane.segments)
+    {
+        if (segment.end < firstBase || lastBase < segment.start)
+        {
+            continue;
+        }
+
+        if (detail == TileDetail::kFull)
+        {
+            segments.push_back(clip(segment, firstBase, lastBase));
+        }
+        else if (detail == TileDetail::kNoLabels)
+        {
+            segments.push_back(clip(removeLabels(segment), firstBase, lastBase));
+        }
+        else
+        {
+            segments.push_back(summarize(segment));
+        }
+    }
+
+    return Lane(lane.height, std::move(segments));
+}
+
+static void writeTile(
+    const vector<PlacedLane>& placedLanes, double xStart, double yStart, double span, TileDetail detail,
+    const string& tilePath)
+{
+    // Lanes are ordered by position so the ones overlapping the tile form a contiguous range
+    auto laneIter = std::lower_bound(
+        placedLanes.begin(), placedLanes.end(), yStart, [](const PlacedLane& placedLane, double yPos) {
+            return placedLane.yPos + placedLane.lane->height < yPos;
+        });
+
+    std::ostringstream lanes;
+    SvgPatternIds patternIds;
+    for (; laneIter != placedLanes.end() && laneIter->yPos <= yStart + span; ++laneIter)
+    {
+        const Lane tilePart = getTilePart(*laneIter->lane, xStart, xStart + span, detail);
+        if (!tilePart.segments.empty())
+        {
+            drawLane(lanes, kBaseWidth, kPlotPadX, laneIter->yPos, tilePart, patternIds);
+        }
+    }
+
+    if (lanes.tellp() == 0)
+    {
+        return;
+    }
+
+    std::ofstream tileFile(tilePath);
+    if (!tileFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + tilePath);
+    }
+
+    tileFile << "<svg width=\"" << kTileSize << "\" height=\"" << kTileSize << "\"";
+    tileFile << " viewBox=\"" << xStart << " " << yStart << " " << span << " " << span << "\"";
+    tileFile << " xmlns=\"http://www.w3.org/2000/svg\">\n";
+    generateSvgDefs(tileFile);
+    tileFile << lanes.str();
+    tileFile << "</svg>" << std::endl;
+}
+
+static void writeViewer(const SvgSize& size, int maxLevel, const string& viewerPath)
+{
+    std::ofstream viewerFile(viewerPath);
+    if (!viewerFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + viewerPath);
+    }
+
+    viewerFile << R"(<!DOCTYPE html>
+<html>
+<head>
+<meta charset="utf-8">
+<title>REViewer plot</title>
+<style>
+body { margin: 0; font-family: sans-serif; }
+#controls { position: fixed; top: 10px; right: 20px; z-index: 1; }
+#viewport { position: absolute; top: 0; bottom: 0; left: 0; right: 0; overflow: auto; }
+#plot { position: relative; }
+#plot img { position: absolute; }
+</style>
+</head>
+<body>
+<div id="controls"><button id="zoom-out">&minus;</button> <button id="zoom-in">+</button></div>
+<div id="viewport"><div id="plot"></div></div>
+<script>
+)";
+    viewerFile << "const plotWidth = " << size.width << ", plotHeight = " << size.height << ";\n";
+    viewerFile << "const tileSize = " << kTileSize << ", maxLevel = " << maxLevel << ";\n";
+    viewerFile << R"(const viewport = document.getElementById("viewport");
+const plot = document.getElementById("plot");
+let level = 0;
+let tiles = new Map();
+
+function scale() { return Math.pow(2, level - maxLevel); }
+
+function showVisibleTiles() {
+    const firstColumn = Math.floor(viewport.scrollLeft / tileSize);
+    const lastColumn = Math.floor((viewport.scrollLeft + viewport.clientWidth) / tileSize);
+    const firstRow = Math.floor(viewport.scrollTop / tileSize);
+    const lastRow = Math.floor((viewport.scrollTop + viewport.clientHeight) / tileSize);
+    const numColumns = Math.ceil(plotWidth * scale() / tileSize);
+    const numRows = Math.ceil(plotHeight * scale() / tileSize);
+    for (let row = firstRow; row <= Math.min(lastRow, numRows - 1); ++row) {
+        for (let column = firstColumn; column <= Math.min(lastColumn, numColumns - 1); ++column) {
+            const key = column + "_" + row;
+            if (tiles.has(key)) {
+                continue;
+            }
+            const tile = document.createElement("img");
+            tile.style.left = column * tileSize + "px";
+            tile.style.top = row * tileSize + "px";
+            tile.onerror = () => tile.remove();
+            tile.src = level + "/" + key + ".svg";
+            tiles.set(key, tile);
+            plot.appendChild(tile);
+        }
+    }
+}
+
+function setLevel(newLevel) {
+    newLevel = Math.max(0, Math.min(maxLevel, newLevel));
+    const centerX = (viewport.scrollLeft + viewport.clientWidth / 2) / scale();
+    const centerY = (viewport.scrollTop + viewport.clientHeight / 2) / scale();
+    level = newLevel;
+    tiles = new Map();
+    plot.innerHTML = "";
+    plot.style.width = Math.ceil(plotWidth * scale()) + "px";
+    plot.style.height = Math.ceil(plotHeight * scale()) + "px";
+    viewport.scrollLeft = centerX * scale() - viewport.clientWidth / 2;
+    viewport.scrollTop = centerY * scale() - viewport.clientHeight / 2;
+    showVisibleTiles();
+}
+
+viewport.addEventListener("scroll", showVisibleTiles);
+window.addEventListener("resize", showVisibleTiles);
+document.getElementById("zoom-in").onclick = () => setLevel(level + 1);
+document.getElementById("zoom-out").onclick = () => setLevel(level - 1);
+setLevel(0);
+</script>
+</body>
+</html>
+)";
+}
+
+void generatePlotTiles(const vector<LanePlot>& lanePlots, const string& outputDir)
+{
+    const SvgSize size = getSvgSize(lanePlots);
+    int maxLevel = 0;
+    while ((std::max(size.width, size.height) >> maxLevel) > kTileSize)
+    {
+        ++maxLevel;
+    }
+
+    vector<PlacedLane> placedLanes;
+    const vector<int> yPositions = getLaneYPositions(lanePlots);
+    auto yPosIter = yPositions.begin();
+    for (const auto& lanePlot : lanePlots)
+    {
+        for (const auto& lane : lanePlot)
+        {
+            placedLanes.push_back({ &lane, *yPosIter++ });
+        }
+    }
+
+    for (int level = 0; level <= maxLevel; ++level)
+    {
+        const string levelDir = outputDir + "/" + to_string(level);
+        fs::create_directories(levelDir);
+
+        const double scale = 1.0 / (1 << (maxLevel - level));
+        const TileDetail detail = getDetail(scale);
+        const double span = kTileSize / scale;
+        const int numColumns = static_cast<int>(std::ceil(size.width * scale / kTileSize));
+        const int numRows = static_cast<int>(std::ceil(size.height * scale / kTileSize));
+        for (int row = 0; row != numRows; ++row)
+        {
+            for (int column = 0; column != numColumns; ++column)
+            {
+                const string tilePath = levelDir + "/" + to_string(column) + "_" + to_string(row) + ".svg";
+                writeTile(placedLanes, column * span, row * span, span, detail, tilePath);
+            }
+        }
+    }
+
+    writeViewer(size, maxLevel, outputDir + "/index.html");
+}
@@ -0,0 +1,36 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "app/LanePlot.hh"
+
+/// Cuts lane plots into a pyramid of fixed-size SVG tiles for viewing very large plots
+///
+/// Level 0 fits the whole plot into a single tile; each following level doubles the resolution up to the
+/// resolution of regular SVG output. Tiles are written to <outputDir>/<level>/<column>_<row>.svg (empty tiles are
+/// skipped) together with a viewer page <outputDir>/index.html that fetches only the visible tiles.
+///
+/// \param lanePlots: Lane plots to render
+/// \param outputDir: Output directory; created if necessary
+void generatePlotTiles(const std::vector<LanePlot>& lanePlots, const std::string& outputDir);
@@ -26,6 +26,8 @@
 
 #include "graphalign/Operation.hh"
 
+#include "app/FragChunks.hh"
+
 using boost::optional;
 using graphtools::Alignment;
 using graphtools::GraphAlignment;
@@ -306,45 +308,67 @@ vector<ReadPathAlign> project(const GraphAlign& align, int pathIndex, const Path
     return pathAligns;
 }
 
-PairPathAlignById project(const vector<Path>& genotypePaths, const FragById& fragById)
+int scorePairProjection(const Frag& frag, const Path& path)
 {
-    PairPathAlignById pairPathAlignById;
-    for (const auto& idAndFrag : fragById)
+    const auto readAligns = project(frag.read.align, 0, path);
+    const auto mateAligns = project(frag.mate.align, 0, path);
+    if (readAligns.empty() || mateAligns.empty())
     {
-        const auto& fragId = idAndFrag.first;
-        const auto& frag = idAndFrag.second;
-        PairPathAlign pathAlign;
-        int bestPairScore = std::numeric_limits<int>::lowest();
-        for (int pathIndex = 0; pathIndex != genotypePaths.size(); ++pathIndex)
-        {
-            const auto& path = genotypePaths[pathIndex];
-            vector<ReadPathAlign> readPathAligns = project(frag.read.align, pathIndex, path);
-            vector<ReadPathAlign> matePathAligns = project(frag.mate.align, pathIndex, path);
-            if (readPathAligns.empty() || matePathAligns.empty())
-            {
-                continue;
-            }
+        return kNoPairScore;
+    }
 
-            const int pairScore = score(*readPathAligns.front().align) + score(*matePathAligns.front().align);
-            if (pairScore > bestPairScore)
-            {
-                bestPairScore = pairScore;
-                pathAlign.readAligns.clear();
-                pathAlign.mateAligns.clear();
-            }
+    return score(*readAligns.front().align) + score(*mateAligns.front().align);
+}
 
-            if (pairScore == bestPairScore)
-            {
-                pathAlign.readAligns.insert(pathAlign.readAligns.end(), readPathAligns.begin(), readPathAligns.end());
-                pathAlign.mateAligns.insert(pathAlign.mateAligns.end(), matePathAligns.begin(), matePathAligns.end());
-            }
+static PairPathAlign projectFrag(const vector<Path>& genotypePaths, const Frag& frag)
+{
+    PairPathAlign pathAlign;
+    int bestPairScore = std::numeric_limits<int>::lowest();
+    for (int pathIndex = 0; pathIndex != genotypePaths.size(); ++pathIndex)
+    {
+        const auto& path = genotypePaths[pathIndex];
+        vector<ReadPathAlign> readPathAligns = project(frag.read.align, pathIndex, path);
+        vector<ReadPathAlign> matePathAligns = project(frag.mate.align, pathIndex, path);
+        if (readPathAligns.empty() || matePathAligns.empty())
+        {
+            continue;
+        }
+
+        const int pairScore = score(*readPathAligns.front().align) + score(*matePathAligns.front().align);
+        if (pairScore > bestPairScore)
+        {
+            bestPairScore = pairScore;
+            pathAlign.readAligns.clear();
+            pathAlign.mateAligns.clear();
         }
 
-        assert(!pathAlign.readAligns.empty() && !pathAlign.mateAligns.empty());
-        pairPathAlignById.emplace(fragId, pathAlign);
+        if (pairScore == bestPairScore)
+        {
+            pathAlign.readAligns.insert(pathAlign.readAligns.end(), readPathAligns.begin(), readPathAligns.end());
+            pathAlign.mateAligns.insert(pathAlign.mateAligns.end(), matePathAligns.begin(), matePathAligns.end());
+        }
     }
 
-    return pairPathAlignById;
+    assert(!pathAlign.readAligns.empty() && !pathAlign.mateAligns.empty());
+    return pathAlign;
+}
+
+PairPathAlignById project(const vector<Path>& genotypePaths, const FragById& fragById, int numThreads)
+{
+    const auto fragEntries = getMapEntries(fragById);
+    auto projectChunk = [&genotypePaths, &fragEntries](size_t begin, size_t end)
+    {
+        PairPathAlignById pairPathAlignById;
+        for (size_t fragIndex = begin; fragIndex != end; ++fragIndex)
+        {
+            const auto& idAndFrag = *fragEntries[fragIndex];
+            pairPathAlignById.emplace_hint(
+                pairPathAlignById.end(), idAndFrag.first, projectFrag(genotypePaths, idAndFrag.second));
+        }
+        return pairPathAlignById;
+    };
+
+    return concatenateMaps(processFragChunks<PairPathAlignById>(fragEntries.size(), numThreads, projectChunk));
 }
 
 /*
@@ -358,19 +382,3 @@ FragOriginsById getFragOrigins(const vector<Path>& hapPaths, const FragPathAlign
     assert(!fragOriginsById.empty());
     return fragOriginsById;
 } */
-
-ReadPathAlign::ReadPathAlign(const Path& hapPath, int pathIndex, int startIndexOnPath, GraphAlignPtr align)
-    : pathIndex(pathIndex)
-    , startIndexOnPath(startIndexOnPath)
-    , align(std::move(align))
-{
-    int prefixLen = 0;
-    for (int nodeIndex = 0; nodeIndex != startIndexOnPath; ++nodeIndex)
-    {
-        NodeId node = hapPath.nodeIds()[nodeIndex];
-        prefixLen += hapPath.graphRawPtr()->nodeSeq(node).length();
-    }
-
-    begin = prefixLen + this->align->path().startPosition();
-    end = begin + this->align->referenceLength();
-}
@@ -20,6 +20,7 @@
 
 #pragma once
 
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -46,5 +47,17 @@ struct PairPathAlign
 
 int score(const graphtools::GraphAlignment& alignment, int matchScore = 5, int mismatchScore = -4, int gapScore = -8);
 
+/// Projects a read alignment onto a haplotype path; reads inside a repeat are projected to each possible position
+std::vector<ReadPathAlign> project(const GraphAlign& align, int pathIndex, const graphtools::Path& path);
+
+// Pair score of a fragment that cannot be projected onto a haplotype
+const int kNoPairScore = std::numeric_limits<int>::lowest();
+
+/// \return Sum of the scores of the read and mate of the fragment projected onto the path, as used by project() to
+/// choose between paths, or kNoPairScore if either of them cannot be projected
+int scorePairProjection(const Frag& frag, const graphtools::Path& path);
+
 using PairPathAlignById = std::map<std::string, PairPathAlign>;
-PairPathAlignById project(const std::vector<graphtools::Path>& genotypePaths, const FragById& fragById);
+/// \param numThreads: Number of threads projecting consecutive chunks of fragments
+PairPathAlignById
+project(const std::vector<graphtools::Path>& genotypePaths, const FragById& fragById, int numThreads = 1);
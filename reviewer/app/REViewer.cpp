@@ -18,8 +18,12 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
 
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <vector>
 
 #include <boost/optional.hpp>
 #include <boost/program_options.hpp>
@@ -28,9 +32,14 @@
 #include "spdlog/spdlog.h"
 
 #include "Workflow.hh"
+#include "app/Benchmark.hh"
+#include "app/XgLocusIndex.hh"
+#include "archive/PlotArchive.hh"
+#include "metrics/MetricsStore.hh"
 
 using boost::optional;
 using std::string;
+using std::vector;
 
 namespace po = boost::program_options;
 
@@ -44,13 +53,37 @@ optional<WorkflowArguments> getCommandLineArguments(int argc, char** argv)
             ("help", "Print help message")
             ("version", "Print version number")
             ("only-metrics", "Only output the metrics file and don't generate images")
-            ("reads", po::value<string>(&args.readsPath)->required(), "BAMlet generated by ExpansionHunter")
-            ("vcf", po::value<string>(&args.vcfPath)->required(), "VCF file generated by ExpansionHunter")
+            ("reads", po::value<string>(&args.readsPath), "BAMlet generated by ExpansionHunter")
+            ("vcf", po::value<string>(&args.vcfPath), "VCF file generated by ExpansionHunter")
+            ("sample", po::value<string>(&args.sampleId), "Sample whose genotypes to use from a multi-sample VCF (defaults to the first sample)")
             ("reference", po::value<string>(&args.referencePath)->required(), "FASTA file with reference genome")
             ("catalog", po::value<string>(&args.catalogPath)->required(), "Variant catalog")
             ("locus", po::value<string>(&args.locusId), "Locus to analyze (or a list of comma-separated loci). If not specified, all loci in the variant catalog will be processed.")
             ("region-extension-length", po::value<int>(&args.locusExtensionLength)->default_value(1000), "Length of flanking region (must match corresponding ExpansionHunter setting)")
-            ("output-prefix", po::value<string>(&args.outputPrefix)->required(), "Prefix for the output files");
+            ("mate-buffer-memory", po::value<size_t>(&args.mateBufferMb)->default_value(1024), "Memory in megabytes for reads waiting for their mates; older unpaired reads are spilled to a temporary file beyond it")
+            ("in-memory-reads", po::value<size_t>(&args.inMemoryReadsMb)->default_value(64), "Load reads files of up to this many megabytes into memory once instead of querying them for each locus (0 always queries the file)")
+            ("locus-index", "Index the reads file by locus on first use (<reads>.xgi) so that only the records of each analyzed locus are read; an existing up-to-date index is always used")
+            ("threads", po::value<int>(&args.numThreads)->default_value(1), "Number of threads analyzing each locus: decoding its reads (read from the reads file on a separate thread above 1) and projecting, resolving and drawing its fragments; sample panels split them between samples")
+            ("output-prefix", po::value<string>(&args.outputPrefix)->required(), "Prefix for the output files")
+            ("cache-dir", po::value<string>(&args.cacheDir), "Directory for caching per-locus results and plot blueprints; loci with unchanged inputs are not reanalyzed")
+            ("no-cache-blueprints", "Cache only metrics and phasing results; cached loci are then reanalyzed unless --only-metrics is given")
+            ("work-queue", po::value<string>(&args.workQueueDir), "Shared directory through which multiple REViewer processes divide the loci between themselves; each process exits once all results are merged")
+            ("lease-seconds", po::value<int>(&args.leaseSeconds)->default_value(3600), "Time after which a locus claimed through the work queue can be claimed by another process if its lease is no longer renewed")
+            ("plot-archive", "Write all plots into a single indexed archive (<prefix>.plots) instead of one SVG per locus")
+            ("compress-plot-archive", "Compress plots stored in the plot archive")
+            ("html-report", "Write all plots into a single HTML page (<prefix>.report.html) instead of one SVG per locus")
+            ("plot-tiles", "Write each plot as a pyramid of image tiles with a viewer page (<prefix>.<locus>.tiles/index.html) for plots too large to view as a single SVG")
+            ("kmer-preview", "Only rank candidate diplotypes by counts of distinguishing k-mers; much faster than full phasing but outputs no metrics or images")
+            ("kmer-prefilter", po::value<int>(&args.kmerPrefilter)->default_value(0), "Fully score only this many candidate diplotypes ranked highest by k-mer counts plus any tied with them (0 scores all candidates)")
+            ("flank-snp-phasing", "Before phasing, drop candidate diplotypes whose phase of the repeats contradicts heterozygous flank SNPs seen on fragments spanning the repeats")
+            ("phasing-top-k", po::value<int>(&args.phasingTopK)->default_value(0), "Only keep and output this many highest-scoring diplotypes of each locus in the phasing file (0 keeps all)")
+            ("realign-reads", "Realign poorly scoring reads to the selected haplotypes instead of only projecting their graph alignments")
+            ("realign-time-budget", po::value<int>(&args.realignTimeBudgetMs)->default_value(2000), "Maximum time in milliseconds spent realigning reads of each locus")
+            ("search-repeat-ci", "Also consider repeat lengths inside the confidence intervals (REPCI) reported by ExpansionHunter")
+            ("haplotype-bam", "Also write reads aligned to the selected haplotypes into an indexed BAM file with the haplotype sequences (<prefix>.<locus>.haplotypes.bam and .fa)")
+            ("metrics-store", "Also write metrics into a binary columnar store (<prefix>.metrics.bin) that can be searched with REViewer query")
+            ("samples", po::value<string>(&args.samplesPath), "Tab-separated list of sample ids, BAMlets, and optionally VCFs (defaulting to --vcf); draws the locus given by --locus in all samples as a single panel (<prefix>.<locus>.panel.svg)")
+            ("panel-read-lanes", "Also draw the reads of each sample in the panel instead of only their depth");
     // clang-format on
 
     if (argc == 1)
@@ -75,16 +108,290 @@ optional<WorkflowArguments> getCommandLineArguments(int argc, char** argv)
     }
 
     args.onlyMetrics = (bool) argumentMap.count("only-metrics");
+    args.cacheBlueprints = !argumentMap.count("no-cache-blueprints");
+    args.writePlotArchive = (bool) argumentMap.count("plot-archive");
+    args.compressPlotArchive = (bool) argumentMap.count("compress-plot-archive");
+    args.writeHtmlReport = (bool) argumentMap.count("html-report");
+    args.writePlotTiles = (bool) argumentMap.count("plot-tiles");
+    args.kmerPreview = (bool) argumentMap.count("kmer-preview");
+    args.flankSnpPhasing = (bool) argumentMap.count("flank-snp-phasing");
+    args.realignReads = (bool) argumentMap.count("realign-reads");
+    args.searchRepeatIntervals = (bool) argumentMap.count("search-repeat-ci");
+    args.writeHaplotypeBam = (bool) argumentMap.count("haplotype-bam");
+    args.writeMetricsStore = (bool) argumentMap.count("metrics-store");
+    args.panelReadLanes = (bool) argumentMap.count("panel-read-lanes");
+    args.buildLocusIndex = (bool) argumentMap.count("locus-index");
 
     po::notify(argumentMap);
 
+    if (args.samplesPath.empty() && (args.readsPath.empty() || args.vcfPath.empty()))
+    {
+        throw std::runtime_error("--reads and --vcf are required unless samples are listed with --samples");
+    }
+
+    if (args.phasingTopK < 0)
+    {
+        throw std::runtime_error("--phasing-top-k must not be negative");
+    }
+
+    if (args.numThreads < 1)
+    {
+        throw std::runtime_error("--threads must be at least 1");
+    }
+
     return args;
 }
 
+// Usage: REViewer extract-plot --archive <prefix>.plots [--locus <id> [--output <svg>]]
+int runPlotExtraction(int argc, char** argv)
+{
+    string archivePath;
+    string locusId;
+    string outputPath;
+
+    // clang-format off
+    po::options_description options("Plot extraction options");
+    options.add_options()
+            ("help", "Print help message")
+            ("archive", po::value<string>(&archivePath)->required(), "Plot archive generated with --plot-archive")
+            ("locus", po::value<string>(&locusId), "Locus whose plot to extract. If not specified, the loci in the archive are listed.")
+            ("output", po::value<string>(&outputPath), "Output SVG file (defaults to standard output)");
+    // clang-format on
+
+    po::variables_map argumentMap;
+    po::store(po::command_line_parser(argc, argv).options(options).run(), argumentMap);
+    if (argumentMap.count("help"))
+    {
+        std::cerr << options << std::endl;
+        return 0;
+    }
+    po::notify(argumentMap);
+
+    PlotArchiveReader archive(archivePath);
+    if (locusId.empty())
+    {
+        for (const auto& archivedLocusId : archive.locusIds())
+        {
+            std::cout << archivedLocusId << std::endl;
+        }
+        return 0;
+    }
+
+    const string plot = archive.get(locusId);
+    if (outputPath.empty())
+    {
+        std::cout << plot;
+        return 0;
+    }
+
+    std::ofstream outputFile(outputPath);
+    if (!outputFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + outputPath);
+    }
+    outputFile << plot;
+
+    return 0;
+}
+
+// Usage: REViewer index-reads --reads <bam>
+int runReadsIndexing(int argc, char** argv)
+{
+    string readsPath;
+
+    // clang-format off
+    po::options_description options("Reads indexing options");
+    options.add_options()
+            ("help", "Print help message")
+            ("reads", po::value<string>(&readsPath)->required(), "BAMlet generated by ExpansionHunter");
+    // clang-format on
+
+    po::variables_map argumentMap;
+    po::store(po::command_line_parser(argc, argv).options(options).run(), argumentMap);
+    if (argumentMap.count("help"))
+    {
+        std::cerr << options << std::endl;
+        return 0;
+    }
+    po::notify(argumentMap);
+
+    const auto index = XgLocusIndex::build(readsPath);
+    index.write(XgLocusIndex::getIndexPath(readsPath));
+    spdlog::info("Indexed {} loci of {}", index.numLoci(), readsPath);
+
+    return 0;
+}
+
+struct MetricsQuery
+{
+    string variantId;
+    string allele;
+    int minLength;
+    int maxLength;
+    double minDepth;
+    double maxDepth;
+
+    bool matchesAllele(const MetricsStoreReader& store, int row, int allele) const
+    {
+        const int length = store.genotype(row, allele);
+        const double depth = store.alleleDepth(row, allele);
+        return length != -1 && minLength <= length && length <= maxLength && minDepth <= depth && depth <= maxDepth;
+    }
+
+    bool matches(const MetricsStoreReader& store, int row) const
+    {
+        int numAlleles = 0;
+        while (numAlleles != MetricsStoreWriter::kNumAlleles && store.genotype(row, numAlleles) != -1)
+        {
+            ++numAlleles;
+        }
+        if (numAlleles == 0)
+        {
+            return false;
+        }
+
+        if (allele == "any")
+        {
+            for (int index = 0; index != numAlleles; ++index)
+            {
+                if (matchesAllele(store, row, index))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        int shortAllele = 0;
+        int longAllele = 0;
+        for (int index = 1; index != numAlleles; ++index)
+        {
+            shortAllele = store.genotype(row, index) < store.genotype(row, shortAllele) ? index : shortAllele;
+            longAllele = store.genotype(row, index) >= store.genotype(row, longAllele) ? index : longAllele;
+        }
+        return matchesAllele(store, row, allele == "short" ? shortAllele : longAllele);
+    }
+};
+
+static void writeQueryMatch(const MetricsStoreReader& store, int row)
+{
+    std::cout << store.sampleId() << "\t" << store.variantId(row) << "\t";
+    string separator;
+    for (int allele = 0; allele != MetricsStoreWriter::kNumAlleles && store.genotype(row, allele) != -1; ++allele)
+    {
+        std::cout << separator << store.genotype(row, allele);
+        separator = "/";
+    }
+    std::cout << "\t";
+    separator.clear();
+    for (int allele = 0; allele != MetricsStoreWriter::kNumAlleles && !std::isnan(store.alleleDepth(row, allele));
+         ++allele)
+    {
+        std::cout << separator << store.alleleDepth(row, allele);
+        separator = "/";
+    }
+    std::cout << "\n";
+}
+
+// Usage: REViewer query [--locus <id>] [--allele short|long|any] [length and depth bounds] <store> ...
+int runMetricsQuery(int argc, char** argv)
+{
+    MetricsQuery query;
+    vector<string> storePaths;
+    string storeListPath;
+
+    // clang-format off
+    po::options_description options("Query options");
+    options.add_options()
+            ("help", "Print help message")
+            ("stores", po::value<vector<string>>(&storePaths), "Metrics stores generated with --metrics-store")
+            ("store-list", po::value<string>(&storeListPath), "File listing paths of metrics stores, one per line")
+            ("locus", po::value<string>(&query.variantId), "Variant to report; all variants are reported if not specified")
+            ("allele", po::value<string>(&query.allele)->default_value("any"), "Allele that must satisfy the bounds: short, long, or any")
+            ("min-length", po::value<int>(&query.minLength)->default_value(0), "Minimal repeat length of the allele")
+            ("max-length", po::value<int>(&query.maxLength)->default_value(std::numeric_limits<int>::max()), "Maximal repeat length of the allele")
+            ("min-depth", po::value<double>(&query.minDepth)->default_value(0), "Minimal depth of the allele")
+            ("max-depth", po::value<double>(&query.maxDepth)->default_value(std::numeric_limits<double>::max()), "Maximal depth of the allele");
+    // clang-format on
+
+    po::positional_options_description positionalOptions;
+    positionalOptions.add("stores", -1);
+
+    po::variables_map argumentMap;
+    po::store(
+        po::command_line_parser(argc, argv).options(options).positional(positionalOptions).run(), argumentMap);
+    if (argumentMap.count("help"))
+    {
+        std::cerr << options << std::endl;
+        return 0;
+    }
+    po::notify(argumentMap);
+
+    if (query.allele != "short" && query.allele != "long" && query.allele != "any")
+    {
+        throw std::runtime_error("Allele must be short, long, or any but got " + query.allele);
+    }
+
+    if (!storeListPath.empty())
+    {
+        std::ifstream storeListFile(storeListPath);
+        if (!storeListFile.is_open())
+        {
+            throw std::runtime_error("Unable to open " + storeListPath);
+        }
+        string storePath;
+        while (getline(storeListFile, storePath))
+        {
+            if (!storePath.empty())
+            {
+                storePaths.push_back(storePath);
+            }
+        }
+    }
+
+    std::cout.precision(2);
+    std::cout << std::fixed;
+    std::cout << "SampleId\tVariantId\tGenotype\tAlleleDepth\n";
+    for (const auto& storePath : storePaths)
+    {
+        MetricsStoreReader store(storePath);
+        const auto rows = query.variantId.empty() ? std::make_pair(0, store.numRows()) : store.findRows(query.variantId);
+        for (int row = rows.first; row != rows.second; ++row)
+        {
+            if (query.matches(store, row))
+            {
+                writeQueryMatch(store, row);
+            }
+        }
+    }
+
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     try
     {
+        if (argc > 1 && string(argv[1]) == "extract-plot")
+        {
+            return runPlotExtraction(argc - 1, argv + 1);
+        }
+
+        if (argc > 1 && string(argv[1]) == "query")
+        {
+            return runMetricsQuery(argc - 1, argv + 1);
+        }
+
+        if (argc > 1 && string(argv[1]) == "index-reads")
+        {
+            return runReadsIndexing(argc - 1, argv + 1);
+        }
+
+        if (argc > 1 && string(argv[1]) == "benchmark")
+        {
+            return runBenchmark(argc - 1, argv + 1);
+        }
+
         optional<WorkflowArguments> arguments = getCommandLineArguments(argc, argv);
         if (arguments)
         {
@@ -0,0 +1,335 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/Realignment.hh"
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "graphalign/GraphAlignmentOperations.hh"
+#include "graphalign/Operation.hh"
+#include "graphalign/PinnedDagAligner.hh"
+
+using graphalign::dagAligner::Cigar;
+using graphalign::dagAligner::EdgeMap;
+using graphtools::Alignment;
+using graphtools::GraphAlignment;
+using graphtools::NodeId;
+using graphtools::Operation;
+using graphtools::OperationType;
+using graphtools::Path;
+using std::list;
+using std::string;
+using std::vector;
+
+// Same scoring scheme as the default arguments of score()
+static const int kMatchScore = 5;
+static const int kMismatchScore = -4;
+static const int kGapOpenScore = 0;
+static const int kGapExtendScore = -8;
+
+// Reads scoring below this fraction of a perfect alignment are realigned
+static const double kPoorScoreFraction = 0.9;
+
+// Compares bases the same way as graph alignments do, so that degenerate bases in the graph match the read
+using Aligner = graphtools::BaseMatchingDagAligner<true>;
+
+namespace
+{
+
+struct RealignJob
+{
+    RealignJob(int pathIndex, const string* bases, ReadPathAlign* readAlign, int score)
+        : pathIndex(pathIndex)
+        , bases(bases)
+        , readAlign(readAlign)
+        , score(score)
+    {
+    }
+
+    int pathIndex;
+    const string* bases;
+    ReadPathAlign* readAlign;
+    int score;
+};
+
+// Linear sequence of a haplotype path and the offsets of its nodes
+struct Haplotype
+{
+    explicit Haplotype(const Path& path)
+        : path(path)
+    {
+        for (NodeId node : path.nodeIds())
+        {
+            nodeStarts.push_back(seq.length());
+            seq += path.graphRawPtr()->nodeSeq(node);
+        }
+    }
+
+    // Index on the path of the node containing the given haplotype position
+    int getNodeIndex(int position) const
+    {
+        return std::upper_bound(nodeStarts.begin(), nodeStarts.end(), position) - nodeStarts.begin() - 1;
+    }
+
+    const Path& path;
+    string seq;
+    vector<int> nodeStarts;
+};
+
+}
+
+static void appendOperation(OperationType type, int length, list<Operation>& operations)
+{
+    if (!operations.empty() && operations.back().type() == type)
+    {
+        operations.back() = Operation(type, operations.back().length() + length);
+    }
+    else
+    {
+        operations.emplace_back(type, length);
+    }
+}
+
+// Edges from offset -1 let the alignment start anywhere in the window at the same cost. The aligner records the jump
+// from such an edge as a single deletion, so every target base is given its own node id to keep the start position in
+// the cigar. Node ids cost nothing during the fill, which iterates over predecessor offsets and is vectorized along
+// the read.
+static EdgeMap makeLinearEdgeMap(int targetLen)
+{
+    vector<std::pair<int, int>> edges;
+    vector<EdgeMap::NodeId> nodeIds = { 0 };
+    for (int offset = 1; offset != targetLen; ++offset)
+    {
+        edges.emplace_back(-1, offset);
+        edges.emplace_back(offset - 1, offset);
+        nodeIds.push_back(offset);
+    }
+    // EdgeMap requires the edge list to end with a self-edge at the target length, which marks where the target ends
+    edges.emplace_back(targetLen, targetLen);
+
+    return EdgeMap(edges, nodeIds);
+}
+
+// Converts a cigar over the haplotype window starting at windowStart into an alignment to the nodes of the haplotype
+static ReadPathAlign convertCigar(const Haplotype& haplotype, int pathIndex, int windowStart, const Cigar& cigar)
+{
+    const auto& pathNodes = haplotype.path.nodeIds();
+    vector<NodeId> nodes;
+    vector<Alignment> nodeAligns;
+    int startIndexOnPath = -1;
+    int startPosition = 0;
+    int endPosition = 0;
+    int nodeIndex = -1;
+    int nodeRefStart = 0;
+    int hapPosition = windowStart;
+    list<Operation> operations;
+    list<Operation> leadingClip;
+
+    for (const Cigar::Operation& op : cigar)
+    {
+        switch (op.code_)
+        {
+        case Cigar::NODE_START:
+            hapPosition = windowStart + static_cast<int>(op.value_);
+            break;
+        case Cigar::NODE_END:
+            break;
+        case Cigar::INSERT:
+        case Cigar::SOFT_CLIP:
+            if (nodeIndex == -1)
+            {
+                appendOperation(OperationType::kSoftclip, op.value_, leadingClip);
+            }
+            else
+            {
+                const auto type = op.code_ == Cigar::INSERT ? OperationType::kInsertionToRef : OperationType::kSoftclip;
+                appendOperation(type, op.value_, operations);
+            }
+            break;
+        case Cigar::MATCH:
+        case Cigar::MISMATCH:
+        case Cigar::DELETE:
+        {
+            if (op.code_ == Cigar::DELETE && nodeIndex == -1)
+            {
+                // Leading deletions are trimmed by starting the alignment at the following base
+                hapPosition += op.value_;
+                break;
+            }
+
+            const int opNodeIndex = haplotype.getNodeIndex(hapPosition);
+            const int offset = hapPosition - haplotype.nodeStarts[opNodeIndex];
+            if (opNodeIndex != nodeIndex)
+            {
+                if (nodeIndex == -1)
+                {
+                    startIndexOnPath = opNodeIndex;
+                    startPosition = offset;
+                    operations.splice(operations.end(), leadingClip);
+                }
+                else
+                {
+                    nodes.push_back(pathNodes[nodeIndex]);
+                    nodeAligns.emplace_back(nodeRefStart, operations);
+                    operations.clear();
+                }
+                nodeIndex = opNodeIndex;
+                nodeRefStart = offset;
+            }
+
+            const auto type = op.code_ == Cigar::MATCH ? OperationType::kMatch
+                : op.code_ == Cigar::MISMATCH          ? OperationType::kMismatch
+                                                       : OperationType::kDeletionFromRef;
+            appendOperation(type, op.value_, operations);
+            hapPosition += op.value_;
+            endPosition = offset + op.value_;
+            break;
+        }
+        default:
+            throw std::logic_error("Unexpected operation in realigned read: " + std::to_string(op.code_));
+        }
+    }
+
+    if (nodeIndex == -1)
+    {
+        throw std::logic_error("Realigned read does not overlap its haplotype");
+    }
+    nodes.push_back(pathNodes[nodeIndex]);
+    nodeAligns.emplace_back(nodeRefStart, operations);
+
+    Path alignPath(haplotype.path.graphRawPtr(), startPosition, nodes, endPosition);
+    GraphAlignPtr align(new GraphAlignment(alignPath, nodeAligns));
+    return ReadPathAlign(haplotype.path, pathIndex, startIndexOnPath, std::move(align));
+}
+
+static int getQueryLength(const GraphAlignment& align)
+{
+    int queryLength = 0;
+    for (const auto& nodeAlign : align.alignments())
+    {
+        queryLength += nodeAlign.queryLength();
+    }
+    return queryLength;
+}
+
+// Reads projected to several positions within a repeat share the alignment; these are left as they are
+static bool isAmbiguous(const vector<ReadPathAlign>& readAligns, const ReadPathAlign& readAlign)
+{
+    return std::count_if(
+               readAligns.begin(), readAligns.end(),
+               [&readAlign](const ReadPathAlign& other) { return other.align == readAlign.align; })
+        > 1;
+}
+
+static void collectJobs(const string& bases, vector<ReadPathAlign>& readAligns, vector<RealignJob>& jobs)
+{
+    for (auto& readAlign : readAligns)
+    {
+        const int alignScore = score(*readAlign.align, kMatchScore, kMismatchScore, kGapExtendScore);
+        const int perfectScore = kMatchScore * getQueryLength(*readAlign.align);
+        if (alignScore < kPoorScoreFraction * perfectScore && !isAmbiguous(readAligns, readAlign))
+        {
+            jobs.emplace_back(readAlign.pathIndex, &bases, &readAlign, alignScore);
+        }
+    }
+}
+
+int realignPoorAligns(
+    const Diplotype& diplotype, const FragById& fragById, PairPathAlignById& pairPathAlignById,
+    std::chrono::milliseconds timeBudget)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    vector<RealignJob> jobs;
+    for (auto& fragIdAndAligns : pairPathAlignById)
+    {
+        const auto& frag = fragById.at(fragIdAndAligns.first);
+        collectJobs(frag.read.bases, fragIdAndAligns.second.readAligns, jobs);
+        collectJobs(frag.mate.bases, fragIdAndAligns.second.mateAligns, jobs);
+    }
+
+    std::stable_sort(
+        jobs.begin(), jobs.end(), [](const RealignJob& lhs, const RealignJob& rhs) { return lhs.score < rhs.score; });
+
+    vector<Haplotype> haplotypes;
+    for (const auto& path : diplotype)
+    {
+        haplotypes.emplace_back(path);
+    }
+
+    // The aligner fills its matrix for one read per call, so reads are aligned one after another; a single aligner is
+    // reused for all of them so that its matrices are allocated only once
+    Aligner aligner(kMatchScore, kMismatchScore, kGapOpenScore, kGapExtendScore);
+    int numImproved = 0;
+    int numProcessed = 0;
+    for (auto& job : jobs)
+    {
+        if (std::chrono::steady_clock::now() - startTime > timeBudget)
+        {
+            break;
+        }
+        ++numProcessed;
+
+        const Haplotype& haplotype = haplotypes[job.pathIndex];
+        const string& bases = *job.bases;
+        const int readLen = bases.length();
+        const int windowStart = std::max(0, job.readAlign->begin - readLen);
+        const int windowEnd = std::min(static_cast<int>(haplotype.seq.length()), job.readAlign->end + readLen);
+        if (windowEnd - windowStart < 2)
+        {
+            continue;
+        }
+
+        const EdgeMap edgeMap = makeLinearEdgeMap(windowEnd - windowStart);
+        const auto targetBegin = haplotype.seq.begin() + windowStart;
+        aligner.align(bases.begin(), bases.end(), targetBegin, targetBegin + (windowEnd - windowStart), edgeMap);
+        graphalign::dagAligner::Score bestScore = 0;
+        graphalign::dagAligner::Score secondBestScore = 0;
+        const Cigar cigar = aligner.backtrackBestPath<false>(edgeMap, bestScore, secondBestScore);
+
+        ReadPathAlign realigned = convertCigar(haplotype, job.pathIndex, windowStart, cigar);
+        if (!graphtools::checkConsistency(*realigned.align, bases))
+        {
+            spdlog::warn("Discarding inconsistent realignment \n{}", prettyPrint(*realigned.align, bases));
+            continue;
+        }
+
+        if (score(*realigned.align, kMatchScore, kMismatchScore, kGapExtendScore) > job.score)
+        {
+            *job.readAlign = std::move(realigned);
+            ++numImproved;
+        }
+    }
+
+    if (numProcessed != static_cast<int>(jobs.size()))
+    {
+        spdlog::warn(
+            "Realignment time budget exhausted; {} of {} poorly scoring reads were not realigned",
+            jobs.size() - numProcessed, jobs.size());
+    }
+
+    return numImproved;
+}
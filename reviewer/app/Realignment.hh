@@ -0,0 +1,44 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <chrono>
+
+#include "app/Aligns.hh"
+#include "app/GenotypePaths.hh"
+#include "app/Projection.hh"
+
+/// Realigns poorly scoring projected reads to the linear sequence of their haplotype
+///
+/// Projection only translates graph alignments onto haplotype paths, so reads whose original alignment ends in long
+/// soft clips or assumes a different repeat length get projected with spurious clips, insertions, or deletions. Such
+/// reads are aligned again with the vectorized graph-tools aligner to a window of the haplotype around their projected
+/// position. A realigned read replaces the projected one only if it scores higher. The worst reads are realigned
+/// first and the remaining reads are left as projected once the time budget is exhausted.
+///
+/// \param diplotype: Haplotype paths that the reads were projected onto
+/// \param fragById: Fragments containing read sequences
+/// \param pairPathAlignById: Projected alignments to update
+/// \param timeBudget: Maximum time to spend on realignment
+/// \return Number of improved read alignments
+int realignPoorAligns(
+    const Diplotype& diplotype, const FragById& fragById, PairPathAlignById& pairPathAlignById,
+    std::chrono::milliseconds timeBudget);
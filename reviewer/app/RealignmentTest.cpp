@@ -0,0 +1,64 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/Realignment.hh"
+
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "graphalign/GraphAlignmentOperations.hh"
+#include "graphcore/GraphBuilders.hh"
+
+using graphtools::decodeGraphAlignment;
+using graphtools::Graph;
+using graphtools::Path;
+using std::string;
+using std::vector;
+
+TEST_CASE("Reads projected with spurious soft clips are realigned to their haplotype", "[Realignment]")
+{
+    const string leftFlank = "TTGACCATGGCATTAGCAAT";
+    const string rightFlank = "GTCTAGGATCCTTACGGAAT";
+    const Graph graph = graphtools::makeStrGraph(leftFlank, "CAG", rightFlank);
+    const Diplotype diplotype = { Path(&graph, 0, { 0, 1, 1, 1, 1, 1, 2 }, rightFlank.length()) };
+
+    // The read spans the repeat, but its projection assumes the repeat ends where the read is clipped
+    const string bases = leftFlank.substr(10) + "CAGCAGCAGCAGCAG" + rightFlank.substr(0, 5);
+    const auto projectedAlign = decodeGraphAlignment(10, "0[10M20S]", &graph);
+    FragById fragById;
+    fragById.emplace(
+        "frag", Frag(Read(bases, string(bases.length(), 'I'), projectedAlign), Read("", "", projectedAlign)));
+
+    PairPathAlignById pairPathAlignById;
+    vector<ReadPathAlign> readAligns
+        = { ReadPathAlign(diplotype.front(), 0, 0, GraphAlignPtr(new GraphAlign(projectedAlign))) };
+    pairPathAlignById.emplace("frag", PairPathAlign(readAligns, vector<ReadPathAlign>()));
+
+    REQUIRE(realignPoorAligns(diplotype, fragById, pairPathAlignById, std::chrono::seconds(10)) == 1);
+
+    const auto& realigned = pairPathAlignById.at("frag").readAligns.front();
+    const auto expectedAlign = decodeGraphAlignment(10, "0[10M]1[3M]1[3M]1[3M]1[3M]1[3M]2[5M]", &graph);
+    REQUIRE(*realigned.align == expectedAlign);
+    REQUIRE(realigned.startIndexOnPath == 0);
+    REQUIRE(realigned.begin == 10);
+    REQUIRE(realigned.end == 40);
+}
@@ -0,0 +1,336 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/RepeatLengthSearch.hh"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "app/Projection.hh"
+
+using graphtools::NodeId;
+using graphtools::Path;
+using std::map;
+using std::vector;
+
+namespace
+{
+
+using NodeVector = vector<NodeId>;
+using PairScores = vector<int>;
+
+struct RepeatVariant
+{
+    NodeId node;
+    vector<int> lengths;
+    vector<RepeatLengthInterval> intervals;
+};
+
+// Properties of fragment alignments that determine whether their projection depends on a repeat length
+struct RepeatOverlap
+{
+    bool spansRepeat;
+    int maxNumMotifs;
+};
+
+class DiplotypeScorer
+{
+public:
+    DiplotypeScorer(const FragById& fragById, const vector<RepeatVariant>& variants);
+
+    /// Scores of all fragments projected onto the haplotype
+    const PairScores& getPairScores(const Path& haplotype);
+
+    /// Scores of all fragments projected onto a haplotype differing from baseHaplotype by the length of one repeat
+    const PairScores& getPairScores(
+        const Path& haplotype, const Path& baseHaplotype, int variantIndex, int baseLength, int length);
+
+    int score(const vector<const PairScores*>& pairScoresByHaplotype) const;
+
+private:
+    int computePairScore(int fragIndex, const Path& haplotype) const;
+
+    vector<const Frag*> frags_;
+    // Overlap of each fragment with each repeat variant
+    vector<vector<RepeatOverlap>> overlapsByFrag_;
+    map<NodeVector, PairScores> pairScoresByHaplotype_;
+};
+
+}
+
+static RepeatOverlap getRepeatOverlap(const GraphAlign& align, NodeId repeatNode)
+{
+    const auto& nodes = align.path().nodeIds();
+    const bool spansRepeat = nodes.front() < repeatNode && repeatNode < nodes.back();
+    const int numMotifs = std::count(nodes.begin(), nodes.end(), repeatNode);
+    return { spansRepeat, numMotifs };
+}
+
+DiplotypeScorer::DiplotypeScorer(const FragById& fragById, const vector<RepeatVariant>& variants)
+{
+    for (const auto& fragIdAndFrag : fragById)
+    {
+        const Frag& frag = fragIdAndFrag.second;
+        vector<RepeatOverlap> overlaps;
+        for (const auto& variant : variants)
+        {
+            const auto readOverlap = getRepeatOverlap(frag.read.align, variant.node);
+            const auto mateOverlap = getRepeatOverlap(frag.mate.align, variant.node);
+            overlaps.push_back({ readOverlap.spansRepeat || mateOverlap.spansRepeat,
+                                 std::max(readOverlap.maxNumMotifs, mateOverlap.maxNumMotifs) });
+        }
+        frags_.push_back(&frag);
+        overlapsByFrag_.push_back(overlaps);
+    }
+}
+
+int DiplotypeScorer::computePairScore(int fragIndex, const Path& haplotype) const
+{
+    return scorePairProjection(*frags_[fragIndex], haplotype);
+}
+
+const PairScores& DiplotypeScorer::getPairScores(const Path& haplotype)
+{
+    auto pairScoresIt = pairScoresByHaplotype_.find(haplotype.nodeIds());
+    if (pairScoresIt != pairScoresByHaplotype_.end())
+    {
+        return pairScoresIt->second;
+    }
+
+    PairScores pairScores;
+    pairScores.reserve(frags_.size());
+    for (int fragIndex = 0; fragIndex != static_cast<int>(frags_.size()); ++fragIndex)
+    {
+        pairScores.push_back(computePairScore(fragIndex, haplotype));
+    }
+
+    return pairScoresByHaplotype_.emplace(haplotype.nodeIds(), std::move(pairScores)).first->second;
+}
+
+const PairScores& DiplotypeScorer::getPairScores(
+    const Path& haplotype, const Path& baseHaplotype, int variantIndex, int baseLength, int length)
+{
+    auto pairScoresIt = pairScoresByHaplotype_.find(haplotype.nodeIds());
+    if (pairScoresIt != pairScoresByHaplotype_.end())
+    {
+        return pairScoresIt->second;
+    }
+
+    // Fragments that neither span the repeat nor contain more motifs than either haplotype are projected identically
+    PairScores pairScores = getPairScores(baseHaplotype);
+    const int minLength = std::min(baseLength, length);
+    for (int fragIndex = 0; fragIndex != static_cast<int>(frags_.size()); ++fragIndex)
+    {
+        const RepeatOverlap& overlap = overlapsByFrag_[fragIndex][variantIndex];
+        if (overlap.spansRepeat || overlap.maxNumMotifs > minLength)
+        {
+            pairScores[fragIndex] = computePairScore(fragIndex, haplotype);
+        }
+    }
+
+    return pairScoresByHaplotype_.emplace(haplotype.nodeIds(), std::move(pairScores)).first->second;
+}
+
+// Each fragment contributes its best pair score once for every haplotype achieving it (see project and scorePath)
+int DiplotypeScorer::score(const vector<const PairScores*>& pairScoresByHaplotype) const
+{
+    int diplotypeScore = 0;
+    for (int fragIndex = 0; fragIndex != static_cast<int>(frags_.size()); ++fragIndex)
+    {
+        int bestPairScore = kNoPairScore;
+        int numBestHaplotypes = 0;
+        for (const PairScores* pairScores : pairScoresByHaplotype)
+        {
+            const int pairScore = (*pairScores)[fragIndex];
+            if (pairScore == kNoPairScore)
+            {
+                continue;
+            }
+            if (pairScore > bestPairScore)
+            {
+                bestPairScore = pairScore;
+                numBestHaplotypes = 0;
+            }
+            if (pairScore == bestPairScore)
+            {
+                ++numBestHaplotypes;
+            }
+        }
+
+        if (numBestHaplotypes)
+        {
+            diplotypeScore += numBestHaplotypes * bestPairScore;
+        }
+    }
+
+    return diplotypeScore;
+}
+
+static vector<RepeatVariant>
+getRepeatVariants(int meanFragLen, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec)
+{
+    vector<RepeatVariant> variants;
+    for (const auto& variantSpec : locusSpec.variantSpecs())
+    {
+        if (variantSpec.classification().type != VariantType::kRepeat)
+        {
+            continue;
+        }
+
+        RepeatVariant variant;
+        variant.node = variantSpec.nodes().front();
+        for (int length : genotypes.getRepeatLengths(variantSpec.id()))
+        {
+            variant.lengths.push_back(std::min(length, meanFragLen));
+        }
+        for (const auto& interval : genotypes.getRepeatLengthIntervals(variantSpec.id()))
+        {
+            variant.intervals.emplace_back(
+                std::min(interval.first, meanFragLen), std::min(interval.second, meanFragLen));
+        }
+        if (variant.intervals.size() != variant.lengths.size())
+        {
+            throw std::runtime_error(
+                "REPCN and REPCI fields of " + variantSpec.id() + " have different numbers of alleles");
+        }
+        variants.push_back(variant);
+    }
+
+    return variants;
+}
+
+static int countMotifs(const Path& haplotype, NodeId repeatNode)
+{
+    return std::count(haplotype.nodeIds().begin(), haplotype.nodeIds().end(), repeatNode);
+}
+
+static Path setRepeatLength(const Path& haplotype, NodeId repeatNode, int length)
+{
+    NodeVector nodes = haplotype.nodeIds();
+    nodes.erase(std::remove(nodes.begin(), nodes.end(), repeatNode), nodes.end());
+    nodes.insert(std::lower_bound(nodes.begin(), nodes.end(), repeatNode), length, repeatNode);
+    return Path(haplotype.graphRawPtr(), haplotype.startPosition(), nodes, haplotype.endPosition());
+}
+
+// Confidence intervals constraining the repeat lengths of each haplotype, assigned by matching REPCN values
+static vector<vector<RepeatLengthInterval>>
+getHaplotypeIntervals(const Diplotype& diplotype, const vector<RepeatVariant>& variants)
+{
+    vector<vector<RepeatLengthInterval>> intervalsByHaplotype(diplotype.size());
+    for (const auto& variant : variants)
+    {
+        vector<bool> isAlleleUsed(variant.lengths.size(), false);
+        for (int hapIndex = 0; hapIndex != static_cast<int>(diplotype.size()); ++hapIndex)
+        {
+            const int length = countMotifs(diplotype[hapIndex], variant.node);
+            RepeatLengthInterval interval(length, length);
+            for (int alleleIndex = 0; alleleIndex != static_cast<int>(variant.lengths.size()); ++alleleIndex)
+            {
+                if (!isAlleleUsed[alleleIndex] && variant.lengths[alleleIndex] == length)
+                {
+                    isAlleleUsed[alleleIndex] = true;
+                    interval = variant.intervals[alleleIndex];
+                    break;
+                }
+            }
+            intervalsByHaplotype[hapIndex].push_back(interval);
+        }
+    }
+
+    return intervalsByHaplotype;
+}
+
+ScoredDiplotype searchRepeatLengths(
+    int meanFragLen, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec, const FragById& fragById,
+    const Diplotype& startDiplotype)
+{
+    const auto variants = getRepeatVariants(meanFragLen, genotypes, locusSpec);
+    const auto intervalsByHaplotype = getHaplotypeIntervals(startDiplotype, variants);
+    DiplotypeScorer scorer(fragById, variants);
+
+    Diplotype diplotype = startDiplotype;
+    vector<const PairScores*> pairScoresByHaplotype;
+    for (const auto& haplotype : diplotype)
+    {
+        pairScoresByHaplotype.push_back(&scorer.getPairScores(haplotype));
+    }
+    int diplotypeScore = scorer.score(pairScoresByHaplotype);
+
+    while (true)
+    {
+        int bestHapIndex = -1;
+        Path bestHaplotype = diplotype.front();
+        const PairScores* bestPairScores = nullptr;
+        int bestScore = diplotypeScore;
+
+        for (int hapIndex = 0; hapIndex != static_cast<int>(diplotype.size()); ++hapIndex)
+        {
+            for (int variantIndex = 0; variantIndex != static_cast<int>(variants.size()); ++variantIndex)
+            {
+                const NodeId repeatNode = variants[variantIndex].node;
+                const auto& interval = intervalsByHaplotype[hapIndex][variantIndex];
+                const int length = countMotifs(diplotype[hapIndex], repeatNode);
+                for (int neighbourLength : { length - 1, length + 1 })
+                {
+                    if (neighbourLength < interval.first || interval.second < neighbourLength)
+                    {
+                        continue;
+                    }
+
+                    Path neighbour = setRepeatLength(diplotype[hapIndex], repeatNode, neighbourLength);
+                    const PairScores& neighbourPairScores
+                        = scorer.getPairScores(neighbour, diplotype[hapIndex], variantIndex, length, neighbourLength);
+
+                    auto neighbourPairScoresByHaplotype = pairScoresByHaplotype;
+                    neighbourPairScoresByHaplotype[hapIndex] = &neighbourPairScores;
+                    const int neighbourScore = scorer.score(neighbourPairScoresByHaplotype);
+                    if (neighbourScore > bestScore)
+                    {
+                        bestHapIndex = hapIndex;
+                        bestHaplotype = neighbour;
+                        bestPairScores = &neighbourPairScores;
+                        bestScore = neighbourScore;
+                    }
+                }
+            }
+        }
+
+        if (bestHapIndex == -1)
+        {
+            break;
+        }
+
+        spdlog::debug("Repeat length search improved diplotype score from {} to {}", diplotypeScore, bestScore);
+        diplotype[bestHapIndex] = bestHaplotype;
+        pairScoresByHaplotype[bestHapIndex] = bestPairScores;
+        diplotypeScore = bestScore;
+    }
+
+    // Keep haplotypes in the same order as getCandidateDiplotypes
+    if (diplotype.front() < diplotype.back())
+    {
+        std::iter_swap(diplotype.begin(), diplotype.end() - 1);
+    }
+
+    return ScoredDiplotype(diplotype, diplotypeScore);
+}
@@ -0,0 +1,44 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include "app/Aligns.hh"
+#include "app/GenotypePaths.hh"
+#include "app/Phasing.hh"
+#include "core/LocusSpecification.hh"
+
+/// Searches repeat lengths inside the REPCI confidence intervals for a diplotype that explains the reads better
+///
+/// Starting from the given diplotype, each step changes the length of one repeat allele by a single motif and moves
+/// to the highest-scoring such neighbour. The search stops as soon as no neighbour improves the score. Scores of
+/// fragments are cached per haplotype, and a neighbouring haplotype only rescores fragments whose projection depends
+/// on the changed repeat length (i.e. fragments spanning the repeat or containing more motifs than the shorter of the
+/// two lengths). Diplotype scores are identical to those of scoreDiplotypes.
+///
+/// \param meanFragLen: Mean fragment length; repeat lengths are capped by it as for candidate diplotypes
+/// \param genotypes: Repeat genotypes of the sample
+/// \param locusSpec: Locus specification
+/// \param fragById: Fragments at the locus
+/// \param startDiplotype: Diplotype to start the search from
+/// \return Highest-scoring diplotype found and its score
+ScoredDiplotype searchRepeatLengths(
+    int meanFragLen, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec, const FragById& fragById,
+    const Diplotype& startDiplotype);
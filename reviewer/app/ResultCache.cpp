@@ -0,0 +1,176 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/ResultCache.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "spdlog/spdlog.h"
+#include "thirdparty/json/json.hpp"
+
+using boost::optional;
+using std::string;
+using std::vector;
+
+using Json = nlohmann::json;
+
+namespace fs = boost::filesystem;
+
+const int ResultCache::kAlgorithmVersion = 3;
+
+static Json encodeLanePlots(const vector<LanePlot>& lanePlots)
+{
+    Json lanePlotsJson = Json::array();
+    for (const auto& lanePlot : lanePlots)
+    {
+        Json lanesJson = Json::array();
+        for (const auto& lane : lanePlot)
+        {
+            Json segmentsJson = Json::array();
+            for (const auto& segment : lane.segments)
+            {
+                Json featuresJson = Json::array();
+                for (const auto& feature : segment.features)
+                {
+                    Json featureJson = { { "type", static_cast<int>(feature.type) },
+                                         { "length", feature.length },
+                                         { "fill", feature.fill },
+                                         { "stroke", feature.stroke } };
+                    if (feature.label)
+                    {
+                        featureJson["label"] = *feature.label;
+                    }
+                    featuresJson.push_back(featureJson);
+                }
+                segmentsJson.push_back(
+                    { { "start", segment.start }, { "opacity", segment.opacity }, { "features", featuresJson } });
+            }
+            lanesJson.push_back({ { "height", lane.height }, { "segments", segmentsJson } });
+        }
+        lanePlotsJson.push_back(lanesJson);
+    }
+
+    return lanePlotsJson;
+}
+
+static vector<LanePlot> decodeLanePlots(const Json& lanePlotsJson)
+{
+    vector<LanePlot> lanePlots;
+    for (const auto& lanesJson : lanePlotsJson)
+    {
+        LanePlot lanePlot;
+        for (const auto& laneJson : lanesJson)
+        {
+            vector<Segment> segments;
+            for (const auto& segmentJson : laneJson["segments"])
+            {
+                vector<Feature> features;
+                for (const auto& featureJson : segmentJson["features"])
+                {
+                    features.emplace_back(
+                        static_cast<FeatureType>(featureJson["type"].get<int>()), featureJson["length"].get<int>(),
+                        featureJson["fill"].get<string>(), featureJson["stroke"].get<string>());
+                    if (featureJson.find("label") != featureJson.end())
+                    {
+                        features.back().label = featureJson["label"].get<string>();
+                    }
+                }
+                segments.emplace_back(
+                    segmentJson["start"].get<int>(), std::move(features), segmentJson["opacity"].get<double>());
+            }
+            lanePlot.emplace_back(laneJson["height"].get<int>(), std::move(segments));
+        }
+        lanePlots.push_back(std::move(lanePlot));
+    }
+
+    return lanePlots;
+}
+
+ResultCache::ResultCache(string cacheDir)
+    : cacheDir_(std::move(cacheDir))
+{
+    fs::create_directories(cacheDir_);
+}
+
+string ResultCache::getEntryPath(const string& key) const { return (fs::path(cacheDir_) / (key + ".json")).string(); }
+
+bool ResultCache::contains(const string& key) const { return fs::exists(getEntryPath(key)); }
+
+optional<CachedLocusResults> ResultCache::load(const string& key) const
+{
+    std::ifstream entryFile(getEntryPath(key));
+    if (!entryFile.is_open())
+    {
+        return boost::none;
+    }
+
+    try
+    {
+        Json entryJson;
+        entryFile >> entryJson;
+
+        CachedLocusResults results;
+        results.metricsRows = entryJson["metrics"].get<vector<string>>();
+        results.phasingRows = entryJson["phasing"].get<vector<string>>();
+        if (entryJson.find("lanePlots") != entryJson.end())
+        {
+            results.lanePlots = decodeLanePlots(entryJson["lanePlots"]);
+        }
+        return results;
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::warn("Ignoring unreadable cache entry {}: {}", getEntryPath(key), e.what());
+        return boost::none;
+    }
+}
+
+void ResultCache::store(const string& key, const CachedLocusResults& results) const
+{
+    Json entryJson = { { "metrics", results.metricsRows }, { "phasing", results.phasingRows } };
+    if (results.lanePlots)
+    {
+        entryJson["lanePlots"] = encodeLanePlots(*results.lanePlots);
+    }
+
+    // Entries are written under a temporary name and renamed so that readers never observe partial entries; the name
+    // is random because pids of processes on different hosts sharing the cache can collide
+    const string entryPath = getEntryPath(key);
+    const string tempPath = entryPath + fs::unique_path(".%%%%-%%%%-%%%%-%%%%.tmp").string();
+    {
+        std::ofstream entryFile(tempPath);
+        if (!entryFile.is_open())
+        {
+            throw std::runtime_error("Unable to open " + tempPath);
+        }
+        entryFile << entryJson;
+    }
+
+    if (std::rename(tempPath.c_str(), entryPath.c_str()) != 0)
+    {
+        std::remove(tempPath.c_str());
+        throw std::runtime_error("Unable to write cache entry " + entryPath);
+    }
+}
@@ -0,0 +1,54 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+#include "app/LanePlot.hh"
+
+struct CachedLocusResults
+{
+    std::vector<std::string> metricsRows;
+    std::vector<std::string> phasingRows;
+    boost::optional<std::vector<LanePlot>> lanePlots;
+};
+
+/// On-disk cache of per-locus results addressed by the hash of the locus inputs
+class ResultCache
+{
+public:
+    explicit ResultCache(std::string cacheDir);
+
+    bool contains(const std::string& key) const;
+    boost::optional<CachedLocusResults> load(const std::string& key) const;
+    void store(const std::string& key, const CachedLocusResults& results) const;
+
+    // Bumped whenever a change to the analysis invalidates previously cached results
+    static const int kAlgorithmVersion;
+
+private:
+    std::string getEntryPath(const std::string& key) const;
+
+    std::string cacheDir_;
+};
@@ -0,0 +1,124 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/SamplePanel.hh"
+
+#include <algorithm>
+
+#include "app/GenerateSvg.hh"
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+const int kPanelTitleHeight = 16;
+// Haplotypes of a sample are drawn closer together than the samples themselves
+const int kSpacingBetweenHaplotypes = 20;
+
+static string escapeXml(const string& text)
+{
+    string escaped;
+    for (char letter : text)
+    {
+        if (letter == '&')
+        {
+            escaped += "&amp;";
+        }
+        else if (letter == '<')
+        {
+            escaped += "&lt;";
+        }
+        else if (letter == '>')
+        {
+            escaped += "&gt;";
+        }
+        else
+        {
+            escaped += letter;
+        }
+    }
+    return escaped;
+}
+
+static int getPanelHeight(const SamplePanel& panel)
+{
+    int height = kPanelTitleHeight + kSpacingBetweenLanes;
+    for (int plotIndex = 0; plotIndex != static_cast<int>(panel.lanePlots.size()); ++plotIndex)
+    {
+        if (plotIndex != 0)
+        {
+            height += kSpacingBetweenHaplotypes;
+        }
+        for (const auto& lane : panel.lanePlots[plotIndex])
+        {
+            height += lane.height + kSpacingBetweenLanes;
+        }
+    }
+    return height;
+}
+
+void generatePanelSvg(const vector<SamplePanel>& panels, ostream& out)
+{
+    int width = 0;
+    int height = 0;
+    for (const auto& panel : panels)
+    {
+        for (const auto& lanePlot : panel.lanePlots)
+        {
+            width = std::max(width, getExtent(lanePlot).width);
+        }
+        if (height != 0)
+        {
+            height += kSpacingBetweenLanePlots;
+        }
+        height += getPanelHeight(panel);
+    }
+
+    out << "<svg width=\"" << width * kBaseWidth + 2 * kPlotPadX << "\" height=\"" << height + 2 * kPlotPadY << "\""
+        << " xmlns=\"http://www.w3.org/2000/svg\">\n";
+    generateSvgDefs(out);
+
+    SvgPatternIds patternIds;
+    int yPos = kPlotPadY;
+    for (const auto& panel : panels)
+    {
+        out << "<text x=\"" << kPlotPadX << "\" y=\"" << yPos + kPanelTitleHeight / 2 << "\"";
+        out << " dy=\"0.25em\" font-family=\"monospace\" font-size=\"13px\" font-weight=\"bold\">";
+        out << escapeXml(panel.title) << "</text>\n";
+        yPos += kPanelTitleHeight + kSpacingBetweenLanes;
+
+        for (int plotIndex = 0; plotIndex != static_cast<int>(panel.lanePlots.size()); ++plotIndex)
+        {
+            if (plotIndex != 0)
+            {
+                yPos += kSpacingBetweenHaplotypes;
+            }
+            for (const auto& lane : panel.lanePlots[plotIndex])
+            {
+                drawLane(out, kBaseWidth, kPlotPadX, yPos, lane, patternIds);
+                yPos += lane.height + kSpacingBetweenLanes;
+            }
+        }
+
+        yPos += kSpacingBetweenLanePlots;
+    }
+
+    out << "</svg>" << std::endl;
+}
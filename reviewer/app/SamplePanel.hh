@@ -0,0 +1,39 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "app/LanePlot.hh"
+
+/// Plots of one sample in a panel of samples analyzed at the same locus
+struct SamplePanel
+{
+    std::string title;
+    std::vector<LanePlot> lanePlots;
+};
+
+/// Writes SVG image with the panels stacked on top of each other
+///
+/// Gradients and markers are defined once and shared by the plots of all panels.
+void generatePanelSvg(const std::vector<SamplePanel>& panels, std::ostream& out);
@@ -0,0 +1,298 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/VcfGenotypeIndex.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+static const int kFormatColumn = 8;
+static const int kFirstSampleColumn = 9;
+
+VcfGenotypeIndex::VcfGenotypeIndex(const string& vcfPath)
+{
+    if (boost::algorithm::ends_with(vcfPath, "gz"))
+    {
+        std::ifstream vcfFile(vcfPath, std::ios::binary);
+        if (!vcfFile.is_open())
+        {
+            throw runtime_error("Unable to open file " + vcfPath);
+        }
+        boost::iostreams::filtering_istreambuf bufferedInputStream;
+        bufferedInputStream.push(boost::iostreams::gzip_decompressor());
+        bufferedInputStream.push(vcfFile);
+        std::istream decompressedStream(&bufferedInputStream);
+        parse(decompressedStream);
+    }
+    else
+    {
+        std::ifstream vcfFile(vcfPath);
+        if (!vcfFile.is_open())
+        {
+            throw runtime_error("Unable to open file " + vcfPath);
+        }
+        parse(vcfFile);
+    }
+}
+
+static string getVariantId(const string& infoField)
+{
+    vector<string> entries;
+    boost::split(entries, infoField, boost::is_any_of(";"));
+    for (const auto& entry : entries)
+    {
+        if (boost::starts_with(entry, "VARID="))
+        {
+            return entry.substr(6);
+        }
+    }
+
+    return "";
+}
+
+static int findFormatKey(const vector<string>& formatKeys, const string& key)
+{
+    auto keyIter = std::find(formatKeys.begin(), formatKeys.end(), key);
+    return keyIter != formatKeys.end() ? static_cast<int>(keyIter - formatKeys.begin()) : -1;
+}
+
+// Parses the whole of the encoding as a base-10 integer
+static bool parseInt(const string& encoding, int& value)
+{
+    if (encoding.empty())
+    {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    const long parsedValue = std::strtol(encoding.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || parsedValue < INT32_MIN || parsedValue > INT32_MAX)
+    {
+        return false;
+    }
+    value = static_cast<int>(parsedValue);
+    return true;
+}
+
+VcfGenotypeIndex::AlleleValues<int> VcfGenotypeIndex::parseRepeatLengths(const string& encoding)
+{
+    AlleleValues<int> repeatLengths = { FieldStatus::kPresent, 0, {} };
+    if (encoding.empty())
+    {
+        repeatLengths.status = FieldStatus::kMissingField;
+        return repeatLengths;
+    }
+    if (encoding == "./.")
+    {
+        repeatLengths.status = FieldStatus::kMissingCall;
+        return repeatLengths;
+    }
+
+    vector<string> pieces;
+    boost::split(pieces, encoding, boost::is_any_of("/"));
+    if (pieces.size() > kMaxAlleles)
+    {
+        repeatLengths.status = FieldStatus::kMalformedField;
+        return repeatLengths;
+    }
+    for (const auto& piece : pieces)
+    {
+        if (!parseInt(piece, repeatLengths.values[repeatLengths.numAlleles++]))
+        {
+            repeatLengths.status = FieldStatus::kMalformedField;
+            return repeatLengths;
+        }
+    }
+    return repeatLengths;
+}
+
+VcfGenotypeIndex::AlleleValues<RepeatLengthInterval>
+VcfGenotypeIndex::parseRepeatLengthIntervals(const string& encoding)
+{
+    AlleleValues<RepeatLengthInterval> intervals = { FieldStatus::kPresent, 0, {} };
+    if (encoding.empty())
+    {
+        intervals.status = FieldStatus::kMissingField;
+        return intervals;
+    }
+    if (encoding == "./.")
+    {
+        intervals.status = FieldStatus::kMissingCall;
+        return intervals;
+    }
+
+    vector<string> pieces;
+    boost::split(pieces, encoding, boost::is_any_of("/"));
+    if (pieces.size() > kMaxAlleles)
+    {
+        intervals.status = FieldStatus::kMalformedField;
+        return intervals;
+    }
+    vector<string> bounds;
+    for (const auto& piece : pieces)
+    {
+        boost::split(bounds, piece, boost::is_any_of("-"));
+        auto& interval = intervals.values[intervals.numAlleles++];
+        if (bounds.size() != 2 || !parseInt(bounds[0], interval.first) || !parseInt(bounds[1], interval.second))
+        {
+            intervals.status = FieldStatus::kMalformedField;
+            return intervals;
+        }
+    }
+    return intervals;
+}
+
+void VcfGenotypeIndex::parse(std::istream& vcfStream)
+{
+    string line;
+    vector<string> pieces;
+    vector<string> formatKeys;
+    vector<string> sampleValues;
+    while (getline(vcfStream, line))
+    {
+        if (boost::starts_with(line, "##"))
+        {
+            continue;
+        }
+
+        boost::split(pieces, line, boost::is_any_of("\t"));
+        if (boost::starts_with(line, "#"))
+        {
+            for (int column = kFirstSampleColumn; column < static_cast<int>(pieces.size()); ++column)
+            {
+                sampleIndexById_.emplace(pieces[column], static_cast<int>(sampleIds_.size()));
+                sampleIds_.push_back(pieces[column]);
+            }
+            continue;
+        }
+
+        const string variantId = pieces.size() > kFormatColumn ? getVariantId(pieces[7]) : "";
+        // Only the first record of each variant is used
+        if (variantId.empty() || variantIndexById_.count(variantId))
+        {
+            continue;
+        }
+        variantIndexById_.emplace(variantId, static_cast<int>(variantIndexById_.size()));
+
+        // Malformed records are reported only if a locus looks the variant up
+        if (pieces.size() < kFirstSampleColumn + sampleIds_.size())
+        {
+            const AlleleValues<int> malformedLengths = { FieldStatus::kMalformedRecord, 0, {} };
+            const AlleleValues<RepeatLengthInterval> malformedIntervals = { FieldStatus::kMalformedRecord, 0, {} };
+            repeatLengths_.insert(repeatLengths_.end(), sampleIds_.size(), malformedLengths);
+            repeatLengthIntervals_.insert(repeatLengthIntervals_.end(), sampleIds_.size(), malformedIntervals);
+            continue;
+        }
+
+        boost::split(formatKeys, pieces[kFormatColumn], boost::is_any_of(":"));
+        const int repcnIndex = findFormatKey(formatKeys, "REPCN");
+        const int repciIndex = findFormatKey(formatKeys, "REPCI");
+        for (int sampleIndex = 0; sampleIndex != static_cast<int>(sampleIds_.size()); ++sampleIndex)
+        {
+            boost::split(sampleValues, pieces[kFirstSampleColumn + sampleIndex], boost::is_any_of(":"));
+            const int numValues = static_cast<int>(sampleValues.size());
+            repeatLengths_.push_back(
+                0 <= repcnIndex && repcnIndex < numValues
+                    ? parseRepeatLengths(sampleValues[repcnIndex])
+                    : AlleleValues<int> { FieldStatus::kMissingField, 0, {} });
+            repeatLengthIntervals_.push_back(
+                0 <= repciIndex && repciIndex < numValues
+                    ? parseRepeatLengthIntervals(sampleValues[repciIndex])
+                    : AlleleValues<RepeatLengthInterval> { FieldStatus::kMissingField, 0, {} });
+        }
+    }
+}
+
+int VcfGenotypeIndex::getSampleIndex(const string& sampleId) const
+{
+    if (sampleIds_.empty())
+    {
+        throw runtime_error("VCF file contains no samples");
+    }
+    if (sampleId.empty())
+    {
+        return 0;
+    }
+
+    auto sampleIndexIt = sampleIndexById_.find(sampleId);
+    if (sampleIndexIt == sampleIndexById_.end())
+    {
+        throw runtime_error("VCF file contains no sample " + sampleId);
+    }
+    return sampleIndexIt->second;
+}
+
+template <typename T>
+const VcfGenotypeIndex::AlleleValues<T>& VcfGenotypeIndex::getValue(
+    const vector<AlleleValues<T>>& column, const string& fieldName, const string& repeatId, int sampleIndex) const
+{
+    auto variantIndexIt = variantIndexById_.find(repeatId);
+    if (variantIndexIt == variantIndexById_.end())
+    {
+        throw runtime_error("No VCF record for " + repeatId);
+    }
+
+    const auto& value = column[variantIndexIt->second * sampleIds_.size() + sampleIndex];
+    switch (value.status)
+    {
+    case FieldStatus::kMalformedRecord:
+        throw runtime_error("Malformed VCF record for " + repeatId);
+    case FieldStatus::kMissingField:
+        throw runtime_error("Missing " + fieldName + " field for " + repeatId);
+    case FieldStatus::kMalformedField:
+        throw runtime_error("Malformed " + fieldName + " field for " + repeatId);
+    default:
+        return value;
+    }
+}
+
+vector<int> VcfGenotypeIndex::getRepeatLengths(const string& repeatId, int sampleIndex) const
+{
+    const auto& repeatLengths = getValue(repeatLengths_, "REPCN", repeatId, sampleIndex);
+    if (repeatLengths.status == FieldStatus::kMissingCall)
+    {
+        throw runtime_error("Cannot create a plot because the genotype of " + repeatId + " is missing");
+    }
+
+    return vector<int>(repeatLengths.values, repeatLengths.values + repeatLengths.numAlleles);
+}
+
+vector<RepeatLengthInterval> VcfGenotypeIndex::getRepeatLengthIntervals(const string& repeatId, int sampleIndex) const
+{
+    const auto& intervals = getValue(repeatLengthIntervals_, "REPCI", repeatId, sampleIndex);
+    if (intervals.status == FieldStatus::kMissingCall)
+    {
+        throw runtime_error("Confidence intervals of " + repeatId + " are missing");
+    }
+
+    return vector<RepeatLengthInterval>(intervals.values, intervals.values + intervals.numAlleles);
+}
@@ -0,0 +1,119 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Lower and upper bounds of the confidence interval of a repeat length
+using RepeatLengthInterval = std::pair<int, int>;
+
+/// Repeat genotypes of all samples in a (possibly multi-sample) VCF file generated by ExpansionHunter
+///
+/// The file is parsed once. REPCN and REPCI values are parsed into fixed-width columns indexed by variant and sample,
+/// so looking up a genotype takes constant time regardless of the number of variants and samples. Missing or
+/// malformed values are reported when they are looked up, so they only affect the loci that use them.
+class VcfGenotypeIndex
+{
+public:
+    explicit VcfGenotypeIndex(const std::string& vcfPath);
+    explicit VcfGenotypeIndex(std::istream& vcfStream) { parse(vcfStream); }
+
+    const std::vector<std::string>& sampleIds() const { return sampleIds_; }
+
+    /// \param sampleId: Sample name from the VCF header or an empty string for the first sample
+    /// \return Column index of the sample
+    int getSampleIndex(const std::string& sampleId) const;
+
+    /// \return Repeat length of each allele (REPCN field)
+    std::vector<int> getRepeatLengths(const std::string& repeatId, int sampleIndex) const;
+
+    /// \return Confidence interval of the length of each allele (REPCI field)
+    std::vector<RepeatLengthInterval> getRepeatLengthIntervals(const std::string& repeatId, int sampleIndex) const;
+
+private:
+    enum class FieldStatus : uint8_t
+    {
+        kPresent,
+        kMissingField,
+        kMissingCall,
+        kMalformedField,
+        kMalformedRecord
+    };
+
+    // ExpansionHunter reports at most two alleles per variant
+    static const int kMaxAlleles = 2;
+
+    template <typename T> struct AlleleValues
+    {
+        FieldStatus status;
+        uint8_t numAlleles;
+        T values[kMaxAlleles];
+    };
+
+    void parse(std::istream& vcfStream);
+    static AlleleValues<int> parseRepeatLengths(const std::string& encoding);
+    static AlleleValues<RepeatLengthInterval> parseRepeatLengthIntervals(const std::string& encoding);
+
+    template <typename T>
+    const AlleleValues<T>& getValue(
+        const std::vector<AlleleValues<T>>& column, const std::string& fieldName, const std::string& repeatId,
+        int sampleIndex) const;
+
+    std::vector<std::string> sampleIds_;
+    std::unordered_map<std::string, int> sampleIndexById_;
+    std::unordered_map<std::string, int> variantIndexById_;
+
+    // Value of variant v in sample s is stored at v * numSamples + s
+    std::vector<AlleleValues<int>> repeatLengths_;
+    std::vector<AlleleValues<RepeatLengthInterval>> repeatLengthIntervals_;
+};
+
+/// Repeat genotypes of a single sample of a genotype index
+class SampleGenotypes
+{
+public:
+    SampleGenotypes(const VcfGenotypeIndex& genotypeIndex, int sampleIndex)
+        : genotypeIndex_(genotypeIndex)
+        , sampleIndex_(sampleIndex)
+    {
+    }
+
+    const std::string& sampleId() const { return genotypeIndex_.sampleIds()[sampleIndex_]; }
+
+    std::vector<int> getRepeatLengths(const std::string& repeatId) const
+    {
+        return genotypeIndex_.getRepeatLengths(repeatId, sampleIndex_);
+    }
+
+    std::vector<RepeatLengthInterval> getRepeatLengthIntervals(const std::string& repeatId) const
+    {
+        return genotypeIndex_.getRepeatLengthIntervals(repeatId, sampleIndex_);
+    }
+
+private:
+    const VcfGenotypeIndex& genotypeIndex_;
+    int sampleIndex_;
+};
@@ -0,0 +1,218 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/WorkQueue.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <boost/filesystem.hpp>
+
+#include "spdlog/spdlog.h"
+
+using std::string;
+
+namespace fs = boost::filesystem;
+
+static string getOwnerName()
+{
+    char hostname[256] = { 0 };
+    if (gethostname(hostname, sizeof(hostname) - 1) != 0)
+    {
+        return "unknown:" + std::to_string(getpid());
+    }
+
+    return string(hostname) + ":" + std::to_string(getpid());
+}
+
+// Locus ids never start with a dot, so the merge task cannot collide with a locus
+const string WorkQueue::kMergeTaskId = ".merge";
+
+WorkQueue::WorkQueue(const string& queueDir, int leaseSeconds)
+    : leaseDir_((fs::path(queueDir) / "leases").string())
+    , resultDir_((fs::path(queueDir) / "results").string())
+    , results_(resultDir_)
+    , leaseSeconds_(leaseSeconds)
+    , owner_(getOwnerName())
+{
+    fs::create_directories(leaseDir_);
+}
+
+string WorkQueue::getLeasePath(const string& locusId) const
+{
+    return (fs::path(leaseDir_) / (locusId + ".lease")).string();
+}
+
+bool WorkQueue::isDone(const string& locusId) const { return results_.contains(locusId); }
+
+bool WorkQueue::tryCreateLease(const string& leasePath) const
+{
+    // O_EXCL makes lease creation atomic: exactly one of the competing processes succeeds
+    const int leaseFd = open(leasePath.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0644);
+    if (leaseFd == -1)
+    {
+        if (errno == EEXIST)
+        {
+            return false;
+        }
+        throw std::runtime_error("Unable to create lease " + leasePath);
+    }
+
+    const string content = owner_ + "\n";
+    const ssize_t numWritten = write(leaseFd, content.data(), content.size());
+    close(leaseFd);
+    if (numWritten != static_cast<ssize_t>(content.size()))
+    {
+        spdlog::warn("Unable to record owner of lease {}", leasePath);
+    }
+
+    return true;
+}
+
+bool WorkQueue::isExpired(const string& leasePath) const
+{
+    struct stat leaseStat;
+    if (stat(leasePath.c_str(), &leaseStat) != 0)
+    {
+        return false;
+    }
+
+    return std::difftime(std::time(nullptr), leaseStat.st_mtime) > leaseSeconds_;
+}
+
+bool WorkQueue::isOwned(const string& leasePath) const
+{
+    std::ifstream leaseFile(leasePath);
+    string owner;
+    return std::getline(leaseFile, owner) && owner == owner_;
+}
+
+bool WorkQueue::tryClaim(const string& locusId)
+{
+    const string leasePath = getLeasePath(locusId);
+    if (tryCreateLease(leasePath))
+    {
+        // The locus could have been finished between the caller's check and the lease creation
+        if (isDone(locusId))
+        {
+            std::remove(leasePath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    if (!isExpired(leasePath))
+    {
+        return false;
+    }
+
+    // Only one process can move the expired lease out of the way; it then competes for the lease like everyone else
+    const string expiredPath = leasePath + ".expired." + owner_;
+    if (std::rename(leasePath.c_str(), expiredPath.c_str()) != 0)
+    {
+        return false;
+    }
+
+    // Another process may have replaced the expired lease with a fresh one after we checked it; link() restores that
+    // lease without clobbering a lease created in the meantime
+    if (!isExpired(expiredPath))
+    {
+        if (link(expiredPath.c_str(), leasePath.c_str()) != 0)
+        {
+            spdlog::warn("Unable to restore lease of locus {} renewed by another process", locusId);
+        }
+        std::remove(expiredPath.c_str());
+        return false;
+    }
+    std::remove(expiredPath.c_str());
+    spdlog::warn("Reclaiming expired lease of locus {}", locusId);
+
+    return tryClaim(locusId);
+}
+
+bool WorkQueue::renew(const string& locusId) const
+{
+    const string leasePath = getLeasePath(locusId);
+    if (!isOwned(leasePath))
+    {
+        return false;
+    }
+
+    return utime(leasePath.c_str(), nullptr) == 0;
+}
+
+void WorkQueue::complete(const string& locusId, const CachedLocusResults& results)
+{
+    results_.store(locusId, results);
+    std::remove(getLeasePath(locusId).c_str());
+}
+
+CachedLocusResults WorkQueue::loadResults(const string& locusId) const
+{
+    auto results = results_.load(locusId);
+    if (!results)
+    {
+        throw std::runtime_error("No results for locus " + locusId + " in " + resultDir_);
+    }
+
+    return *results;
+}
+
+LeaseHeartbeat::LeaseHeartbeat(const WorkQueue& workQueue, string locusId, int leaseSeconds)
+    : locusId_(std::move(locusId))
+    , thread_(&LeaseHeartbeat::run, this, std::cref(workQueue), leaseSeconds)
+{
+}
+
+LeaseHeartbeat::~LeaseHeartbeat()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        isStopped_ = true;
+    }
+    stopped_.notify_one();
+    thread_.join();
+}
+
+void LeaseHeartbeat::run(const WorkQueue& workQueue, int leaseSeconds)
+{
+    // Several renewals fit into each lease period, so a delayed renewal does not let the lease expire
+    const auto interval = std::chrono::milliseconds(std::max(1000, leaseSeconds * 1000 / 3));
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopped_.wait_for(lock, interval, [this]() { return isStopped_; }))
+    {
+        if (!workQueue.renew(locusId_))
+        {
+            spdlog::warn("Lost lease of locus {}", locusId_);
+            return;
+        }
+    }
+}
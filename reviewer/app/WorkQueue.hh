@@ -0,0 +1,85 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "app/ResultCache.hh"
+
+/// Queue of loci shared by REViewer processes through a common directory
+///
+/// A process works on a locus after atomically creating its lease file. Leases older than the lease duration are
+/// assumed to belong to processes that died and can be claimed again. Results of each finished locus are stored as a
+/// separate fragment, so the presence of a fragment marks the locus as done. Leases of loci under analysis are
+/// renewed by a LeaseHeartbeat, so slow loci are not claimed by other processes.
+class WorkQueue
+{
+public:
+    /// Pseudo-locus claimed by the one process that merges the results of all loci
+    static const std::string kMergeTaskId;
+
+    WorkQueue(const std::string& queueDir, int leaseSeconds);
+
+    /// Name of this process (host and pid) that is unique among processes sharing the queue
+    const std::string& owner() const { return owner_; }
+
+    bool isDone(const std::string& locusId) const;
+    bool tryClaim(const std::string& locusId);
+    /// Resets the age of the lease of a claimed locus; \return false if the lease no longer belongs to this process
+    bool renew(const std::string& locusId) const;
+    void complete(const std::string& locusId, const CachedLocusResults& results);
+    CachedLocusResults loadResults(const std::string& locusId) const;
+
+private:
+    std::string getLeasePath(const std::string& locusId) const;
+    bool tryCreateLease(const std::string& leasePath) const;
+    bool isExpired(const std::string& leasePath) const;
+    bool isOwned(const std::string& leasePath) const;
+
+    std::string leaseDir_;
+    std::string resultDir_;
+    ResultCache results_;
+    int leaseSeconds_;
+    std::string owner_;
+};
+
+/// Renews the lease of a locus from a background thread for as long as the heartbeat exists
+class LeaseHeartbeat
+{
+public:
+    LeaseHeartbeat(const WorkQueue& workQueue, std::string locusId, int leaseSeconds);
+    ~LeaseHeartbeat();
+
+    LeaseHeartbeat(const LeaseHeartbeat&) = delete;
+    LeaseHeartbeat& operator=(const LeaseHeartbeat&) = delete;
+
+private:
+    void run(const WorkQueue& workQueue, int leaseSeconds);
+
+    std::string locusId_;
+    std::mutex mutex_;
+    std::condition_variable stopped_;
+    bool isStopped_ = false;
+    std::thread thread_;
+};
@@ -20,29 +20,51 @@
 
 #include "Workflow.hh"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
 #include <set>
 #include <stdlib.h>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
 
 #include "spdlog/spdlog.h"
 #include "thirdparty/json/json.hpp"
 
 #include "app/Aligns.hh"
 #include "app/CatalogLoading.hh"
+#include "app/ContentHash.hh"
 #include "app/FragLenFilter.hh"
 #include "app/GenerateSvg.hh"
 #include "app/GenotypePaths.hh"
+#include "app/HaplotypeBam.hh"
+#include "app/HtmlReport.hh"
+#include "app/KmerPreview.hh"
 #include "app/LanePlot.hh"
 #include "app/Origin.hh"
 #include "app/Phasing.hh"
+#include "app/PlotTiles.hh"
 #include "app/Projection.hh"
+#include "app/Realignment.hh"
+#include "app/RepeatLengthSearch.hh"
+#include "app/ResultCache.hh"
+#include "app/SamplePanel.hh"
+#include "app/VcfGenotypeIndex.hh"
+#include "app/WorkQueue.hh"
+#include "archive/PlotArchive.hh"
 #include "metrics/Metrics.hh"
+#include "metrics/MetricsStore.hh"
+#include "snps/FlankPhasing.hh"
 
 using boost::optional;
 using graphtools::Graph;
 using graphtools::GraphAlignment;
+using graphtools::NodeId;
 using graphtools::Operation;
 using graphtools::OperationType;
 using std::map;
@@ -73,68 +95,233 @@ class LocusResults
 {
 public:
     LocusResults(
-        const ScoredDiplotypes& scoredDiplotypes, vector<LanePlot> lanePlots, MetricsByVariant metricsByVariant)
-        : scoredDiplotypes_(std::move(scoredDiplotypes))
+        DiplotypeCodec diplotypeCodec, CompactScoredDiplotypes scoredDiplotypes, vector<LanePlot> lanePlots,
+        MetricsByVariant metricsByVariant)
+        : diplotypeCodec_(std::move(diplotypeCodec))
+        , scoredDiplotypes_(std::move(scoredDiplotypes))
         , lanePlots_(std::move(lanePlots))
         , metricsByVariant_(std::move(metricsByVariant))
     {
     }
 
-    const ScoredDiplotypes& scoredDiplotypes() const { return scoredDiplotypes_; }
+    const DiplotypeCodec& diplotypeCodec() const { return diplotypeCodec_; }
+    const CompactScoredDiplotypes& scoredDiplotypes() const { return scoredDiplotypes_; }
     const vector<LanePlot>& lanePlots() const { return lanePlots_; }
     const MetricsByVariant& metricsByVariant() const { return metricsByVariant_; }
 
 private:
-    ScoredDiplotypes scoredDiplotypes_;
+    DiplotypeCodec diplotypeCodec_;
+    CompactScoredDiplotypes scoredDiplotypes_;
     vector<LanePlot> lanePlots_;
     MetricsByVariant metricsByVariant_;
 };
 
-static LocusResults analyzeLocus(
-    const string& referencePath, const string& readsPath, const string& vcfPath, const string& locusId,
-    const LocusSpecification& locusSpec, bool onlyMetrics)
+// Preview mode ranks diplotypes without analyzing reads further, so it produces neither metrics nor plots
+static bool drawsPlots(const WorkflowArguments& args) { return !args.onlyMetrics && !args.kmerPreview; }
+
+// Alternatives to querying the reads file by region; either may be absent
+struct ReadsAccess
 {
-    spdlog::info("Loading specification of locus {}", locusId);
+    std::unique_ptr<BamletStore> bamletStore;
+    optional<XgLocusIndex> xgLocusIndex;
+    // Identifies the reads of each locus in result cache keys when neither alternative is available
+    std::unique_ptr<ReadChunkIndex> readChunkIndex;
+};
 
-    auto fragById = getAligns(readsPath, referencePath, locusSpec);
-    spdlog::info("Extracted {} frags", fragById.size());
+// Each locus draws fragment origins from its own seed, so its results do not depend on which loci were analyzed
+// before it or were loaded from the cache
+static unsigned getAssignmentSeed(const string& locusId)
+{
+    ContentHash hash;
+    hash.add(static_cast<int64_t>(14345));
+    hash.add(locusId);
+    return static_cast<unsigned>(hash.value());
+}
+
+static LocusResults analyzeFrags(
+    const WorkflowArguments& args, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec,
+    const FragById& fragById, LanePlotSink* plotSink, unsigned* assignmentSeed, const StageCallback& onStageEnd)
+{
+    const auto& locusId = locusSpec.locusId();
+    auto finishStage = [&onStageEnd](AnalysisStage stage)
+    {
+        if (onStageEnd)
+        {
+            onStageEnd(stage);
+        }
+    };
 
     spdlog::info("Calculating fragment length");
     const int meanFragLen = getMeanFragLen(fragById);
     spdlog::info("Fragment length is estimated to be {}", meanFragLen);
 
     spdlog::info("Extracting genotype paths");
-    auto pathsByDiplotype = getCandidateDiplotypes(meanFragLen, vcfPath, locusSpec);
+    auto pathsByDiplotype = getCandidateDiplotypes(meanFragLen, genotypes, locusSpec);
+    const DiplotypeCodec diplotypeCodec(locusSpec.regionGraph());
+
+    if (args.flankSnpPhasing)
+    {
+        const size_t numCandidates = pathsByDiplotype.size();
+        pathsByDiplotype = snps::pruneDiplotypesByFlankSnps(locusSpec, fragById, std::move(pathsByDiplotype));
+        spdlog::info(
+            "Kept {} of {} candidate diplotypes consistent with flank SNPs", pathsByDiplotype.size(), numCandidates);
+    }
+    finishStage(AnalysisStage::kCandidates);
+
+    if (args.kmerPreview)
+    {
+        spdlog::info("Ranking {} candidate diplotypes by k-mer counts", pathsByDiplotype.size());
+        auto previewDiplotypes = KmerPreview(pathsByDiplotype).rank(fragById);
+        return { diplotypeCodec, compactScoredDiplotypes(diplotypeCodec, previewDiplotypes, args.phasingTopK),
+                 vector<LanePlot>(), MetricsByVariant() };
+    }
+
+    optional<ScoredDiplotypes> previewDiplotypes;
+    const bool usesPrefilter
+        = args.kmerPrefilter > 0 && static_cast<int>(pathsByDiplotype.size()) > args.kmerPrefilter;
+    if (usesPrefilter && KmerPreview::countHaplotypes(pathsByDiplotype) > KmerPreview::kMaxHaplotypes)
+    {
+        spdlog::info(
+            "Scoring all {} candidate diplotypes because they have too many haplotypes for the k-mer prefilter",
+            pathsByDiplotype.size());
+    }
+    else if (usesPrefilter)
+    {
+        previewDiplotypes = KmerPreview(pathsByDiplotype).rank(fragById);
+        pathsByDiplotype = getTopDiplotypes(*previewDiplotypes, args.kmerPrefilter);
+        spdlog::info(
+            "Kept {} of {} candidate diplotypes ranked by k-mer counts", pathsByDiplotype.size(),
+            previewDiplotypes->size());
+    }
 
     spdlog::info("Phasing");
-    auto scoredDiplotypes = scoreDiplotypes(fragById, pathsByDiplotype);
-    auto topDiplotype = scoredDiplotypes.front().first; // scoredDiplotypes are sorted
+    auto scoredDiplotypes = scoreDiplotypes(fragById, pathsByDiplotype, args.numThreads);
+
+    if (args.searchRepeatIntervals)
+    {
+        spdlog::info("Searching repeat lengths within confidence intervals");
+        auto searchedDiplotype
+            = searchRepeatLengths(meanFragLen, genotypes, locusSpec, fragById, scoredDiplotypes.front().first);
+        if (searchedDiplotype.second > scoredDiplotypes.front().second)
+        {
+            std::ostringstream searchedEncoding, topEncoding;
+            searchedEncoding << searchedDiplotype.first;
+            topEncoding << scoredDiplotypes.front().first;
+            spdlog::info(
+                "Diplotype {} explains reads better than {} (score {} vs {})", searchedEncoding.str(),
+                topEncoding.str(), searchedDiplotype.second, scoredDiplotypes.front().second);
+            scoredDiplotypes.insert(scoredDiplotypes.begin(), searchedDiplotype);
+        }
+    }
+
+    if (previewDiplotypes)
+    {
+        const auto& topDiplotype = scoredDiplotypes.front().first;
+        auto previewRank = std::find_if(
+            previewDiplotypes->begin(), previewDiplotypes->end(),
+            [&topDiplotype](const ScoredDiplotype& diplotypeAndScore)
+            { return diplotypeAndScore.first == topDiplotype; });
+        spdlog::info(
+            "K-mer preview ranked the selected diplotype {} of {}", previewRank - previewDiplotypes->begin() + 1,
+            previewDiplotypes->size());
+        previewDiplotypes = boost::none;
+    }
+
+    // Only the compact encodings of the kept diplotypes outlive phasing; the top diplotype is materialized from them
+    auto phasedDiplotypes = compactScoredDiplotypes(diplotypeCodec, scoredDiplotypes, args.phasingTopK);
+    ScoredDiplotypes().swap(scoredDiplotypes);
+    vector<Diplotype>().swap(pathsByDiplotype);
+
+    auto topDiplotype = diplotypeCodec.decode(phasedDiplotypes.front().first); // phasedDiplotypes are sorted
     spdlog::info("Found {} paths defining diplotype", topDiplotype.size());
+    finishStage(AnalysisStage::kPhasing);
 
     spdlog::info("Projecting reads onto haplotype paths");
-    auto pairPathAlignById = project(topDiplotype, fragById);
+    auto pairPathAlignById = project(topDiplotype, fragById, args.numThreads);
     spdlog::info("Projected {} read pairs", pairPathAlignById.size());
 
+    if (args.realignReads)
+    {
+        spdlog::info("Realigning poorly scoring reads");
+        const int numImproved = realignPoorAligns(
+            topDiplotype, fragById, pairPathAlignById, std::chrono::milliseconds(args.realignTimeBudgetMs));
+        spdlog::info("Improved alignments of {} reads", numImproved);
+    }
+    finishStage(AnalysisStage::kProjection);
+
     spdlog::info("Generating fragment alignments");
-    auto fragPathAlignsById = resolveByFragLen(meanFragLen, topDiplotype, pairPathAlignById);
+    auto fragPathAlignsById = resolveByFragLen(meanFragLen, topDiplotype, pairPathAlignById, args.numThreads);
     spdlog::info("Generated {} fragment alignments", fragPathAlignsById.size());
+    finishStage(AnalysisStage::kFragLenFilter);
 
     spdlog::info("Assigning fragment origins");
-    auto fragAssignment = getBestFragAssignment(topDiplotype, fragPathAlignsById);
+    auto fragAssignment = assignmentSeed ? getBestFragAssignment(topDiplotype, fragPathAlignsById, *assignmentSeed)
+                                         : getBestFragAssignment(topDiplotype, fragPathAlignsById);
     spdlog::info("Found assignments for {} frags", fragAssignment.fragIds.size());
+    finishStage(AnalysisStage::kAssignment);
+
+    if (args.writeHaplotypeBam)
+    {
+        const auto bamPrefix = args.outputPrefix + "." + locusId + ".haplotypes";
+        spdlog::info("Writing reads aligned to haplotypes to {}.bam", bamPrefix);
+        writeHaplotypeBam(bamPrefix, locusId, topDiplotype, fragById, fragAssignment, fragPathAlignsById);
+    }
 
     spdlog::info("Generating metrics");
     auto metricsByVariant = getMetrics(locusSpec, topDiplotype, fragById, fragAssignment, fragPathAlignsById);
+    finishStage(AnalysisStage::kMetrics);
 
-	if (onlyMetrics) {
+	if (!drawsPlots(args)) {
 		std::vector<LanePlot> lanePlots;
-		return { scoredDiplotypes, lanePlots, metricsByVariant };
+		return { diplotypeCodec, phasedDiplotypes, lanePlots, metricsByVariant };
 	}
 
     spdlog::info("Generating plot blueprint");
-    auto lanePlots = generateBlueprint(topDiplotype, fragById, fragAssignment, fragPathAlignsById);
+    if (!args.samplesPath.empty())
+    {
+        auto lanePlots = generateSummaryBlueprint(
+            topDiplotype, fragById, fragAssignment, fragPathAlignsById, args.panelReadLanes, args.numThreads);
+        finishStage(AnalysisStage::kBlueprint);
+        return { diplotypeCodec, phasedDiplotypes, lanePlots, metricsByVariant };
+    }
+    if (plotSink)
+    {
+        generateBlueprint(topDiplotype, fragById, fragAssignment, fragPathAlignsById, *plotSink, args.numThreads);
+        finishStage(AnalysisStage::kBlueprint);
+        return { diplotypeCodec, phasedDiplotypes, vector<LanePlot>(), metricsByVariant };
+    }
+    auto lanePlots = generateBlueprint(topDiplotype, fragById, fragAssignment, fragPathAlignsById, args.numThreads);
+    finishStage(AnalysisStage::kBlueprint);
+
+    return { diplotypeCodec, phasedDiplotypes, lanePlots, metricsByVariant };
+}
 
-    return { scoredDiplotypes, lanePlots, metricsByVariant };
+static LocusResults
+analyzeLocus(
+    const WorkflowArguments& args, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec,
+    const ReadsAccess* readsAccess, LanePlotSink* plotSink = nullptr, unsigned* assignmentSeed = nullptr)
+{
+    spdlog::info("Loading specification of locus {}", locusSpec.locusId());
+
+    const size_t mateBufferSize = args.mateBufferMb << 20;
+    auto fragById = readsAccess && readsAccess->bamletStore
+        ? getAligns(*readsAccess->bamletStore, args.referencePath, locusSpec, mateBufferSize)
+        : getAligns(
+            args.readsPath, args.referencePath, locusSpec, mateBufferSize,
+            readsAccess && readsAccess->xgLocusIndex ? readsAccess->xgLocusIndex.get_ptr() : nullptr,
+            args.numThreads);
+    spdlog::info("Extracted {} frags", fragById.size());
+
+    return analyzeFrags(args, genotypes, locusSpec, fragById, plotSink, assignmentSeed, StageCallback());
+}
+
+LocusAnalysis analyzeLocusReads(
+    const WorkflowArguments& args, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec,
+    const FragById& fragById, const StageCallback& onStageEnd)
+{
+    unsigned assignmentSeed = getAssignmentSeed(locusSpec.locusId());
+    auto locusResults = analyzeFrags(args, genotypes, locusSpec, fragById, nullptr, &assignmentSeed, onStageEnd);
+    return { static_cast<int>(locusResults.scoredDiplotypes().size()), locusResults.lanePlots() };
 }
 
 vector<string> getLocusIds(const RegionCatalog& catalog, const string& locusIdArg)
@@ -195,38 +382,655 @@ std::ofstream initMetricsFile(const std::string& prefix)
     return metricsFile;
 }
 
+// Inverse of the encoding of metrics rows in summarizeLocusResults
+static Metrics decodeMetricsRow(const string& row)
+{
+    vector<string> columns;
+    boost::split(columns, row, boost::is_any_of("\t"));
+    if (columns.size() != 3)
+    {
+        throw std::runtime_error("Malformed metrics row " + row);
+    }
+
+    Metrics metrics;
+    metrics.variantId = columns[0];
+    vector<string> pieces;
+    if (!columns[1].empty())
+    {
+        boost::split(pieces, columns[1], boost::is_any_of("/"));
+        for (const auto& piece : pieces)
+        {
+            metrics.genotype.push_back(std::stoi(piece));
+        }
+    }
+    if (!columns[2].empty())
+    {
+        boost::split(pieces, columns[2], boost::is_any_of("/"));
+        for (const auto& piece : pieces)
+        {
+            metrics.alleleDepth.push_back(std::stod(piece));
+        }
+    }
+
+    return metrics;
+}
+
+static string computeResultKey(
+    const WorkflowArguments& args, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec,
+    const ReadsAccess& readsAccess)
+{
+    ContentHash hash;
+    hash.add(static_cast<int64_t>(ResultCache::kAlgorithmVersion));
+    hash.add(static_cast<int64_t>(args.locusExtensionLength));
+    hash.add(static_cast<int64_t>(args.kmerPreview));
+    hash.add(static_cast<int64_t>(args.kmerPrefilter));
+    hash.add(static_cast<int64_t>(args.flankSnpPhasing));
+    hash.add(static_cast<int64_t>(args.phasingTopK));
+    hash.add(static_cast<int64_t>(args.realignReads));
+    hash.add(static_cast<int64_t>(args.realignTimeBudgetMs));
+    hash.add(static_cast<int64_t>(args.searchRepeatIntervals));
+
+    hash.add(locusSpec.locusId());
+    const auto& graph = locusSpec.regionGraph();
+    for (NodeId node = 0; node != static_cast<NodeId>(graph.numNodes()); ++node)
+    {
+        hash.add(graph.nodeSeq(node));
+        for (NodeId successor : graph.successors(node))
+        {
+            hash.add(static_cast<int64_t>(successor));
+        }
+    }
+
+    for (const auto& variantSpec : locusSpec.variantSpecs())
+    {
+        const auto& referenceLocus = variantSpec.referenceLocus();
+        hash.add(variantSpec.id());
+        hash.add(static_cast<int64_t>(referenceLocus.contigIndex()));
+        hash.add(referenceLocus.start());
+        hash.add(referenceLocus.end());
+        for (int repeatLength : genotypes.getRepeatLengths(variantSpec.id()))
+        {
+            hash.add(static_cast<int64_t>(repeatLength));
+        }
+        if (args.searchRepeatIntervals)
+        {
+            for (const auto& interval : genotypes.getRepeatLengthIntervals(variantSpec.id()))
+            {
+                hash.add(static_cast<int64_t>(interval.first));
+                hash.add(static_cast<int64_t>(interval.second));
+            }
+        }
+    }
+
+    auto extractionRegions = locusSpec.targetReadExtractionRegions();
+    const auto& offtargetRegions = locusSpec.offtargetReadExtractionRegions();
+    extractionRegions.insert(extractionRegions.end(), offtargetRegions.begin(), offtargetRegions.end());
+    for (const auto& region : extractionRegions)
+    {
+        hash.add(static_cast<int64_t>(region.contigIndex()));
+        hash.add(region.start());
+        hash.add(region.end());
+    }
+
+    // The fragment length is estimated from the locus reads, so it is covered by the reads file identity
+    hash.add(args.readsPath);
+    hash.add(static_cast<uint64_t>(boost::filesystem::file_size(args.readsPath)));
+    hash.add(static_cast<int64_t>(boost::filesystem::last_write_time(args.readsPath)));
+    if (readsAccess.bamletStore)
+    {
+        for (const auto& record : readsAccess.bamletStore->getRecords(locusSpec.locusId()))
+        {
+            hash.add(record.fragmentId);
+            hash.add(static_cast<int64_t>(record.contigIndex));
+            hash.add(record.start);
+            hash.add(record.end);
+            hash.add(static_cast<int64_t>(record.graphPosition));
+            hash.add(record.graphCigar);
+            hash.add(record.bases);
+            hash.add(record.quals);
+        }
+    }
+    else if (readsAccess.xgLocusIndex)
+    {
+        for (const auto& range : readsAccess.xgLocusIndex->getRanges(locusSpec.locusId()))
+        {
+            hash.add(range.begin);
+            hash.add(range.end);
+        }
+    }
+    else
+    {
+        for (const auto& chunk : readsAccess.readChunkIndex->getChunks(args.referencePath, locusSpec))
+        {
+            hash.add(chunk.first);
+            hash.add(chunk.second);
+        }
+    }
+
+    return hash.hex();
+}
+
+static CachedLocusResults
+summarizeLocusResults(const string& locusId, const LocusResults& locusResults, bool keepLanePlots)
+{
+    CachedLocusResults summary;
+    for (const auto& metrics : locusResults.metricsByVariant())
+    {
+        const auto& genotype = encode(metrics.genotype);
+        const auto& alleleDepth = encode(metrics.alleleDepth);
+        summary.metricsRows.push_back(metrics.variantId + "\t" + genotype + "\t" + alleleDepth);
+    }
+
+    for (const auto& diplotypeAndScore : locusResults.scoredDiplotypes())
+    {
+        const auto& diplotype = locusResults.diplotypeCodec().summarize(diplotypeAndScore.first);
+        summary.phasingRows.push_back(locusId + "\t" + diplotype + "\t" + std::to_string(diplotypeAndScore.second));
+    }
+
+    if (keepLanePlots)
+    {
+        summary.lanePlots = locusResults.lanePlots();
+    }
+
+    return summary;
+}
+
+static CachedLocusResults processLocus(
+    const WorkflowArguments& args, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec,
+    const optional<ResultCache>& resultCache, const ReadsAccess& readsAccess, PlotArchiveWriter* plotArchive = nullptr,
+    HtmlReportWriter* htmlReport = nullptr)
+{
+    const auto& locusId = locusSpec.locusId();
+    const auto svgPath = args.outputPrefix + "." + locusId + ".svg";
+
+    // Unless the blueprint is needed elsewhere, lanes are drawn as soon as they are generated
+    const bool streamSvg = drawsPlots(args) && !plotArchive && !htmlReport && !args.writePlotTiles
+        && !(resultCache && args.cacheBlueprints);
+
+    string resultKey;
+    optional<CachedLocusResults> results;
+    if (resultCache)
+    {
+        resultKey = computeResultKey(args, genotypes, locusSpec, readsAccess);
+        // Haplotype BAMs are not cached, so loci are reanalyzed to write them
+        if (!args.writeHaplotypeBam)
+        {
+            results = resultCache->load(resultKey);
+        }
+        if (results && drawsPlots(args) && !results->lanePlots)
+        {
+            results = boost::none;
+        }
+    }
+
+    if (results)
+    {
+        spdlog::info("Reusing cached results for locus {}", locusId);
+    }
+    else
+    {
+        std::ofstream svgFile;
+        std::unique_ptr<SvgLaneSink> svgSink;
+        if (streamSvg)
+        {
+            svgFile.open(svgPath);
+            if (!svgFile.is_open())
+            {
+                throw std::runtime_error("Unable to open " + svgPath);
+            }
+            svgSink.reset(new SvgLaneSink(svgFile));
+        }
+
+        try
+        {
+            unsigned assignmentSeed = getAssignmentSeed(locusId);
+            auto locusResults
+                = analyzeLocus(args, genotypes, locusSpec, &readsAccess, svgSink.get(), &assignmentSeed);
+            results = summarizeLocusResults(locusId, locusResults, drawsPlots(args) && !streamSvg);
+        }
+        catch (const std::exception&)
+        {
+            if (svgSink)
+            {
+                svgFile.close();
+                std::remove(svgPath.c_str());
+            }
+            throw;
+        }
+        if (resultCache)
+        {
+            CachedLocusResults entry = *results;
+            if (!args.cacheBlueprints)
+            {
+                entry.lanePlots = boost::none;
+            }
+            resultCache->store(resultKey, entry);
+        }
+    }
+
+    if (!drawsPlots(args))
+    {
+        return *results;
+    }
+
+    if (plotArchive)
+    {
+        std::ostringstream svg;
+        generateSvg(*results->lanePlots, svg);
+        plotArchive->add(locusId, svg.str());
+    }
+
+    if (htmlReport)
+    {
+        htmlReport->add(locusId, *results->lanePlots);
+    }
+
+    if (args.writePlotTiles)
+    {
+        generatePlotTiles(*results->lanePlots, args.outputPrefix + "." + locusId + ".tiles");
+    }
+
+    if (!plotArchive && !htmlReport && !args.writePlotTiles && results->lanePlots)
+    {
+        generateSvg(*results->lanePlots, svgPath);
+    }
+
+    return *results;
+}
+
+static void mergeQueueResults(
+    const WorkflowArguments& args, const SampleGenotypes& genotypes, const WorkQueue& workQueue,
+    const vector<string>& locusIds)
+{
+    const string& outputPrefix = args.outputPrefix;
+    // Tables are written under temporary names and renamed into place, so they are never seen partially written
+    const string tempPrefix = outputPrefix + ".merge." + workQueue.owner();
+    vector<string> suffixes = { ".phasing.tsv", ".metrics.tsv" };
+    {
+        auto phasingFile = initPhasingFile(tempPrefix);
+        auto metricsFile = initMetricsFile(tempPrefix);
+        MetricsStoreWriter metricsStore(tempPrefix + ".metrics.bin", genotypes.sampleId());
+        for (const auto& locusId : locusIds)
+        {
+            const auto results = workQueue.loadResults(locusId);
+            for (const auto& row : results.metricsRows)
+            {
+                metricsFile << row << std::endl;
+                if (args.writeMetricsStore)
+                {
+                    metricsStore.add(decodeMetricsRow(row));
+                }
+            }
+            for (const auto& row : results.phasingRows)
+            {
+                phasingFile << row << std::endl;
+            }
+        }
+
+        if (args.writeMetricsStore)
+        {
+            metricsStore.write();
+            suffixes.push_back(".metrics.bin");
+        }
+    }
+
+    for (const auto& suffix : suffixes)
+    {
+        if (std::rename((tempPrefix + suffix).c_str(), (outputPrefix + suffix).c_str()) != 0)
+        {
+            throw std::runtime_error("Unable to write " + outputPrefix + suffix);
+        }
+    }
+}
+
+static int runQueueWorkflow(
+    const WorkflowArguments& args, const SampleGenotypes& genotypes, const RegionCatalog& locusCatalog,
+    const vector<string>& locusIds, const optional<ResultCache>& resultCache, const ReadsAccess& readsAccess)
+{
+    WorkQueue workQueue(args.workQueueDir, args.leaseSeconds);
+
+    // Processes keep polling until the results are merged, so loci and merges of processes that die are reclaimed
+    // once their leases expire
+    const auto pollInterval = std::chrono::seconds(std::max(1, std::min(args.leaseSeconds, 60)));
+    bool isWaiting = false;
+    while (true)
+    {
+        // Keep claiming loci until a full pass finds nothing to claim; this also picks up loci with expired leases
+        bool claimedLocus = true;
+        while (claimedLocus)
+        {
+            claimedLocus = false;
+            for (const auto& locusId : locusIds)
+            {
+                if (workQueue.isDone(locusId) || !workQueue.tryClaim(locusId))
+                {
+                    continue;
+                }
+
+                claimedLocus = true;
+                // Failed loci are recorded with empty results so that other processes do not retry them
+                CachedLocusResults results;
+                try
+                {
+                    LeaseHeartbeat heartbeat(workQueue, locusId, args.leaseSeconds);
+                    results = processLocus(args, genotypes, locusCatalog.at(locusId), resultCache, readsAccess);
+                }
+                catch (const std::exception& e)
+                {
+                    spdlog::error("Failed to analyze locus {}", locusId + ": " + e.what());
+                }
+                workQueue.complete(locusId, results);
+            }
+        }
+
+        const bool areLociDone = std::all_of(
+            locusIds.begin(), locusIds.end(), [&workQueue](const string& locusId) { return workQueue.isDone(locusId); });
+        if (areLociDone && workQueue.isDone(WorkQueue::kMergeTaskId))
+        {
+            return 0;
+        }
+
+        // Exactly one process merges the results
+        if (areLociDone && workQueue.tryClaim(WorkQueue::kMergeTaskId))
+        {
+            spdlog::info("All loci are analyzed; merging results");
+            {
+                LeaseHeartbeat heartbeat(workQueue, WorkQueue::kMergeTaskId, args.leaseSeconds);
+                mergeQueueResults(args, genotypes, workQueue, locusIds);
+            }
+            workQueue.complete(WorkQueue::kMergeTaskId, CachedLocusResults());
+            return 0;
+        }
+
+        if (!isWaiting)
+        {
+            spdlog::info("Waiting for other processes to finish analyzing loci and merging results");
+            isWaiting = true;
+        }
+        std::this_thread::sleep_for(pollInterval);
+    }
+}
+
+struct PanelSample
+{
+    string sampleId;
+    string readsPath;
+    string vcfPath;
+};
+
+// Sample lists have a sample id, a BAMlet, and optionally a VCF on each tab-separated line
+static vector<PanelSample> loadPanelSamples(const string& samplesPath, const string& defaultVcfPath)
+{
+    std::ifstream samplesFile(samplesPath);
+    if (!samplesFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + samplesPath);
+    }
+
+    vector<PanelSample> samples;
+    string line;
+    while (std::getline(samplesFile, line))
+    {
+        if (line.empty() || line.front() == '#')
+        {
+            continue;
+        }
+
+        vector<string> columns;
+        boost::split(columns, line, boost::is_any_of("\t"));
+        if (columns.size() < 2 || columns.size() > 3 || columns[0].empty() || columns[1].empty())
+        {
+            throw std::runtime_error("Malformed line in " + samplesPath + ": " + line);
+        }
+
+        const string vcfPath = columns.size() == 3 ? columns[2] : defaultVcfPath;
+        if (vcfPath.empty())
+        {
+            throw std::runtime_error("No VCF is specified for sample " + columns[0]);
+        }
+        samples.push_back({ columns[0], columns[1], vcfPath });
+    }
+
+    if (samples.empty())
+    {
+        throw std::runtime_error(samplesPath + " lists no samples");
+    }
+
+    return samples;
+}
+
+// Analyzes one locus in several samples and draws them in a single image
+static int runPanelWorkflow(
+    const WorkflowArguments& args, const RegionCatalog& locusCatalog, const vector<string>& locusIds)
+{
+    if (locusIds.size() != 1)
+    {
+        throw std::runtime_error("Sample panels are drawn for a single locus; specify it with --locus");
+    }
+    if (!args.workQueueDir.empty() || args.writePlotArchive || args.writeHtmlReport || args.writePlotTiles)
+    {
+        throw std::runtime_error(
+            "Sample panels cannot be combined with work queues, plot archives, or other plot formats");
+    }
+
+    const auto& locusSpec = locusCatalog.at(locusIds.front());
+    const auto samples = loadPanelSamples(args.samplesPath, args.vcfPath);
+
+    // Each VCF is parsed once even if it holds the genotypes of several samples
+    map<string, std::unique_ptr<VcfGenotypeIndex>> genotypeIndexByPath;
+    vector<SampleGenotypes> genotypesBySample;
+    for (const auto& sample : samples)
+    {
+        auto& genotypeIndex = genotypeIndexByPath[sample.vcfPath];
+        if (!genotypeIndex)
+        {
+            genotypeIndex.reset(new VcfGenotypeIndex(sample.vcfPath));
+        }
+
+        // Single-sample VCFs are used regardless of the name of their sample
+        const auto& vcfSampleIds = genotypeIndex->sampleIds();
+        const bool isNamed = std::find(vcfSampleIds.begin(), vcfSampleIds.end(), sample.sampleId) != vcfSampleIds.end();
+        const string vcfSampleId = !isNamed && vcfSampleIds.size() == 1 ? "" : sample.sampleId;
+        genotypesBySample.emplace_back(*genotypeIndex, genotypeIndex->getSampleIndex(vcfSampleId));
+    }
+
+    spdlog::info("Analyzing locus {} in {} samples", locusSpec.locusId(), samples.size());
+    // The thread budget is split between samples and the analysis of each sample, which also bounds the number of
+    // samples whose reads are held in memory at once
+    const int numSampleThreads = std::max(1, std::min(static_cast<int>(samples.size()), args.numThreads));
+    const int numThreadsPerSample = std::max(1, args.numThreads / numSampleThreads);
+    vector<optional<LocusResults>> resultsBySample(samples.size());
+    std::atomic<int> nextSample(0);
+    auto analyzeSamples = [&]()
+    {
+        for (int sampleIndex = nextSample++; sampleIndex < static_cast<int>(samples.size());
+             sampleIndex = nextSample++)
+        {
+            const auto& sample = samples[sampleIndex];
+            WorkflowArguments sampleArgs = args;
+            sampleArgs.readsPath = sample.readsPath;
+            sampleArgs.numThreads = numThreadsPerSample;
+            sampleArgs.outputPrefix = args.outputPrefix + "." + sample.sampleId;
+
+            // Same seed as in single-sample runs, so panel results do not depend on the order of samples or threads
+            unsigned assignmentSeed = getAssignmentSeed(locusSpec.locusId());
+            try
+            {
+                resultsBySample[sampleIndex]
+                    = analyzeLocus(
+                    sampleArgs, genotypesBySample[sampleIndex], locusSpec, nullptr, nullptr, &assignmentSeed);
+            }
+            catch (const std::exception& e)
+            {
+                spdlog::error("Failed to analyze sample {}", sample.sampleId + ": " + e.what());
+            }
+        }
+    };
+
+    vector<std::thread> threads;
+    for (int threadIndex = 0; threadIndex != numSampleThreads; ++threadIndex)
+    {
+        threads.emplace_back(analyzeSamples);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    const auto metricsPath = args.outputPrefix + ".panel.metrics.tsv";
+    std::ofstream metricsFile(metricsPath);
+    if (!metricsFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + metricsPath);
+    }
+    metricsFile << "SampleId\tVariantId\tGenotype\tAlleleDepth" << std::endl;
+
+    vector<SamplePanel> panels;
+    for (int sampleIndex = 0; sampleIndex != static_cast<int>(samples.size()); ++sampleIndex)
+    {
+        const auto& results = resultsBySample[sampleIndex];
+        if (!results)
+        {
+            continue;
+        }
+
+        SamplePanel panel;
+        panel.title = samples[sampleIndex].sampleId;
+        for (const auto& metrics : results->metricsByVariant())
+        {
+            const auto genotype = encode(metrics.genotype);
+            metricsFile << samples[sampleIndex].sampleId << "\t" << metrics.variantId << "\t" << genotype << "\t"
+                        << encode(metrics.alleleDepth) << std::endl;
+            panel.title += "  " + metrics.variantId + " " + genotype;
+        }
+        panel.lanePlots = results->lanePlots();
+        panels.push_back(std::move(panel));
+    }
+
+    if (drawsPlots(args) && !panels.empty())
+    {
+        const auto svgPath = args.outputPrefix + "." + locusSpec.locusId() + ".panel.svg";
+        std::ofstream svgFile(svgPath);
+        if (!svgFile.is_open())
+        {
+            throw std::runtime_error("Unable to open " + svgPath);
+        }
+        generatePanelSvg(panels, svgFile);
+    }
+
+    return 0;
+}
+
 int runWorkflow(const WorkflowArguments& args)
 {
     Reference reference(args.referencePath);
     auto locusCatalog = loadLocusCatalogFromDisk(args.catalogPath, reference, args.locusExtensionLength);
     auto locusIds = getLocusIds(locusCatalog, args.locusId);
+
+    if (!args.samplesPath.empty())
+    {
+        return runPanelWorkflow(args, locusCatalog, locusIds);
+    }
+
+    const VcfGenotypeIndex genotypeIndex(args.vcfPath);
+    const SampleGenotypes genotypes(genotypeIndex, genotypeIndex.getSampleIndex(args.sampleId));
+    spdlog::info("Using genotypes of sample {}", genotypes.sampleId());
+
+    optional<ResultCache> resultCache;
+    if (!args.cacheDir.empty())
+    {
+        resultCache = ResultCache(args.cacheDir);
+    }
+
+    ReadsAccess readsAccess;
+    if (args.inMemoryReadsMb > 0 && boost::filesystem::file_size(args.readsPath) <= (args.inMemoryReadsMb << 20))
+    {
+        try
+        {
+            readsAccess.bamletStore.reset(new BamletStore(args.readsPath, args.referencePath));
+            spdlog::info("Loaded {} reads of {} into memory", readsAccess.bamletStore->numRecords(), args.readsPath);
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::warn("Querying {} for each locus instead of loading it into memory: {}", args.readsPath, e.what());
+        }
+    }
+
+    // An up-to-date locus index is used whenever present
+    if (!readsAccess.bamletStore)
+    {
+        try
+        {
+            readsAccess.xgLocusIndex = args.buildLocusIndex ? XgLocusIndex::loadOrBuild(args.readsPath)
+                                                            : XgLocusIndex::load(args.readsPath);
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::warn("Querying {} by region instead of by locus: {}", args.readsPath, e.what());
+        }
+        if (readsAccess.xgLocusIndex)
+        {
+            spdlog::info("Using index of {} loci of {}", readsAccess.xgLocusIndex->numLoci(), args.readsPath);
+        }
+    }
+
+    if (resultCache && !readsAccess.bamletStore && !readsAccess.xgLocusIndex)
+    {
+        try
+        {
+            readsAccess.readChunkIndex.reset(new ReadChunkIndex(args.readsPath));
+        }
+        catch (const std::exception& e)
+        {
+            spdlog::warn("Not caching results because reads of loci cannot be identified: {}", e.what());
+            resultCache = boost::none;
+        }
+    }
+
+    if (!args.workQueueDir.empty())
+    {
+        if (args.writePlotArchive || args.writeHtmlReport)
+        {
+            throw std::runtime_error("Plot archives and HTML reports cannot be written in work queue mode");
+        }
+        return runQueueWorkflow(args, genotypes, locusCatalog, locusIds, resultCache, readsAccess);
+    }
+
     auto phasingFile = initPhasingFile(args.outputPrefix);
     auto metricsFile = initMetricsFile(args.outputPrefix);
-    
-    // For reproducibility
-    srand(14345);
+    MetricsStoreWriter metricsStore(args.outputPrefix + ".metrics.bin", genotypes.sampleId());
+
+    std::unique_ptr<PlotArchiveWriter> plotArchive;
+    if (args.writePlotArchive && drawsPlots(args))
+    {
+        plotArchive.reset(new PlotArchiveWriter(args.outputPrefix + ".plots", args.compressPlotArchive));
+    }
+
+    std::unique_ptr<HtmlReportWriter> htmlReport;
+    if (args.writeHtmlReport && drawsPlots(args))
+    {
+        htmlReport.reset(new HtmlReportWriter(args.outputPrefix + ".report.html"));
+    }
 
     for (const auto& locusId : locusIds)
     {
         try {
-    	    auto locusSpec = locusCatalog.at(locusId);
-            auto locusResults = analyzeLocus(args.referencePath, args.readsPath, args.vcfPath, locusId, locusSpec,
-                                             args.onlyMetrics);
-			if ( !args.onlyMetrics ) {
-				const auto svgPath = args.outputPrefix + "." + locusId + ".svg";
-				generateSvg(locusResults.lanePlots(), svgPath);
-			}
+            const auto results = processLocus(
+                args, genotypes, locusCatalog.at(locusId), resultCache, readsAccess, plotArchive.get(),
+                htmlReport.get());
 
-			for (const auto& metrics : locusResults.metricsByVariant())
+			for (const auto& row : results.metricsRows)
 			{
-				const auto& genotype = encode(metrics.genotype);
-				const auto& alleleDepth = encode(metrics.alleleDepth);
-				metricsFile << metrics.variantId << "\t" << genotype << "\t" << alleleDepth << std::endl;
+				metricsFile << row << std::endl;
+				if (args.writeMetricsStore)
+				{
+					metricsStore.add(decodeMetricsRow(row));
+				}
 			}
 
-			for (const auto& diplotypeAndScore : locusResults.scoredDiplotypes())
+			for (const auto& row : results.phasingRows)
 			{
-				phasingFile << locusId << "\t" << diplotypeAndScore.first << "\t" << diplotypeAndScore.second << std::endl;
+				phasingFile << row << std::endl;
 			}
  		} catch(const std::exception & e) {
 			spdlog::error("Failed to analyze locus {}", locusId + ": " + e.what());
@@ -236,6 +1040,18 @@ int runWorkflow(const WorkflowArguments& args)
 
     phasingFile.close();
     metricsFile.close();
+    if (args.writeMetricsStore)
+    {
+        metricsStore.write();
+    }
+    if (plotArchive)
+    {
+        plotArchive->close();
+    }
+    if (htmlReport)
+    {
+        htmlReport->close();
+    }
 
     return 0;
 }
@@ -21,20 +21,77 @@
 #pragma once
 
 #include <fstream>
+#include <functional>
 #include <string>
+#include <vector>
 
 #include "app/CatalogLoading.hh"
+#include "app/LanePlot.hh"
+#include "app/VcfGenotypeIndex.hh"
+#include "core/Aligns.hh"
 
 struct WorkflowArguments
 {
     bool onlyMetrics;
     std::string readsPath;
     std::string vcfPath;
+    std::string sampleId;
     std::string catalogPath;
     std::string referencePath;
     std::string locusId;
     std::string outputPrefix;
     int locusExtensionLength;
+    size_t mateBufferMb;
+    size_t inMemoryReadsMb;
+    bool buildLocusIndex;
+    int numThreads;
+    std::string cacheDir;
+    bool cacheBlueprints;
+    std::string workQueueDir;
+    int leaseSeconds;
+    bool writePlotArchive;
+    bool compressPlotArchive;
+    bool writeHtmlReport;
+    bool writePlotTiles;
+    bool kmerPreview;
+    int kmerPrefilter;
+    bool flankSnpPhasing;
+    bool realignReads;
+    int realignTimeBudgetMs;
+    bool searchRepeatIntervals;
+    bool writeHaplotypeBam;
+    bool writeMetricsStore;
+    int phasingTopK;
+    std::string samplesPath;
+    bool panelReadLanes;
 };
 
 int runWorkflow(const WorkflowArguments& args);
+
+/// Stages of the analysis of a locus in the order they finish
+enum class AnalysisStage
+{
+    kCandidates,
+    kPhasing,
+    kProjection,
+    kFragLenFilter,
+    kAssignment,
+    kMetrics,
+    kBlueprint
+};
+
+using StageCallback = std::function<void(AnalysisStage)>;
+
+struct LocusAnalysis
+{
+    int numScoredDiplotypes;
+    std::vector<LanePlot> lanePlots;
+};
+
+/// Analyzes reads of a locus the way runWorkflow does once they are extracted and paired
+///
+/// \param onStageEnd: Called as each stage of the analysis finishes
+/// \return Number of diplotypes kept after phasing and the blueprint of the plot if the arguments call for one
+LocusAnalysis analyzeLocusReads(
+    const WorkflowArguments& args, const SampleGenotypes& genotypes, const LocusSpecification& locusSpec,
+    const FragById& fragById, const StageCallback& onStageEnd);
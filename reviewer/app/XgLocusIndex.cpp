@@ -0,0 +1,276 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "app/XgLocusIndex.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "spdlog/spdlog.h"
+
+extern "C"
+{
+#include "htslib/bgzf.h"
+#include "htslib/hts.h"
+#include "htslib/sam.h"
+}
+
+using boost::optional;
+using std::string;
+using std::vector;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+const string kMagic = "REVXGI01";
+
+template <typename T> void writeValue(std::ostream& out, T value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T> void readValue(std::istream& in, T& value)
+{
+    in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+// Locus id is the first comma-separated field of the XG tag
+string getLocusId(const bam1_t* htsAlignmentPtr)
+{
+    uint8_t* aux = bam_aux_get(htsAlignmentPtr, "XG");
+    const char* encodingPtr = aux ? bam_aux2Z(aux) : nullptr;
+    if (!encodingPtr)
+    {
+        throw std::runtime_error("All BAM alignments are required to have \"XG\" auxiliary tag");
+    }
+    const string encoding(encodingPtr);
+    return encoding.substr(0, encoding.find(','));
+}
+}
+
+XgLocusIndex::XgLocusIndex(uint64_t readsFileSize, int64_t readsFileTime)
+    : readsFileSize_(readsFileSize)
+    , readsFileTime_(readsFileTime)
+{
+}
+
+XgLocusIndex XgLocusIndex::build(const string& readsPath)
+{
+    XgLocusIndex index(fs::file_size(readsPath), fs::last_write_time(readsPath));
+
+    htsFile* htsFilePtr = sam_open(readsPath.c_str(), "r");
+    if (!htsFilePtr)
+    {
+        throw std::runtime_error("Failed to read BAM file " + readsPath);
+    }
+    if (!htsFilePtr->is_bgzf)
+    {
+        sam_close(htsFilePtr);
+        throw std::runtime_error("Locus index requires a BGZF-compressed reads file but " + readsPath + " is not");
+    }
+
+    bam_hdr_t* htsHeaderPtr = sam_hdr_read(htsFilePtr);
+    if (!htsHeaderPtr)
+    {
+        sam_close(htsFilePtr);
+        throw std::runtime_error("Failed to read header of " + readsPath);
+    }
+
+    bam1_t* htsAlignmentPtr = bam_init1();
+    uint64_t recordStart = bgzf_tell(htsFilePtr->fp.bgzf);
+    int status;
+    try
+    {
+        while ((status = sam_read1(htsFilePtr, htsHeaderPtr, htsAlignmentPtr)) >= 0)
+        {
+            const uint64_t recordEnd = bgzf_tell(htsFilePtr->fp.bgzf);
+            auto& ranges = index.rangesByLocus_[getLocusId(htsAlignmentPtr)];
+            // Consecutive records of a locus form a single range
+            if (!ranges.empty() && ranges.back().end == recordStart)
+            {
+                ranges.back().end = recordEnd;
+            }
+            else
+            {
+                ranges.push_back({ recordStart, recordEnd });
+            }
+            recordStart = recordEnd;
+        }
+    }
+    catch (const std::exception&)
+    {
+        bam_destroy1(htsAlignmentPtr);
+        bam_hdr_destroy(htsHeaderPtr);
+        sam_close(htsFilePtr);
+        throw;
+    }
+
+    bam_destroy1(htsAlignmentPtr);
+    bam_hdr_destroy(htsHeaderPtr);
+    sam_close(htsFilePtr);
+
+    if (status < -1)
+    {
+        throw std::runtime_error("Failed to read " + readsPath);
+    }
+
+    return index;
+}
+
+optional<XgLocusIndex> XgLocusIndex::load(const string& readsPath)
+{
+    std::ifstream indexFile(getIndexPath(readsPath), std::ios::binary);
+    if (!indexFile.is_open())
+    {
+        return boost::none;
+    }
+
+    string magic(kMagic.size(), '\0');
+    indexFile.read(&magic[0], magic.size());
+    uint64_t readsFileSize = 0;
+    int64_t readsFileTime = 0;
+    readValue(indexFile, readsFileSize);
+    readValue(indexFile, readsFileTime);
+    if (!indexFile || magic != kMagic || readsFileSize != fs::file_size(readsPath)
+        || readsFileTime != fs::last_write_time(readsPath))
+    {
+        return boost::none;
+    }
+
+    // Lengths read from the index are checked against the bytes left in it before anything is allocated, so a corrupt
+    // index falls back to region queries instead of exhausting memory
+    indexFile.seekg(0, std::ios::end);
+    const uint64_t indexSize = indexFile.tellg();
+    indexFile.seekg(kMagic.size() + sizeof(readsFileSize) + sizeof(readsFileTime));
+    auto getBytesLeft = [&indexFile, indexSize]() { return indexSize - static_cast<uint64_t>(indexFile.tellg()); };
+
+    XgLocusIndex index(readsFileSize, readsFileTime);
+    uint64_t numLoci = 0;
+    readValue(indexFile, numLoci);
+    for (uint64_t locusIndex = 0; locusIndex != numLoci && indexFile; ++locusIndex)
+    {
+        uint32_t locusIdLength = 0;
+        readValue(indexFile, locusIdLength);
+        if (!indexFile || locusIdLength > getBytesLeft())
+        {
+            return boost::none;
+        }
+        string locusId(locusIdLength, '\0');
+        indexFile.read(&locusId[0], locusIdLength);
+
+        uint64_t numRanges = 0;
+        readValue(indexFile, numRanges);
+        if (!indexFile || numRanges > getBytesLeft() / (2 * sizeof(uint64_t)))
+        {
+            return boost::none;
+        }
+        auto& ranges = index.rangesByLocus_[locusId];
+        ranges.resize(numRanges);
+        for (auto& range : ranges)
+        {
+            readValue(indexFile, range.begin);
+            readValue(indexFile, range.end);
+        }
+    }
+
+    if (!indexFile)
+    {
+        return boost::none;
+    }
+    return index;
+}
+
+XgLocusIndex XgLocusIndex::loadOrBuild(const string& readsPath)
+{
+    auto index = load(readsPath);
+    if (index)
+    {
+        return *index;
+    }
+
+    spdlog::info("Indexing loci of {}", readsPath);
+    index = build(readsPath);
+    try
+    {
+        index->write(getIndexPath(readsPath));
+    }
+    catch (const std::exception& e)
+    {
+        spdlog::warn("Keeping locus index in memory only: {}", e.what());
+    }
+    return *index;
+}
+
+void XgLocusIndex::write(const string& indexPath) const
+{
+    // Loci are written in a fixed order so that indexes of the same file are identical
+    const std::map<string, vector<VirtualOffsetRange>> sortedRanges(rangesByLocus_.begin(), rangesByLocus_.end());
+
+    // The index is written next to its final location and renamed into place so that readers never see it partially
+    const string tempPath = indexPath + ".tmp" + fs::unique_path("%%%%%%%%").string();
+    {
+        std::ofstream indexFile(tempPath, std::ios::binary);
+        if (!indexFile.is_open())
+        {
+            throw std::runtime_error("Unable to open " + tempPath);
+        }
+
+        indexFile.write(kMagic.data(), kMagic.size());
+        writeValue(indexFile, readsFileSize_);
+        writeValue(indexFile, readsFileTime_);
+        writeValue(indexFile, static_cast<uint64_t>(sortedRanges.size()));
+        for (const auto& locusAndRanges : sortedRanges)
+        {
+            writeValue(indexFile, static_cast<uint32_t>(locusAndRanges.first.size()));
+            indexFile.write(locusAndRanges.first.data(), locusAndRanges.first.size());
+            writeValue(indexFile, static_cast<uint64_t>(locusAndRanges.second.size()));
+            for (const auto& range : locusAndRanges.second)
+            {
+                writeValue(indexFile, range.begin);
+                writeValue(indexFile, range.end);
+            }
+        }
+
+        indexFile.close();
+        if (!indexFile)
+        {
+            std::remove(tempPath.c_str());
+            throw std::runtime_error("Unable to write " + tempPath);
+        }
+    }
+
+    if (std::rename(tempPath.c_str(), indexPath.c_str()) != 0)
+    {
+        std::remove(tempPath.c_str());
+        throw std::runtime_error("Unable to write " + indexPath);
+    }
+}
+
+const vector<VirtualOffsetRange>& XgLocusIndex::getRanges(const string& locusId) const
+{
+    static const vector<VirtualOffsetRange> kNoRanges;
+    const auto rangesIt = rangesByLocus_.find(locusId);
+    return rangesIt != rangesByLocus_.end() ? rangesIt->second : kNoRanges;
+}
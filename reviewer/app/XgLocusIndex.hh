@@ -0,0 +1,69 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+/// Range [begin, end) of BGZF virtual offsets of consecutive records of the reads file
+struct VirtualOffsetRange
+{
+    uint64_t begin;
+    uint64_t end;
+};
+
+/// Sidecar index of a BAMlet mapping the id of each locus in the XG tags to the ranges of records of that locus
+///
+/// The index (<reads>.xgi) records the size and modification time of the reads file and is rebuilt when either
+/// changes. Reads of a locus are fetched by seeking to its ranges, skipping the records of other loci that share its
+/// region of the genome.
+class XgLocusIndex
+{
+public:
+    /// Scans the reads file to build its index; the file must be BGZF-compressed
+    static XgLocusIndex build(const std::string& readsPath);
+
+    /// \return Index of the reads file or none if the index is missing or out of date
+    static boost::optional<XgLocusIndex> load(const std::string& readsPath);
+
+    /// Loads the index of the reads file, building and writing it if needed
+    static XgLocusIndex loadOrBuild(const std::string& readsPath);
+
+    static std::string getIndexPath(const std::string& readsPath) { return readsPath + ".xgi"; }
+
+    void write(const std::string& indexPath) const;
+
+    /// \return Ranges of records of the locus in the order of the reads file
+    const std::vector<VirtualOffsetRange>& getRanges(const std::string& locusId) const;
+
+    int numLoci() const { return static_cast<int>(rangesByLocus_.size()); }
+
+private:
+    XgLocusIndex(uint64_t readsFileSize, int64_t readsFileTime);
+
+    uint64_t readsFileSize_;
+    int64_t readsFileTime_;
+    std::unordered_map<std::string, std::vector<VirtualOffsetRange>> rangesByLocus_;
+};
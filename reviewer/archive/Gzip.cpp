@@ -0,0 +1,53 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "archive/Gzip.hh"
+
+#include <sstream>
+
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+using std::string;
+
+namespace io = boost::iostreams;
+
+string gzipCompress(const string& text)
+{
+    string compressedText;
+    io::filtering_ostream out;
+    out.push(io::gzip_compressor());
+    out.push(io::back_inserter(compressedText));
+    out.write(text.data(), text.size());
+    io::close(out);
+    return compressedText;
+}
+
+string gzipDecompress(const string& compressedText)
+{
+    std::istringstream compressedStream(compressedText);
+    io::filtering_istream in;
+    in.push(io::gzip_decompressor());
+    in.push(compressedStream);
+    std::ostringstream text;
+    io::copy(in, text);
+    return text.str();
+}
@@ -0,0 +1,224 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "archive/PlotArchive.hh"
+
+#include <stdexcept>
+
+#include "archive/Gzip.hh"
+
+using std::string;
+using std::vector;
+
+static const string kHeaderMagic = "REVPLOT1";
+static const string kFooterMagic = "REVINDX1";
+static const uint64_t kFooterLength = 2 * sizeof(uint64_t) + 8;
+
+static void writeUint64(std::ostream& out, uint64_t value)
+{
+    char bytes[sizeof(value)];
+    for (size_t index = 0; index != sizeof(value); ++index)
+    {
+        bytes[index] = static_cast<char>((value >> (8 * index)) & 0xFF);
+    }
+    out.write(bytes, sizeof(value));
+}
+
+static uint64_t readUint64(std::istream& in)
+{
+    unsigned char bytes[sizeof(uint64_t)];
+    in.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+    uint64_t value = 0;
+    for (size_t index = 0; index != sizeof(bytes); ++index)
+    {
+        value |= static_cast<uint64_t>(bytes[index]) << (8 * index);
+    }
+    return value;
+}
+
+static string readString(std::istream& in, uint64_t length)
+{
+    string value(length, '\0');
+    in.read(&value[0], length);
+    return value;
+}
+
+PlotArchiveWriter::PlotArchiveWriter(const string& archivePath, bool compressPlots)
+    : archivePath_(archivePath)
+    , compressPlots_(compressPlots)
+    , archiveFile_(archivePath, std::ios::binary)
+    , currentOffset_(0)
+{
+    if (!archiveFile_.is_open())
+    {
+        throw std::runtime_error("Unable to open " + archivePath);
+    }
+
+    archiveFile_ << kHeaderMagic;
+    currentOffset_ = kHeaderMagic.size();
+}
+
+PlotArchiveWriter::~PlotArchiveWriter()
+{
+    if (archiveFile_.is_open())
+    {
+        try
+        {
+            close();
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+}
+
+void PlotArchiveWriter::add(const string& locusId, const string& plot)
+{
+    const string storedPlot = compressPlots_ ? gzipCompress(plot) : plot;
+    archiveFile_.write(storedPlot.data(), storedPlot.size());
+
+    PlotArchiveEntry entry = { currentOffset_, storedPlot.size(), plot.size(), compressPlots_ };
+    entries_.emplace_back(locusId, entry);
+    currentOffset_ += storedPlot.size();
+
+    if (!archiveFile_)
+    {
+        throw std::runtime_error("Unable to write plot of " + locusId + " to " + archivePath_);
+    }
+}
+
+void PlotArchiveWriter::close()
+{
+    const uint64_t indexOffset = currentOffset_;
+    for (const auto& locusIdAndEntry : entries_)
+    {
+        const auto& locusId = locusIdAndEntry.first;
+        const auto& entry = locusIdAndEntry.second;
+        writeUint64(archiveFile_, locusId.size());
+        archiveFile_ << locusId;
+        writeUint64(archiveFile_, entry.offset);
+        writeUint64(archiveFile_, entry.storedLength);
+        writeUint64(archiveFile_, entry.length);
+        archiveFile_.put(entry.isCompressed ? 1 : 0);
+    }
+
+    writeUint64(archiveFile_, indexOffset);
+    writeUint64(archiveFile_, entries_.size());
+    archiveFile_ << kFooterMagic;
+    archiveFile_.close();
+
+    if (!archiveFile_)
+    {
+        throw std::runtime_error("Unable to write index of " + archivePath_);
+    }
+}
+
+PlotArchiveReader::PlotArchiveReader(const string& archivePath)
+    : archivePath_(archivePath)
+    , archiveFile_(archivePath, std::ios::binary)
+{
+    if (!archiveFile_.is_open())
+    {
+        throw std::runtime_error("Unable to open " + archivePath);
+    }
+
+    archiveFile_.seekg(0, std::ios::end);
+    const uint64_t archiveLength = archiveFile_.tellg();
+    if (archiveLength < kHeaderMagic.size() + kFooterLength)
+    {
+        throw std::runtime_error(archivePath + " is not a plot archive");
+    }
+
+    archiveFile_.seekg(archiveLength - kFooterLength);
+    const uint64_t indexOffset = readUint64(archiveFile_);
+    const uint64_t numEntries = readUint64(archiveFile_);
+    if (readString(archiveFile_, kFooterMagic.size()) != kFooterMagic)
+    {
+        throw std::runtime_error(archivePath + " is not a plot archive or was not closed properly");
+    }
+
+    // Every offset and length is checked against the file size, so a corrupt archive is rejected here instead of
+    // causing reads outside the file later
+    const uint64_t indexEnd = archiveLength - kFooterLength;
+    const uint64_t kMinEntryLength = 4 * sizeof(uint64_t) + 1;
+    if (indexOffset < kHeaderMagic.size() || indexOffset > indexEnd
+        || numEntries > (indexEnd - indexOffset) / kMinEntryLength)
+    {
+        throw std::runtime_error("Index of " + archivePath + " is corrupt");
+    }
+
+    archiveFile_.seekg(indexOffset);
+    uint64_t entryOffset = indexOffset;
+    for (uint64_t entryIndex = 0; entryIndex != numEntries; ++entryIndex)
+    {
+        // Checked in two steps, since the bytes left after a long locus id can be fewer than an entry needs
+        const uint64_t locusIdLength = readUint64(archiveFile_);
+        if (!archiveFile_ || indexEnd - entryOffset < kMinEntryLength
+            || locusIdLength > indexEnd - entryOffset - kMinEntryLength)
+        {
+            throw std::runtime_error("Index of " + archivePath + " is corrupt");
+        }
+        const string locusId = readString(archiveFile_, locusIdLength);
+        PlotArchiveEntry entry;
+        entry.offset = readUint64(archiveFile_);
+        entry.storedLength = readUint64(archiveFile_);
+        entry.length = readUint64(archiveFile_);
+        entry.isCompressed = archiveFile_.get() == 1;
+        if (!archiveFile_)
+        {
+            throw std::runtime_error("Index of " + archivePath + " is truncated");
+        }
+        entryOffset += kMinEntryLength + locusIdLength;
+
+        const bool isWithinPlots = entry.offset >= kHeaderMagic.size() && entry.offset <= indexOffset
+            && entry.storedLength <= indexOffset - entry.offset;
+        if (!isWithinPlots || (!entry.isCompressed && entry.length != entry.storedLength))
+        {
+            throw std::runtime_error("Index of " + archivePath + " has a corrupt entry for " + locusId);
+        }
+
+        locusIds_.push_back(locusId);
+        entryByLocus_[locusId] = entry;
+    }
+
+    if (entryOffset != indexEnd)
+    {
+        throw std::runtime_error("Index of " + archivePath + " is corrupt");
+    }
+}
+
+string PlotArchiveReader::get(const string& locusId)
+{
+    auto entryIter = entryByLocus_.find(locusId);
+    if (entryIter == entryByLocus_.end())
+    {
+        throw std::runtime_error("There is no plot of " + locusId + " in " + archivePath_);
+    }
+
+    const auto& entry = entryIter->second;
+    archiveFile_.seekg(entry.offset);
+    const string storedPlot = readString(archiveFile_, entry.storedLength);
+    if (!archiveFile_)
+    {
+        throw std::runtime_error("Unable to read plot of " + locusId + " from " + archivePath_);
+    }
+
+    return entry.isCompressed ? gzipDecompress(storedPlot) : storedPlot;
+}
@@ -0,0 +1,76 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Plot archives store the plots of many loci in a single file:
+//
+//   magic | plot 1 | plot 2 | ... | index | index offset | number of entries | magic
+//
+// Plots are optionally gzip-compressed. The index trailing the plots records the location of each plot, so a
+// single plot can be read without scanning the archive.
+
+struct PlotArchiveEntry
+{
+    uint64_t offset;
+    uint64_t storedLength;
+    uint64_t length;
+    bool isCompressed;
+};
+
+class PlotArchiveWriter
+{
+public:
+    PlotArchiveWriter(const std::string& archivePath, bool compressPlots);
+    ~PlotArchiveWriter();
+
+    void add(const std::string& locusId, const std::string& plot);
+    // Writes the index; the archive is unreadable until it is closed
+    void close();
+
+private:
+    std::string archivePath_;
+    bool compressPlots_;
+    std::ofstream archiveFile_;
+    uint64_t currentOffset_;
+    std::vector<std::pair<std::string, PlotArchiveEntry>> entries_;
+};
+
+class PlotArchiveReader
+{
+public:
+    explicit PlotArchiveReader(const std::string& archivePath);
+
+    const std::vector<std::string>& locusIds() const { return locusIds_; }
+    bool contains(const std::string& locusId) const { return entryByLocus_.find(locusId) != entryByLocus_.end(); }
+    std::string get(const std::string& locusId);
+
+private:
+    std::string archivePath_;
+    std::ifstream archiveFile_;
+    std::vector<std::string> locusIds_;
+    std::map<std::string, PlotArchiveEntry> entryByLocus_;
+};
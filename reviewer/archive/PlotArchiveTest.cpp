@@ -0,0 +1,137 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "archive/PlotArchive.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <catch2/catch.hpp>
+
+TEST_CASE("Plots are retrieved from archive by locus", "[Plot archive]")
+{
+    for (bool compressPlots : { false, true })
+    {
+        const std::string archivePath = "PlotArchiveTest.plots";
+        {
+            PlotArchiveWriter writer(archivePath, compressPlots);
+            writer.add("DMPK", "<svg>DMPK</svg>");
+            writer.add("HTT", "<svg>HTT</svg>");
+            writer.add("Empty", "");
+            writer.close();
+        }
+
+        PlotArchiveReader reader(archivePath);
+        REQUIRE(reader.locusIds() == std::vector<std::string>({ "DMPK", "HTT", "Empty" }));
+        REQUIRE(reader.get("HTT") == "<svg>HTT</svg>");
+        REQUIRE(reader.get("DMPK") == "<svg>DMPK</svg>");
+        REQUIRE(reader.get("Empty").empty());
+        REQUIRE_FALSE(reader.contains("FMR1"));
+        REQUIRE_THROWS(reader.get("FMR1"));
+
+        std::remove(archivePath.c_str());
+    }
+}
+
+TEST_CASE("Archives without index are rejected", "[Plot archive]")
+{
+    const std::string archivePath = "PlotArchiveTest.truncated";
+    {
+        std::ofstream archiveFile(archivePath, std::ios::binary);
+        archiveFile << "REVPLOT1<svg></svg>";
+    }
+
+    REQUIRE_THROWS(PlotArchiveReader(archivePath));
+    std::remove(archivePath.c_str());
+}
+
+TEST_CASE("Archives with corrupt index are rejected", "[Plot archive]")
+{
+    const std::string archivePath = "PlotArchiveTest.corrupt";
+    {
+        PlotArchiveWriter writer(archivePath, false);
+        writer.add("DMPK", "<svg>DMPK</svg>");
+        writer.add("HTT", "<svg>HTT</svg>");
+        writer.close();
+    }
+    std::string archive;
+    {
+        std::ifstream archiveFile(archivePath, std::ios::binary);
+        archive.assign(std::istreambuf_iterator<char>(archiveFile), std::istreambuf_iterator<char>());
+    }
+
+    auto writeArchive = [&archivePath](const std::string& contents)
+    {
+        std::ofstream archiveFile(archivePath, std::ios::binary);
+        archiveFile << contents;
+    };
+
+    // Index offset in the footer points past the end of the file
+    std::string corruptArchive = archive;
+    corruptArchive[corruptArchive.size() - 24 + 7] = '\x7f';
+    writeArchive(corruptArchive);
+    REQUIRE_THROWS(PlotArchiveReader(archivePath));
+
+    // Plots are shorter than the index expects
+    corruptArchive = archive;
+    corruptArchive.erase(8, 5);
+    writeArchive(corruptArchive);
+    REQUIRE_THROWS(PlotArchiveReader(archivePath));
+
+    std::remove(archivePath.c_str());
+}
+
+static void appendUint64(std::string& bytes, uint64_t value)
+{
+    for (size_t index = 0; index != sizeof(value); ++index)
+    {
+        bytes.push_back(static_cast<char>((value >> (8 * index)) & 0xFF));
+    }
+}
+
+TEST_CASE("Archives with oversized locus ids are rejected", "[Plot archive]")
+{
+    const std::string archivePath = "PlotArchiveTest.oversized";
+    std::string archive = "REVPLOT1<svg></svg>";
+    const uint64_t indexOffset = archive.size();
+
+    // A valid entry whose long id leaves fewer bytes than an entry needs, followed by an entry with a huge id length
+    const std::string locusId(40, 'A');
+    appendUint64(archive, locusId.size());
+    archive += locusId;
+    appendUint64(archive, 8);
+    appendUint64(archive, 11);
+    appendUint64(archive, 11);
+    archive.push_back(0);
+    appendUint64(archive, static_cast<uint64_t>(1) << 62);
+
+    appendUint64(archive, indexOffset);
+    appendUint64(archive, 2);
+    archive += "REVINDX1";
+    {
+        std::ofstream archiveFile(archivePath, std::ios::binary);
+        archiveFile << archive;
+    }
+
+    REQUIRE_THROWS_AS(PlotArchiveReader(archivePath), std::runtime_error);
+    std::remove(archivePath.c_str());
+}
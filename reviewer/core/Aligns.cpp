@@ -17,3 +17,24 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 //
+
+#include "core/Aligns.hh"
+
+using graphtools::NodeId;
+using graphtools::Path;
+
+ReadPathAlign::ReadPathAlign(const Path& hapPath, int pathIndex, int startIndexOnPath, GraphAlignPtr align)
+    : pathIndex(pathIndex)
+    , startIndexOnPath(startIndexOnPath)
+    , align(std::move(align))
+{
+    int prefixLen = 0;
+    for (int nodeIndex = 0; nodeIndex != startIndexOnPath; ++nodeIndex)
+    {
+        NodeId node = hapPath.nodeIds()[nodeIndex];
+        prefixLen += hapPath.graphRawPtr()->nodeSeq(node).length();
+    }
+
+    begin = prefixLen + this->align->path().startPosition();
+    end = begin + this->align->referenceLength();
+}
@@ -46,8 +46,12 @@ using Json = nlohmann::json;
 
 namespace spd = spdlog;
 
-LocusSpecification::LocusSpecification(RegionId locusId, graphtools::Graph regionGraph)
+LocusSpecification::LocusSpecification(
+    RegionId locusId, vector<GenomicRegion> targetReadExtractionRegions,
+    vector<GenomicRegion> offtargetReadExtractionRegions, graphtools::Graph regionGraph)
     : locusId_(std::move(locusId))
+    , targetReadExtractionRegions_(std::move(targetReadExtractionRegions))
+    , offtargetReadExtractionRegions_(std::move(offtargetReadExtractionRegions))
     , regionGraph_(std::move(regionGraph))
 {
 }
@@ -41,9 +41,18 @@ using NodeToRegionAssociation = std::unordered_map<graphtools::NodeId, GenomicRe
 class LocusSpecification
 {
 public:
-    LocusSpecification(RegionId locusId, graphtools::Graph regionGraph);
+    LocusSpecification(
+        RegionId locusId, std::vector<GenomicRegion> targetReadExtractionRegions,
+        std::vector<GenomicRegion> offtargetReadExtractionRegions, graphtools::Graph regionGraph);
 
     const RegionId& locusId() const { return locusId_; }
+    /// Regions around the locus whose reads are extracted; the first variant and the flanks by default
+    const std::vector<GenomicRegion>& targetReadExtractionRegions() const { return targetReadExtractionRegions_; }
+    /// Regions elsewhere in the genome where reads originating from the locus may be aligned
+    const std::vector<GenomicRegion>& offtargetReadExtractionRegions() const
+    {
+        return offtargetReadExtractionRegions_;
+    }
     const graphtools::Graph& regionGraph() const { return regionGraph_; }
     const std::vector<VariantSpecification>& variantSpecs() const { return variantSpecs_; }
     void addVariantSpecification(
@@ -55,6 +64,8 @@ public:
 
 private:
     std::string locusId_;
+    std::vector<GenomicRegion> targetReadExtractionRegions_;
+    std::vector<GenomicRegion> offtargetReadExtractionRegions_;
     graphtools::Graph regionGraph_;
     std::vector<VariantSpecification> variantSpecs_;
 };
@@ -0,0 +1,322 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "metrics/MetricsStore.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using std::string;
+using std::vector;
+
+static const string kMagic = "REVMET01";
+static const uint64_t kNumHeaderFields = 9;
+static const uint64_t kHeaderLength = 8 + kNumHeaderFields * sizeof(uint64_t);
+static const int32_t kMissingLength = -1;
+
+template <typename T> static void appendUint(string& buffer, T value)
+{
+    for (size_t index = 0; index != sizeof(T); ++index)
+    {
+        buffer.push_back(static_cast<char>((value >> (8 * index)) & 0xFF));
+    }
+}
+
+template <typename T> static T decodeUint(const char* bytes)
+{
+    T value = 0;
+    for (size_t index = 0; index != sizeof(T); ++index)
+    {
+        value |= static_cast<T>(static_cast<unsigned char>(bytes[index])) << (8 * index);
+    }
+    return value;
+}
+
+static void appendFloat(string& buffer, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appendUint(buffer, bits);
+}
+
+static float decodeFloat(const char* bytes)
+{
+    const uint32_t bits = decodeUint<uint32_t>(bytes);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void alignSection(string& buffer)
+{
+    while (buffer.size() % 8)
+    {
+        buffer.push_back('\0');
+    }
+}
+
+MetricsStoreWriter::MetricsStoreWriter(string storePath, string sampleId)
+    : storePath_(std::move(storePath))
+    , sampleId_(std::move(sampleId))
+{
+}
+
+void MetricsStoreWriter::add(const Metrics& metrics)
+{
+    if (static_cast<int>(metrics.genotype.size()) > kNumAlleles
+        || static_cast<int>(metrics.alleleDepth.size()) > kNumAlleles)
+    {
+        throw std::runtime_error("Metrics store supports at most 2 alleles but " + metrics.variantId + " has more");
+    }
+    rows_.push_back(metrics);
+}
+
+void MetricsStoreWriter::write() const
+{
+    auto rows = rows_;
+    std::stable_sort(
+        rows.begin(), rows.end(), [](const Metrics& lhs, const Metrics& rhs) { return lhs.variantId < rhs.variantId; });
+
+    vector<string> dictionary;
+    vector<uint32_t> codes;
+    vector<std::pair<uint32_t, uint32_t>> rowRanges;
+    for (uint32_t row = 0; row != rows.size(); ++row)
+    {
+        if (dictionary.empty() || dictionary.back() != rows[row].variantId)
+        {
+            dictionary.push_back(rows[row].variantId);
+            rowRanges.emplace_back(row, row);
+        }
+        codes.push_back(dictionary.size() - 1);
+        rowRanges.back().second = row + 1;
+    }
+
+    // Header is filled in once section offsets are known
+    string buffer(kHeaderLength, '\0');
+    vector<uint64_t> header = { rows.size(), dictionary.size() };
+
+    header.push_back(buffer.size());
+    header.push_back(sampleId_.size());
+    buffer += sampleId_;
+    alignSection(buffer);
+
+    header.push_back(buffer.size());
+    uint64_t entryOffset = 0;
+    for (const auto& entry : dictionary)
+    {
+        appendUint<uint64_t>(buffer, entryOffset);
+        entryOffset += entry.size();
+    }
+    appendUint<uint64_t>(buffer, entryOffset);
+    for (const auto& entry : dictionary)
+    {
+        buffer += entry;
+    }
+    alignSection(buffer);
+
+    header.push_back(buffer.size());
+    for (const auto& rowRange : rowRanges)
+    {
+        appendUint<uint32_t>(buffer, rowRange.first);
+        appendUint<uint32_t>(buffer, rowRange.second);
+    }
+
+    header.push_back(buffer.size());
+    for (uint32_t code : codes)
+    {
+        appendUint<uint32_t>(buffer, code);
+    }
+    alignSection(buffer);
+
+    header.push_back(buffer.size());
+    for (int allele = 0; allele != kNumAlleles; ++allele)
+    {
+        for (const auto& metrics : rows)
+        {
+            const bool hasAllele = allele < static_cast<int>(metrics.genotype.size());
+            appendUint<uint32_t>(buffer, hasAllele ? metrics.genotype[allele] : kMissingLength);
+        }
+    }
+    alignSection(buffer);
+
+    header.push_back(buffer.size());
+    for (int allele = 0; allele != kNumAlleles; ++allele)
+    {
+        for (const auto& metrics : rows)
+        {
+            const bool hasAllele = allele < static_cast<int>(metrics.alleleDepth.size());
+            appendFloat(buffer, hasAllele ? static_cast<float>(metrics.alleleDepth[allele]) : NAN);
+        }
+    }
+
+    string headerBytes = kMagic;
+    for (uint64_t field : header)
+    {
+        appendUint(headerBytes, field);
+    }
+    buffer.replace(0, kHeaderLength, headerBytes);
+
+    std::ofstream storeFile(storePath_, std::ios::binary);
+    if (!storeFile.is_open())
+    {
+        throw std::runtime_error("Unable to open " + storePath_);
+    }
+    storeFile.write(buffer.data(), buffer.size());
+    storeFile.close();
+    if (!storeFile)
+    {
+        throw std::runtime_error("Unable to write " + storePath_);
+    }
+}
+
+MetricsStoreReader::MetricsStoreReader(const string& storePath)
+    : storePath_(storePath)
+{
+    try
+    {
+        file_.open(storePath);
+    }
+    catch (const std::exception&)
+    {
+        throw std::runtime_error("Unable to open " + storePath);
+    }
+
+    if (file_.size() < kHeaderLength || string(file_.data(), kMagic.size()) != kMagic)
+    {
+        throw std::runtime_error(storePath + " is not a metrics store");
+    }
+
+    const char* field = file_.data() + kMagic.size();
+    uint64_t* const fields[] = { &numRows_,          &numVariants_, &sampleIdOffset_,      &sampleIdLength_,
+                                 &dictionaryOffset_, &indexOffset_, &variantColumnOffset_, &genotypeColumnsOffset_,
+                                 &depthColumnsOffset_ };
+    for (uint64_t* value : fields)
+    {
+        *value = decodeUint<uint64_t>(field);
+        field += sizeof(uint64_t);
+    }
+
+    // Sizes are compared with the space left after each offset, so corrupt offsets and counts cannot overflow
+    const uint64_t size = file_.size();
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t width)
+    { return offset <= size && count <= (size - offset) / width; };
+
+    // Every variant has at least one row, which bounds the number of dictionary offsets by the file size
+    const uint64_t numAlleles = MetricsStoreWriter::kNumAlleles;
+    const bool isComplete = fits(sampleIdOffset_, sampleIdLength_, 1)
+        && fits(variantColumnOffset_, numRows_, sizeof(uint32_t)) && numVariants_ <= numRows_
+        && fits(dictionaryOffset_, numVariants_ + 1, sizeof(uint64_t))
+        && fits(indexOffset_, 2 * numVariants_, sizeof(uint32_t))
+        && fits(genotypeColumnsOffset_, numAlleles * numRows_, sizeof(int32_t))
+        && fits(depthColumnsOffset_, numAlleles * numRows_, sizeof(float))
+        && size - depthColumnsOffset_ == numAlleles * numRows_ * sizeof(float);
+    if (!isComplete)
+    {
+        throw std::runtime_error(storePath + " is truncated");
+    }
+
+    // Values that locate other data are validated once here, so lookups never read outside the file
+    const uint64_t entriesOffset = dictionaryOffset_ + (numVariants_ + 1) * sizeof(uint64_t);
+    uint64_t previousEnd = 0;
+    for (uint64_t code = 0; code <= numVariants_; ++code)
+    {
+        const uint64_t end = decodeUint<uint64_t>(section(dictionaryOffset_) + code * sizeof(uint64_t));
+        if (end < previousEnd || !fits(entriesOffset, end, 1))
+        {
+            throw std::runtime_error(storePath + " has a corrupt variant dictionary");
+        }
+        previousEnd = end;
+    }
+
+    for (uint64_t code = 0; code != numVariants_; ++code)
+    {
+        const char* rowRange = section(indexOffset_) + code * 2 * sizeof(uint32_t);
+        const uint32_t first = decodeUint<uint32_t>(rowRange);
+        const uint32_t last = decodeUint<uint32_t>(rowRange + sizeof(uint32_t));
+        if (first > last || last > numRows_)
+        {
+            throw std::runtime_error(storePath + " has a corrupt variant index");
+        }
+    }
+
+    for (uint64_t row = 0; row != numRows_; ++row)
+    {
+        if (decodeUint<uint32_t>(section(variantColumnOffset_) + row * sizeof(uint32_t)) >= numVariants_)
+        {
+            throw std::runtime_error(storePath + " has a corrupt variant column");
+        }
+    }
+}
+
+string MetricsStoreReader::sampleId() const { return string(section(sampleIdOffset_), sampleIdLength_); }
+
+string MetricsStoreReader::getDictionaryEntry(uint64_t code) const
+{
+    const char* offsets = section(dictionaryOffset_);
+    const char* entries = offsets + (numVariants_ + 1) * sizeof(uint64_t);
+    const uint64_t start = decodeUint<uint64_t>(offsets + code * sizeof(uint64_t));
+    const uint64_t end = decodeUint<uint64_t>(offsets + (code + 1) * sizeof(uint64_t));
+    return string(entries + start, end - start);
+}
+
+std::pair<int, int> MetricsStoreReader::findRows(const string& variantId) const
+{
+    uint64_t first = 0;
+    uint64_t last = numVariants_;
+    while (first < last)
+    {
+        const uint64_t middle = first + (last - first) / 2;
+        if (getDictionaryEntry(middle) < variantId)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+
+    if (first == numVariants_ || getDictionaryEntry(first) != variantId)
+    {
+        return { 0, 0 };
+    }
+
+    const char* rowRange = section(indexOffset_) + first * 2 * sizeof(uint32_t);
+    return { decodeUint<uint32_t>(rowRange), decodeUint<uint32_t>(rowRange + sizeof(uint32_t)) };
+}
+
+string MetricsStoreReader::variantId(int row) const
+{
+    return getDictionaryEntry(decodeUint<uint32_t>(section(variantColumnOffset_) + row * sizeof(uint32_t)));
+}
+
+int MetricsStoreReader::genotype(int row, int allele) const
+{
+    const char* value = section(genotypeColumnsOffset_) + (allele * numRows_ + row) * sizeof(int32_t);
+    return static_cast<int32_t>(decodeUint<uint32_t>(value));
+}
+
+double MetricsStoreReader::alleleDepth(int row, int allele) const
+{
+    return decodeFloat(section(depthColumnsOffset_) + (allele * numRows_ + row) * sizeof(float));
+}
@@ -0,0 +1,91 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "metrics/Metrics.hh"
+
+// Metrics stores hold the metrics of one sample in columns that can be scanned without parsing:
+//
+//   header | sample id | variant dictionary | variant index | variant column | genotype columns | depth columns
+//
+// Variant ids are dictionary-encoded; the dictionary is sorted, and rows are sorted by variant, so the index maps
+// each dictionary entry to a contiguous range of rows. Genotypes (int32) and allele depths (float32) are stored in one
+// fixed-width column per allele. All values are little-endian and all sections start at multiples of 8 bytes.
+
+class MetricsStoreWriter
+{
+public:
+    // Number of allele columns; alleles of haploid genotypes are padded with missing values
+    static const int kNumAlleles = 2;
+
+    MetricsStoreWriter(std::string storePath, std::string sampleId);
+
+    void add(const Metrics& metrics);
+    void write() const;
+
+private:
+    std::string storePath_;
+    std::string sampleId_;
+    std::vector<Metrics> rows_;
+};
+
+/// Memory-mapped view of a metrics store
+class MetricsStoreReader
+{
+public:
+    explicit MetricsStoreReader(const std::string& storePath);
+
+    std::string sampleId() const;
+    int numRows() const { return static_cast<int>(numRows_); }
+    int numVariants() const { return static_cast<int>(numVariants_); }
+
+    /// \return Range [first, last) of rows of the given variant; the range is empty if the variant is absent
+    std::pair<int, int> findRows(const std::string& variantId) const;
+
+    std::string variantId(int row) const;
+    /// \return Repeat length of the allele or -1 if the genotype has fewer alleles
+    int genotype(int row, int allele) const;
+    /// \return Depth of the allele or NaN if the genotype has fewer alleles
+    double alleleDepth(int row, int allele) const;
+
+private:
+    std::string getDictionaryEntry(uint64_t code) const;
+    const char* section(uint64_t offset) const { return file_.data() + offset; }
+
+    std::string storePath_;
+    boost::iostreams::mapped_file_source file_;
+    uint64_t numRows_;
+    uint64_t numVariants_;
+    uint64_t sampleIdOffset_;
+    uint64_t sampleIdLength_;
+    uint64_t dictionaryOffset_;
+    uint64_t indexOffset_;
+    uint64_t variantColumnOffset_;
+    uint64_t genotypeColumnsOffset_;
+    uint64_t depthColumnsOffset_;
+};
@@ -0,0 +1,133 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "metrics/MetricsStore.hh"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <catch2/catch.hpp>
+
+static Metrics makeMetrics(std::string variantId, std::vector<int> genotype, std::vector<double> alleleDepth)
+{
+    Metrics metrics;
+    metrics.variantId = std::move(variantId);
+    metrics.genotype = std::move(genotype);
+    metrics.alleleDepth = std::move(alleleDepth);
+    return metrics;
+}
+
+TEST_CASE("Metrics are retrieved from store by variant", "[Metrics store]")
+{
+    const std::string storePath = "MetricsStoreTest.metrics.bin";
+    {
+        MetricsStoreWriter writer(storePath, "HG002");
+        writer.add(makeMetrics("HTT", { 17, 40 }, { 12.5, 3.0 }));
+        writer.add(makeMetrics("DMPK", { 5, 5 }, { 20.0, 18.25 }));
+        writer.add(makeMetrics("AR", { 22 }, { 30.0 }));
+        writer.write();
+    }
+
+    MetricsStoreReader reader(storePath);
+    REQUIRE(reader.sampleId() == "HG002");
+    REQUIRE(reader.numRows() == 3);
+    REQUIRE(reader.numVariants() == 3);
+
+    const auto httRows = reader.findRows("HTT");
+    REQUIRE(httRows == std::make_pair(2, 3));
+    REQUIRE(reader.variantId(httRows.first) == "HTT");
+    REQUIRE(reader.genotype(httRows.first, 0) == 17);
+    REQUIRE(reader.genotype(httRows.first, 1) == 40);
+    REQUIRE(reader.alleleDepth(httRows.first, 1) == 3.0);
+
+    const auto arRows = reader.findRows("AR");
+    REQUIRE(arRows == std::make_pair(0, 1));
+    REQUIRE(reader.genotype(arRows.first, 0) == 22);
+    REQUIRE(reader.genotype(arRows.first, 1) == -1);
+    REQUIRE(std::isnan(reader.alleleDepth(arRows.first, 1)));
+
+    const auto fmr1Rows = reader.findRows("FMR1");
+    REQUIRE(fmr1Rows.first == fmr1Rows.second);
+
+    std::remove(storePath.c_str());
+}
+
+TEST_CASE("Truncated metrics stores are rejected", "[Metrics store]")
+{
+    const std::string storePath = "MetricsStoreTest.truncated";
+    {
+        std::ofstream storeFile(storePath, std::ios::binary);
+        storeFile << "REVMET01";
+    }
+
+    REQUIRE_THROWS(MetricsStoreReader(storePath));
+    std::remove(storePath.c_str());
+}
+
+TEST_CASE("Metrics stores with corrupt offsets or codes are rejected", "[Metrics store]")
+{
+    const std::string storePath = "MetricsStoreTest.corrupt";
+    {
+        MetricsStoreWriter writer(storePath, "HG002");
+        writer.add(makeMetrics("HTT", { 17, 40 }, { 12.5, 3.0 }));
+        writer.add(makeMetrics("DMPK", { 5, 5 }, { 20.0, 18.25 }));
+        writer.write();
+    }
+    std::string store;
+    {
+        std::ifstream storeFile(storePath, std::ios::binary);
+        store.assign(std::istreambuf_iterator<char>(storeFile), std::istreambuf_iterator<char>());
+    }
+
+    // Header fields follow the 8-byte magic; field 4 is the dictionary offset and field 6 the variant column offset
+    auto getHeaderField = [&store](int field)
+    {
+        uint64_t value = 0;
+        for (int index = 0; index != 8; ++index)
+        {
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(store[8 + 8 * field + index])) << (8 * index);
+        }
+        return value;
+    };
+    auto writeStore = [&storePath](const std::string& contents)
+    {
+        std::ofstream storeFile(storePath, std::ios::binary);
+        storeFile << contents;
+    };
+
+    // End offset of the first dictionary entry points far past the end of the file
+    std::string corruptStore = store;
+    corruptStore[getHeaderField(4) + 8 + 6] = '\x7f';
+    writeStore(corruptStore);
+    REQUIRE_THROWS(MetricsStoreReader(storePath));
+
+    // Variant code of the first row is not in the dictionary
+    corruptStore = store;
+    corruptStore[getHeaderField(6)] = '\x09';
+    writeStore(corruptStore);
+    REQUIRE_THROWS(MetricsStoreReader(storePath));
+
+    writeStore(store);
+    REQUIRE_NOTHROW(MetricsStoreReader(storePath));
+
+    std::remove(storePath.c_str());
+}
@@ -0,0 +1,359 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "snps/FlankPhasing.hh"
+
+#include <algorithm>
+#include <map>
+
+#include "snps/Pileup.hh"
+
+using graphtools::Graph;
+using graphtools::NodeId;
+using std::map;
+using std::string;
+using std::vector;
+
+namespace snps
+{
+
+// Each base of a heterozygous site must be seen on at least this many reads and make up this fraction of the depth
+static const int kMinHetBaseCount = 2;
+static const double kMinHetBaseFraction = 0.2;
+
+// A base of a site is linked to the repeat length seen with it on at least this many fragments and this fraction of
+// the fragments spanning the repeat
+static const int kMinLinkCount = 2;
+static const double kMinLinkFraction = 0.8;
+
+static vector<HetSite> getHetSites(const FlankPileup& pileup)
+{
+    vector<HetSite> sites;
+    for (int position = 0; position != pileup.numPositions(); ++position)
+    {
+        int firstBaseIndex = 0;
+        int secondBaseIndex = 1;
+        if (pileup.count(position, secondBaseIndex) > pileup.count(position, firstBaseIndex))
+        {
+            std::swap(firstBaseIndex, secondBaseIndex);
+        }
+        for (int baseIndex = 2; baseIndex != kNumBases; ++baseIndex)
+        {
+            if (pileup.count(position, baseIndex) > pileup.count(position, firstBaseIndex))
+            {
+                secondBaseIndex = firstBaseIndex;
+                firstBaseIndex = baseIndex;
+            }
+            else if (pileup.count(position, baseIndex) > pileup.count(position, secondBaseIndex))
+            {
+                secondBaseIndex = baseIndex;
+            }
+        }
+
+        const int secondBaseCount = pileup.count(position, secondBaseIndex);
+        if (secondBaseCount >= kMinHetBaseCount && secondBaseCount >= kMinHetBaseFraction * pileup.depth(position))
+        {
+            sites.emplace_back(
+                pileup.getNode(position), pileup.getOffset(position), decodeBase(firstBaseIndex),
+                decodeBase(secondBaseIndex));
+        }
+    }
+
+    return sites;
+}
+
+static FlankPileup getFlankPileup(const Graph& graph, const FragById& fragById)
+{
+    FlankPileup pileup(graph);
+    for (const auto& fragIdAndFrag : fragById)
+    {
+        const auto& frag = fragIdAndFrag.second;
+        pileup.add(frag.read.align, frag.read.bases);
+        pileup.add(frag.mate.align, frag.mate.bases);
+    }
+    return pileup;
+}
+
+vector<HetSite> findHetSites(const Graph& graph, const FragById& fragById)
+{
+    return getHetSites(getFlankPileup(graph, fragById));
+}
+
+static vector<NodeId> getRepeatNodes(const LocusSpecification& locusSpec)
+{
+    vector<NodeId> repeatNodes;
+    for (const auto& variantSpec : locusSpec.variantSpecs())
+    {
+        if (variantSpec.classification().type == VariantType::kRepeat && variantSpec.nodes().size() == 1)
+        {
+            repeatNodes.push_back(variantSpec.nodes().front());
+        }
+    }
+    return repeatNodes;
+}
+
+// Value of fragment observations that differ between the reads of the fragment
+static const int kConflict = -2;
+
+static void observe(int value, int& observation)
+{
+    if (observation == -1)
+    {
+        observation = value;
+    }
+    else if (observation != value)
+    {
+        observation = kConflict;
+    }
+}
+
+/// \return Length of the repeat in the read or -1 if the read does not span the repeat
+static int getSpannedRepeatLength(const GraphAlign& align, NodeId repeatNode)
+{
+    const auto& nodes = align.path().nodeIds();
+    if (nodes.front() >= repeatNode || nodes.back() <= repeatNode)
+    {
+        return -1;
+    }
+    return static_cast<int>(std::count(nodes.begin(), nodes.end(), repeatNode));
+}
+
+struct Link
+{
+    int baseIndex;
+    int repeatIndex;
+    int repeatLength;
+};
+
+/// \return Links of each site that is linked to at least two repeats
+static vector<vector<Link>> getPhasingLinks(
+    const FlankPileup& pileup, const vector<HetSite>& sites, const vector<NodeId>& repeatNodes,
+    const FragById& fragById)
+{
+    vector<int> siteByPosition(pileup.numPositions(), -1);
+    for (int siteIndex = 0; siteIndex != static_cast<int>(sites.size()); ++siteIndex)
+    {
+        siteByPosition[pileup.getPosition(sites[siteIndex].node, sites[siteIndex].offset)] = siteIndex;
+    }
+
+    // Counts of repeat lengths seen with each base of each site, indexed by (site, base, repeat)
+    const int numRepeats = static_cast<int>(repeatNodes.size());
+    vector<map<int, int>> lengthCounts(sites.size() * 2 * numRepeats);
+    vector<int> siteBases(sites.size(), -1);
+    vector<int> observedSites;
+    for (const auto& fragIdAndFrag : fragById)
+    {
+        const auto& frag = fragIdAndFrag.second;
+        for (const Read* read : { &frag.read, &frag.mate })
+        {
+            forEachAlignedBase(
+                read->align, read->bases,
+                [&](int nodeIndex, int offset, int baseIndex)
+                {
+                    const int position = pileup.getPosition(read->align.getNodeIdByIndex(nodeIndex), offset);
+                    const int siteIndex = position == -1 ? -1 : siteByPosition[position];
+                    if (siteIndex == -1)
+                    {
+                        return;
+                    }
+
+                    const auto& site = sites[siteIndex];
+                    const char base = decodeBase(baseIndex);
+                    const int siteBase = base == site.bases[0] ? 0 : base == site.bases[1] ? 1 : kConflict;
+                    if (siteBases[siteIndex] == -1)
+                    {
+                        observedSites.push_back(siteIndex);
+                    }
+                    observe(siteBase, siteBases[siteIndex]);
+                });
+        }
+
+        for (int repeatIndex = 0; repeatIndex != numRepeats && !observedSites.empty(); ++repeatIndex)
+        {
+            int repeatLength = -1;
+            for (const Read* read : { &frag.read, &frag.mate })
+            {
+                const int readRepeatLength = getSpannedRepeatLength(read->align, repeatNodes[repeatIndex]);
+                if (readRepeatLength != -1)
+                {
+                    observe(readRepeatLength, repeatLength);
+                }
+            }
+            if (repeatLength < 0)
+            {
+                continue;
+            }
+
+            for (int siteIndex : observedSites)
+            {
+                if (siteBases[siteIndex] >= 0)
+                {
+                    ++lengthCounts[(siteIndex * 2 + siteBases[siteIndex]) * numRepeats + repeatIndex][repeatLength];
+                }
+            }
+        }
+
+        for (int siteIndex : observedSites)
+        {
+            siteBases[siteIndex] = -1;
+        }
+        observedSites.clear();
+    }
+
+    vector<vector<Link>> linksBySite;
+    for (int siteIndex = 0; siteIndex != static_cast<int>(sites.size()); ++siteIndex)
+    {
+        vector<Link> links;
+        vector<bool> isRepeatLinked(numRepeats, false);
+        for (int baseIndex = 0; baseIndex != 2; ++baseIndex)
+        {
+            for (int repeatIndex = 0; repeatIndex != numRepeats; ++repeatIndex)
+            {
+                const auto& counts = lengthCounts[(siteIndex * 2 + baseIndex) * numRepeats + repeatIndex];
+                int totalCount = 0;
+                auto topLengthAndCount = counts.end();
+                for (auto lengthAndCount = counts.begin(); lengthAndCount != counts.end(); ++lengthAndCount)
+                {
+                    totalCount += lengthAndCount->second;
+                    if (topLengthAndCount == counts.end() || lengthAndCount->second > topLengthAndCount->second)
+                    {
+                        topLengthAndCount = lengthAndCount;
+                    }
+                }
+
+                if (topLengthAndCount != counts.end() && topLengthAndCount->second >= kMinLinkCount
+                    && topLengthAndCount->second >= kMinLinkFraction * totalCount)
+                {
+                    links.push_back({ baseIndex, repeatIndex, topLengthAndCount->first });
+                    isRepeatLinked[repeatIndex] = true;
+                }
+            }
+        }
+
+        if (std::count(isRepeatLinked.begin(), isRepeatLinked.end(), true) >= 2)
+        {
+            linksBySite.push_back(links);
+        }
+    }
+
+    return linksBySite;
+}
+
+static bool isConsistent(const vector<vector<int>>& repeatLengthsByHap, const vector<vector<Link>>& linksBySite)
+{
+    for (const auto& links : linksBySite)
+    {
+        bool hasConsistentPhase = false;
+        for (int firstBaseHap = 0; firstBaseHap != 2 && !hasConsistentPhase; ++firstBaseHap)
+        {
+            hasConsistentPhase = std::all_of(
+                links.begin(), links.end(),
+                [&](const Link& link)
+                {
+                    const int hapIndex = link.baseIndex == 0 ? firstBaseHap : 1 - firstBaseHap;
+                    return repeatLengthsByHap[hapIndex][link.repeatIndex] == link.repeatLength;
+                });
+        }
+
+        if (!hasConsistentPhase)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+vector<GraphPaths> pruneDiplotypesByFlankSnps(
+    const LocusSpecification& locusSpec, const FragById& fragById, vector<GraphPaths> diplotypes)
+{
+    const auto repeatNodes = getRepeatNodes(locusSpec);
+    if (repeatNodes.size() < 2 || diplotypes.size() < 2)
+    {
+        return diplotypes;
+    }
+
+    const auto pileup = getFlankPileup(locusSpec.regionGraph(), fragById);
+    const auto sites = getHetSites(pileup);
+    const auto linksBySite = getPhasingLinks(pileup, sites, repeatNodes, fragById);
+    if (linksBySite.empty())
+    {
+        return diplotypes;
+    }
+
+    // Diplotypes that only differ by phase have the same genotype of every repeat
+    map<vector<int>, vector<int>> diplotypeIndexesByGenotypes;
+    vector<bool> isKept(diplotypes.size(), true);
+    for (int diplotypeIndex = 0; diplotypeIndex != static_cast<int>(diplotypes.size()); ++diplotypeIndex)
+    {
+        const auto& diplotype = diplotypes[diplotypeIndex];
+        if (diplotype.size() != 2)
+        {
+            continue;
+        }
+
+        vector<vector<int>> repeatLengthsByHap;
+        for (const auto& hapPath : diplotype)
+        {
+            vector<int> repeatLengths;
+            for (NodeId repeatNode : repeatNodes)
+            {
+                repeatLengths.push_back(std::count(hapPath.nodeIds().begin(), hapPath.nodeIds().end(), repeatNode));
+            }
+            repeatLengthsByHap.push_back(repeatLengths);
+        }
+
+        vector<int> genotypes;
+        for (int repeatIndex = 0; repeatIndex != static_cast<int>(repeatNodes.size()); ++repeatIndex)
+        {
+            genotypes.push_back(std::min(repeatLengthsByHap[0][repeatIndex], repeatLengthsByHap[1][repeatIndex]));
+            genotypes.push_back(std::max(repeatLengthsByHap[0][repeatIndex], repeatLengthsByHap[1][repeatIndex]));
+        }
+        diplotypeIndexesByGenotypes[genotypes].push_back(diplotypeIndex);
+        isKept[diplotypeIndex] = isConsistent(repeatLengthsByHap, linksBySite);
+    }
+
+    for (const auto& genotypesAndDiplotypeIndexes : diplotypeIndexesByGenotypes)
+    {
+        const auto& diplotypeIndexes = genotypesAndDiplotypeIndexes.second;
+        const bool hasConsistentPhase = std::any_of(
+            diplotypeIndexes.begin(), diplotypeIndexes.end(), [&isKept](int index) { return isKept[index]; });
+        if (!hasConsistentPhase)
+        {
+            for (int diplotypeIndex : diplotypeIndexes)
+            {
+                isKept[diplotypeIndex] = true;
+            }
+        }
+    }
+
+    vector<GraphPaths> keptDiplotypes;
+    for (int diplotypeIndex = 0; diplotypeIndex != static_cast<int>(diplotypes.size()); ++diplotypeIndex)
+    {
+        if (isKept[diplotypeIndex])
+        {
+            keptDiplotypes.push_back(std::move(diplotypes[diplotypeIndex]));
+        }
+    }
+
+    return keptDiplotypes;
+}
+
+}
@@ -0,0 +1,58 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <vector>
+
+#include "core/Aligns.hh"
+#include "core/LocusSpecification.hh"
+
+namespace snps
+{
+
+/// Flank position where the reads show two bases
+struct HetSite
+{
+    HetSite(graphtools::NodeId node, int offset, char firstBase, char secondBase)
+        : node(node)
+        , offset(offset)
+        , bases{ firstBase, secondBase }
+    {
+    }
+
+    graphtools::NodeId node;
+    int offset;
+    char bases[2];
+};
+
+/// Finds heterozygous flank positions from a pileup of all reads of the locus
+std::vector<HetSite> findHetSites(const graphtools::Graph& graph, const FragById& fragById);
+
+/// Drops candidate diplotypes whose phasing of the repeats contradicts the flank SNPs
+///
+/// Fragments with one read over a heterozygous flank site and a read spanning a repeat link the bases of the site to
+/// repeat lengths. A site linked to at least two repeats fixes their phase, so of the candidates that only differ by
+/// phase, those that cannot assign the bases of every such site to haplotypes carrying the linked lengths are dropped.
+/// Candidates are kept if none of their phase combinations is consistent with the links.
+std::vector<GraphPaths> pruneDiplotypesByFlankSnps(
+    const LocusSpecification& locusSpec, const FragById& fragById, std::vector<GraphPaths> diplotypes);
+
+}
@@ -0,0 +1,120 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "snps/FlankPhasing.hh"
+
+#include <string>
+#include <vector>
+
+#include <catch2/catch.hpp>
+
+#include "graphalign/GraphAlignmentOperations.hh"
+
+using graphtools::Graph;
+using graphtools::NodeId;
+using std::string;
+using std::vector;
+
+using namespace snps;
+
+static Graph makeCompoundRepeatGraph()
+{
+    Graph graph(5);
+    graph.setNodeSeq(0, "ACGTACGTAC");
+    graph.setNodeSeq(1, "CAG");
+    graph.setNodeSeq(2, "TTAGG");
+    graph.setNodeSeq(3, "GCC");
+    graph.setNodeSeq(4, "ATGCATGCAA");
+    for (NodeId node = 0; node != 4; ++node)
+    {
+        graph.addEdge(node, node + 1);
+    }
+    graph.addEdge(1, 1);
+    graph.addEdge(3, 3);
+    return graph;
+}
+
+static LocusSpecification makeLocusSpec(const Graph& graph, const vector<NodeId>& repeatNodes)
+{
+    LocusSpecification locusSpec("LOCUS", {}, {}, graph);
+    for (NodeId repeatNode : repeatNodes)
+    {
+        locusSpec.addVariantSpecification(
+            "REPEAT" + std::to_string(repeatNode),
+            VariantClassification(VariantType::kRepeat, VariantSubtype::kCommonRepeat), GenomicRegion(0, 0, 1),
+            { repeatNode }, boost::none);
+    }
+    return locusSpec;
+}
+
+static GraphPath makeHaplotype(const Graph& graph, int firstRepeatLength, int secondRepeatLength)
+{
+    vector<NodeId> nodes = { 0 };
+    nodes.insert(nodes.end(), firstRepeatLength, 1);
+    nodes.push_back(2);
+    nodes.insert(nodes.end(), secondRepeatLength, 3);
+    nodes.push_back(4);
+    return GraphPath(&graph, 0, nodes, 10);
+}
+
+static void addFrags(
+    const Graph& graph, int numFrags, const string& readCigar, const string& readBases, const string& mateCigar,
+    const string& mateBases, FragById& fragById)
+{
+    for (int fragIndex = 0; fragIndex != numFrags; ++fragIndex)
+    {
+        Read read(readBases, string(readBases.size(), '#'), graphtools::decodeGraphAlignment(2, readCigar, &graph));
+        Read mate(mateBases, string(mateBases.size(), '#'), graphtools::decodeGraphAlignment(3, mateCigar, &graph));
+        fragById.emplace("frag" + std::to_string(fragById.size()), Frag(read, mate));
+    }
+}
+
+TEST_CASE("Phase combinations contradicting flank SNPs are dropped", "[Flank phasing]")
+{
+    const Graph graph = makeCompoundRepeatGraph();
+
+    // Haplotype with 2 and 3 repeat units carries C at position 5 of the left flank and the other haplotype, with 4 and
+    // 1 units, carries T
+    FragById fragById;
+    addFrags(
+        graph, 3, "0[8M]1[3M]1[3M]2[2M]", "GTACGTACCAGCAGTT", "2[2M]3[3M]3[3M]3[3M]4[4M]", "GGGCCGCCGCCATGC",
+        fragById);
+    addFrags(
+        graph, 3, "0[3M1X4M]1[3M]1[3M]1[3M]1[3M]2[2M]", "GTATGTACCAGCAGCAGCAGTT", "2[2M]3[3M]4[4M]", "GGGCCATGC",
+        fragById);
+
+    const auto sites = findHetSites(graph, fragById);
+    REQUIRE(sites.size() == 1);
+    REQUIRE(sites.front().node == 0);
+    REQUIRE(sites.front().offset == 5);
+    REQUIRE(string(sites.front().bases, 2) == "CT");
+
+    const GraphPaths consistentPhase = { makeHaplotype(graph, 4, 1), makeHaplotype(graph, 2, 3) };
+    const GraphPaths inconsistentPhase = { makeHaplotype(graph, 4, 3), makeHaplotype(graph, 2, 1) };
+    const GraphPaths unlinkedGenotype = { makeHaplotype(graph, 4, 4), makeHaplotype(graph, 2, 2) };
+    const vector<GraphPaths> diplotypes = { consistentPhase, inconsistentPhase, unlinkedGenotype };
+
+    const auto compoundLocusSpec = makeLocusSpec(graph, { 1, 3 });
+    const vector<GraphPaths> expectedDiplotypes = { consistentPhase, unlinkedGenotype };
+    REQUIRE(pruneDiplotypesByFlankSnps(compoundLocusSpec, fragById, diplotypes) == expectedDiplotypes);
+
+    const auto singleRepeatLocusSpec = makeLocusSpec(graph, { 1 });
+    REQUIRE(pruneDiplotypesByFlankSnps(singleRepeatLocusSpec, fragById, diplotypes) == diplotypes);
+}
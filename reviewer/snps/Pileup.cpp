@@ -0,0 +1,121 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "snps/Pileup.hh"
+
+using graphtools::NodeId;
+using std::string;
+using std::vector;
+
+namespace snps
+{
+
+PathPileup::PathPileup(const GraphPaths& paths)
+{
+    pathOffsets_.push_back(0);
+    nodeIndexOffsets_.push_back(0);
+    for (const auto& path : paths)
+    {
+        int offset = pathOffsets_.back();
+        for (NodeId node : path.nodeIds())
+        {
+            nodeOffsets_.push_back(offset);
+            offset += static_cast<int>(path.graphRawPtr()->nodeSeq(node).length());
+        }
+        pathOffsets_.push_back(offset);
+        nodeIndexOffsets_.push_back(static_cast<int>(nodeOffsets_.size()));
+    }
+
+    for (auto& column : counts_)
+    {
+        column.assign(pathOffsets_.back(), 0);
+    }
+}
+
+void PathPileup::add(const ReadPathAlign& pathAlign, const string& bases)
+{
+    const int firstNodeOffset = nodeIndexOffsets_[pathAlign.pathIndex] + pathAlign.startIndexOnPath;
+    assert(firstNodeOffset + static_cast<int>(pathAlign.align->size()) <= nodeIndexOffsets_[pathAlign.pathIndex + 1]);
+
+    forEachAlignedBase(
+        *pathAlign.align, bases,
+        [this, firstNodeOffset](int nodeIndex, int offset, int baseIndex)
+        { ++counts_[baseIndex][nodeOffsets_[firstNodeOffset + nodeIndex] + offset]; });
+}
+
+int PathPileup::depth(int pathIndex, int position) const
+{
+    int depth = 0;
+    for (int baseIndex = 0; baseIndex != kNumBases; ++baseIndex)
+    {
+        depth += count(pathIndex, position, baseIndex);
+    }
+    return depth;
+}
+
+FlankPileup::FlankPileup(const graphtools::Graph& graph)
+    : rightFlankNode_(graph.numNodes() - 1)
+    , leftFlankLength_(static_cast<int>(graph.nodeSeq(0).length()))
+{
+    const int numPositions = leftFlankLength_ + static_cast<int>(graph.nodeSeq(rightFlankNode_).length());
+    for (auto& column : counts_)
+    {
+        column.assign(numPositions, 0);
+    }
+}
+
+int FlankPileup::getPosition(NodeId node, int offset) const
+{
+    if (node == 0)
+    {
+        return offset;
+    }
+    if (node == rightFlankNode_)
+    {
+        return leftFlankLength_ + offset;
+    }
+    return -1;
+}
+
+void FlankPileup::add(const GraphAlign& align, const string& bases)
+{
+    forEachAlignedBase(
+        align, bases,
+        [this, &align](int nodeIndex, int offset, int baseIndex)
+        {
+            const int position = getPosition(align.getNodeIdByIndex(nodeIndex), offset);
+            if (position != -1)
+            {
+                ++counts_[baseIndex][position];
+            }
+        });
+}
+
+int FlankPileup::depth(int position) const
+{
+    int depth = 0;
+    for (int baseIndex = 0; baseIndex != kNumBases; ++baseIndex)
+    {
+        depth += count(position, baseIndex);
+    }
+    return depth;
+}
+
+}
@@ -0,0 +1,170 @@
+//
+// REViewer
+// Copyright 2020 Illumina, Inc.
+//
+// Author: Egor Dolzhenko <edolzhenko@illumina.com>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "graphalign/Operation.hh"
+
+#include "core/Aligns.hh"
+
+namespace snps
+{
+
+const int kNumBases = 4;
+
+/// \return Index of the base in "ACGT" or -1 for other characters
+inline int encodeBase(char base)
+{
+    switch (base)
+    {
+    case 'A':
+    case 'a':
+        return 0;
+    case 'C':
+    case 'c':
+        return 1;
+    case 'G':
+    case 'g':
+        return 2;
+    case 'T':
+    case 't':
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+inline char decodeBase(int baseIndex) { return "ACGT"[baseIndex]; }
+
+/// Calls addBase(nodeIndex, offset, baseIndex) for each base of the read aligned to the offset of a node of its path
+template <typename BaseAdder>
+void forEachAlignedBase(const GraphAlign& align, const std::string& bases, BaseAdder addBase)
+{
+    using graphtools::OperationType;
+
+    const auto& nodeAligns = align.alignments();
+    int queryPos = 0;
+    for (int nodeIndex = 0; nodeIndex != static_cast<int>(nodeAligns.size()); ++nodeIndex)
+    {
+        const auto& nodeAlign = nodeAligns[nodeIndex];
+        int refPos = static_cast<int>(nodeAlign.referenceStart());
+        for (const auto& operation : nodeAlign)
+        {
+            const int length = static_cast<int>(operation.length());
+            switch (operation.type())
+            {
+            case OperationType::kMatch:
+            case OperationType::kMismatch:
+                assert(queryPos + length <= static_cast<int>(bases.size()));
+                for (int offset = 0; offset != length; ++offset)
+                {
+                    const int baseIndex = encodeBase(bases[queryPos + offset]);
+                    if (baseIndex != -1)
+                    {
+                        addBase(nodeIndex, refPos + offset, baseIndex);
+                    }
+                }
+                refPos += length;
+                queryPos += length;
+                break;
+            case OperationType::kMissingBases:
+                refPos += length;
+                queryPos += length;
+                break;
+            case OperationType::kInsertionToRef:
+            case OperationType::kSoftclip:
+                queryPos += length;
+                break;
+            case OperationType::kDeletionFromRef:
+                refPos += length;
+                break;
+            }
+        }
+    }
+}
+
+/// Counts of read bases aligned to every position of a set of haplotype paths
+///
+/// The positions of all paths are laid out back to back and the counts of each base are stored in their own column,
+/// so a position of a path is found from the offset of the path plus the offset of the node within the path.
+class PathPileup
+{
+public:
+    explicit PathPileup(const GraphPaths& paths);
+
+    int numPaths() const { return static_cast<int>(pathOffsets_.size()) - 1; }
+    int pathLength(int pathIndex) const { return pathOffsets_[pathIndex + 1] - pathOffsets_[pathIndex]; }
+    /// \return Position of the start of the node on the path
+    int nodeStart(int pathIndex, int nodeIndex) const
+    {
+        return nodeOffsets_[nodeIndexOffsets_[pathIndex] + nodeIndex] - pathOffsets_[pathIndex];
+    }
+
+    /// Adds bases of a read to positions of the path they are aligned to
+    void add(const ReadPathAlign& pathAlign, const std::string& bases);
+
+    int count(int pathIndex, int position, int baseIndex) const
+    {
+        return counts_[baseIndex][pathOffsets_[pathIndex] + position];
+    }
+    int depth(int pathIndex, int position) const;
+
+private:
+    std::vector<int> pathOffsets_;
+    std::vector<int> nodeIndexOffsets_;
+    std::vector<int> nodeOffsets_;
+    std::array<std::vector<uint32_t>, kNumBases> counts_;
+};
+
+/// Counts of read bases aligned to the flanks of a locus graph, with the positions of the left flank followed by those
+/// of the right flank
+class FlankPileup
+{
+public:
+    explicit FlankPileup(const graphtools::Graph& graph);
+
+    int numPositions() const { return static_cast<int>(counts_.front().size()); }
+    /// \return Position of the offset of the node in the pileup or -1 if the node is not a flank
+    int getPosition(graphtools::NodeId node, int offset) const;
+    graphtools::NodeId getNode(int position) const { return position < leftFlankLength_ ? 0 : rightFlankNode_; }
+    int getOffset(int position) const
+    {
+        return position < leftFlankLength_ ? position : position - leftFlankLength_;
+    }
+
+    /// Adds bases of a read aligned to the locus graph
+    void add(const GraphAlign& align, const std::string& bases);
+
+    int count(int position, int baseIndex) const { return counts_[baseIndex][position]; }
+    int depth(int position) const;
+
+private:
+    graphtools::NodeId rightFlankNode_;
+    int leftFlankLength_;
+    std::array<std::vector<uint32_t>, kNumBases> counts_;
+};
+
+}
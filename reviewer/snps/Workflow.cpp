@@ -20,14 +20,89 @@
 
 #include "snps/Workflow.hh"
 
+#include "snps/Pileup.hh"
+
+using graphtools::NodeId;
+using std::string;
+using std::vector;
+
 namespace snps
 {
 
+// A base is called if it is seen on at least this many reads and makes up at least this fraction of the depth
+static const int kMinAltCount = 2;
+static const double kMinAltFraction = 0.8;
+
+static vector<SnpCall> callFlankSnps(const PathPileup& pileup, const GraphPath& path, int pathIndex)
+{
+    const auto& graph = *path.graphRawPtr();
+    const NodeId rightFlankNode = graph.numNodes() - 1;
+
+    vector<SnpCall> calls;
+    for (int nodeIndex = 0; nodeIndex != static_cast<int>(path.numNodes()); ++nodeIndex)
+    {
+        const NodeId node = path.getNodeIdByIndex(nodeIndex);
+        if (node != 0 && node != rightFlankNode)
+        {
+            continue;
+        }
+
+        const string& nodeSeq = graph.nodeSeq(node);
+        const int nodeStart = pileup.nodeStart(pathIndex, nodeIndex);
+        for (int offset = 0; offset != static_cast<int>(nodeSeq.length()); ++offset)
+        {
+            const int refBaseIndex = encodeBase(nodeSeq[offset]);
+            if (refBaseIndex == -1)
+            {
+                continue;
+            }
+
+            const int position = nodeStart + offset;
+            int altBaseIndex = -1;
+            int altCount = 0;
+            for (int baseIndex = 0; baseIndex != kNumBases; ++baseIndex)
+            {
+                const int count = pileup.count(pathIndex, position, baseIndex);
+                if (baseIndex != refBaseIndex && count > altCount)
+                {
+                    altBaseIndex = baseIndex;
+                    altCount = count;
+                }
+            }
+
+            const int depth = pileup.depth(pathIndex, position);
+            if (altCount >= kMinAltCount && altCount >= kMinAltFraction * depth)
+            {
+                calls.emplace_back(node, offset, nodeSeq[offset], decodeBase(altBaseIndex), altCount, depth);
+            }
+        }
+    }
+
+    return calls;
+}
+
 SnpCalls callSnps(
     GraphPaths paths, const FragById& fragById, const FragAssignment& fragAssignment,
     const FragPathAlignsById& fragPathAlignsById)
 {
-    return {};
+    PathPileup pileup(paths);
+    for (int fragIndex = 0; fragIndex != static_cast<int>(fragAssignment.fragIds.size()); ++fragIndex)
+    {
+        const auto& fragId = fragAssignment.fragIds[fragIndex];
+        const int alignIndex = fragAssignment.alignIndexByFrag[fragIndex];
+        const auto& fragPathAlign = fragPathAlignsById.at(fragId)[alignIndex];
+        const auto& frag = fragById.at(fragId);
+        pileup.add(fragPathAlign.readAlign, frag.read.bases);
+        pileup.add(fragPathAlign.mateAlign, frag.mate.bases);
+    }
+
+    vector<vector<SnpCall>> callsByHap;
+    for (int pathIndex = 0; pathIndex != static_cast<int>(paths.size()); ++pathIndex)
+    {
+        callsByHap.push_back(callFlankSnps(pileup, paths[pathIndex], pathIndex));
+    }
+
+    return SnpCalls(std::move(callsByHap));
 }
 
-}
\ No newline at end of file
+}
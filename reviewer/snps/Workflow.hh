@@ -27,12 +27,55 @@
 namespace snps
 {
 
+/// Base that differs from the reference base of a flank position in the reads assigned to a haplotype
+struct SnpCall
+{
+    SnpCall(graphtools::NodeId node, int offset, char refBase, char altBase, int altCount, int depth)
+        : node(node)
+        , offset(offset)
+        , refBase(refBase)
+        , altBase(altBase)
+        , altCount(altCount)
+        , depth(depth)
+    {
+    }
+
+    bool operator==(const SnpCall& other) const
+    {
+        return node == other.node && offset == other.offset && refBase == other.refBase && altBase == other.altBase
+            && altCount == other.altCount && depth == other.depth;
+    }
+
+    graphtools::NodeId node;
+    int offset;
+    char refBase;
+    char altBase;
+    int altCount;
+    int depth;
+};
+
 class SnpCalls
 {
 public:
-    bool operator==(const SnpCalls& other) const { return true; }
+    SnpCalls() = default;
+    explicit SnpCalls(std::vector<std::vector<SnpCall>> callsByHap)
+        : callsByHap_(std::move(callsByHap))
+    {
+    }
+
+    int numHaplotypes() const { return static_cast<int>(callsByHap_.size()); }
+    /// \return Calls on the haplotype in the order of their positions on its path
+    const std::vector<SnpCall>& getCalls(int hapIndex) const { return callsByHap_[hapIndex]; }
+
+    bool operator==(const SnpCalls& other) const { return callsByHap_ == other.callsByHap_; }
+
+private:
+    std::vector<std::vector<SnpCall>> callsByHap_;
 };
 
+/// Calls SNPs in the flanks of each haplotype from the reads assigned to it
+///
+/// Reads are piled up in a single pass, so the running time is linear in the number of aligned bases
 SnpCalls callSnps(
     GraphPaths paths, const FragById& fragById, const FragAssignment& fragAssignment,
     const FragPathAlignsById& fragPathAlignsById);
@@ -20,10 +20,64 @@
 
 #include "snps/Workflow.hh"
 
+#include <string>
+#include <vector>
+
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
 #include <catch2/catch.hpp>
 
+#include "graphalign/GraphAlignmentOperations.hh"
+#include "graphcore/GraphBuilders.hh"
+
+#include "snps/Pileup.hh"
+
+using graphtools::Graph;
+using std::string;
+using std::vector;
+
 using namespace snps;
 
+struct TestRead
+{
+    int startIndexOnPath;
+    int firstNodeStart;
+    string graphCigar;
+    string bases;
+};
+
+struct TestFrags
+{
+    TestFrags()
+        : fragAssignment({}, {})
+    {
+    }
+
+    void add(const GraphPaths& paths, int pathIndex, const TestRead& read, const TestRead& mate)
+    {
+        const string fragId = "frag" + std::to_string(fragById.size());
+        const Graph* graph = paths[pathIndex].graphRawPtr();
+        const auto readAlign = graphtools::decodeGraphAlignment(read.firstNodeStart, read.graphCigar, graph);
+        const auto mateAlign = graphtools::decodeGraphAlignment(mate.firstNodeStart, mate.graphCigar, graph);
+
+        const string readQuals(read.bases.size(), '#');
+        const string mateQuals(mate.bases.size(), '#');
+        fragById.emplace(fragId, Frag(Read(read.bases, readQuals, readAlign), Read(mate.bases, mateQuals, mateAlign)));
+
+        ReadPathAlign readPathAlign(
+            paths[pathIndex], pathIndex, read.startIndexOnPath, std::make_shared<GraphAlign>(readAlign));
+        ReadPathAlign matePathAlign(
+            paths[pathIndex], pathIndex, mate.startIndexOnPath, std::make_shared<GraphAlign>(mateAlign));
+        fragPathAlignsById[fragId].emplace_back(readPathAlign, matePathAlign);
+
+        fragAssignment.fragIds.push_back(fragId);
+        fragAssignment.alignIndexByFrag.push_back(0);
+    }
+
+    FragById fragById;
+    FragAssignment fragAssignment;
+    FragPathAlignsById fragPathAlignsById;
+};
+
 TEST_CASE("Initializing SNP calling workflow", "[SNP calling]")
 {
     GraphPaths paths;
@@ -33,3 +87,105 @@ TEST_CASE("Initializing SNP calling workflow", "[SNP calling]")
     auto snpCalls = callSnps(paths, fragById, fragAssignment, fragPathAlignsById);
     REQUIRE(snpCalls == SnpCalls());
 }
+
+TEST_CASE("Flank SNPs are called on the haplotypes of their reads", "[SNP calling]")
+{
+    const Graph graph = graphtools::makeStrGraph("ACGTACGTAC", "CAG", "TTGACCATGA");
+    const GraphPaths paths
+        = { GraphPath(&graph, 0, { 0, 1, 1, 2 }, 10), GraphPath(&graph, 0, { 0, 1, 1, 1, 2 }, 10) };
+
+    const TestRead snpRead = { 0, 0, "0[3M1X6M]1[3M]1[3M]", "ACGCACGTACCAGCAG" };
+    const TestRead refRead = { 0, 0, "0[10M]1[3M]1[3M]", "ACGTACGTACCAGCAG" };
+    TestFrags frags;
+    for (int fragIndex = 0; fragIndex != 3; ++fragIndex)
+    {
+        frags.add(paths, 0, snpRead, { 3, 0, "2[10M]", "TTGACCATGA" });
+    }
+    for (int fragIndex = 0; fragIndex != 2; ++fragIndex)
+    {
+        frags.add(paths, 1, refRead, { 4, 0, "2[10M]", "TTGACCATGA" });
+    }
+    frags.add(paths, 1, snpRead, { 4, 0, "2[10M]", "TTGACCATGA" });
+
+    PathPileup pileup(paths);
+    REQUIRE(pileup.numPaths() == 2);
+    REQUIRE(pileup.pathLength(1) == 29);
+    REQUIRE(pileup.nodeStart(1, 4) == 19);
+
+    const auto snpCalls = callSnps(paths, frags.fragById, frags.fragAssignment, frags.fragPathAlignsById);
+    const vector<SnpCall> hap1Calls = { SnpCall(0, 3, 'T', 'C', 3, 3) };
+    REQUIRE(snpCalls.numHaplotypes() == 2);
+    REQUIRE(snpCalls.getCalls(0) == hap1Calls);
+    REQUIRE(snpCalls.getCalls(1).empty());
+}
+
+TEST_CASE("Reads are piled up across clips, indels, and repeat nodes", "[SNP calling]")
+{
+    const Graph graph = graphtools::makeStrGraph("ACGTACGTAC", "CAG", "TTGACCATGA");
+    const GraphPaths paths = { GraphPath(&graph, 0, { 0, 1, 1, 2 }, 10) };
+
+    const TestRead mate = { 2, 0, "1[1X2M]2[8M1X1M]", "TAGTTGACCATAA" };
+    TestFrags frags;
+    for (int fragIndex = 0; fragIndex != 2; ++fragIndex)
+    {
+        frags.add(paths, 0, { 0, 0, "0[2S3M1I4M]", "GGACGATACG" }, mate);
+        frags.add(paths, 0, { 0, 2, "0[2M2D4M]", "GTGTAC" }, mate);
+    }
+
+    PathPileup pileup(paths);
+    for (const auto& fragIdAndAligns : frags.fragPathAlignsById)
+    {
+        const auto& frag = frags.fragById.at(fragIdAndAligns.first);
+        pileup.add(fragIdAndAligns.second.front().readAlign, frag.read.bases);
+        pileup.add(fragIdAndAligns.second.front().mateAlign, frag.mate.bases);
+    }
+    REQUIRE(pileup.depth(0, 0) == 2);
+    REQUIRE(pileup.count(0, 3, encodeBase('T')) == 4);
+    REQUIRE(pileup.depth(0, 4) == 2);
+    REQUIRE(pileup.depth(0, 6) == 4);
+    REQUIRE(pileup.count(0, 16, encodeBase('T')) == 4);
+
+    const auto snpCalls = callSnps(paths, frags.fragById, frags.fragAssignment, frags.fragPathAlignsById);
+    const vector<SnpCall> calls = { SnpCall(2, 8, 'G', 'A', 4, 4) };
+    REQUIRE(snpCalls.getCalls(0) == calls);
+}
+
+static string makeFlank(int length, unsigned seed)
+{
+    string flank;
+    for (int position = 0; position != length; ++position)
+    {
+        seed = seed * 1103515245 + 12345;
+        flank.push_back(decodeBase((seed >> 16) % kNumBases));
+    }
+    return flank;
+}
+
+TEST_CASE("Throughput of SNP calling", "[SNP calling][!benchmark]")
+{
+    const int flankLength = 1000;
+    const int readLength = 150;
+    const int numFrags = 10000;
+    const Graph graph = graphtools::makeStrGraph(makeFlank(flankLength, 1), "CAG", makeFlank(flankLength, 2));
+    vector<graphtools::NodeId> nodes(20, 1);
+    nodes.insert(nodes.begin(), 0);
+    nodes.push_back(2);
+    const GraphPaths paths = { GraphPath(&graph, 0, nodes, flankLength) };
+
+    TestFrags frags;
+    const string cigar = "[" + std::to_string(readLength) + "M]";
+    for (int fragIndex = 0; fragIndex != numFrags; ++fragIndex)
+    {
+        const int start = fragIndex % (flankLength - readLength);
+        const TestRead read = { 0, start, "0" + cigar, graph.nodeSeq(0).substr(start, readLength) };
+        const int mateStart = flankLength - readLength - start;
+        const TestRead mate = { static_cast<int>(nodes.size()) - 1, mateStart, "2" + cigar,
+                                graph.nodeSeq(2).substr(mateStart, readLength) };
+        frags.add(paths, 0, read, mate);
+    }
+
+    BENCHMARK("Pileup of 3M aligned bases")
+    {
+        return callSnps(paths, frags.fragById, frags.fragAssignment, frags.fragPathAlignsById);
+    };
+}